@@ -0,0 +1,415 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include "header/socket.hpp"
+#include "header/stream_channel.hpp"
+#include "header/impairment.hpp"
+#include "header/logger.hpp"
+
+/**
+ * End-to-end transfer benchmark.
+ *
+ * Every case runs a sender and a receiver in one process over loopback,
+ * optionally through an in-process ImpairmentProxy. Data is streamed
+ * through StreamChannels so memory stays flat up to 10 GB. Each case runs
+ * in a forked child so that its CPU time and peak RSS can be measured on
+ * their own.
+ *
+ * The results go out as JSON, one case per line. With --baseline they are
+ * compared against an earlier result file, and a slower case fails the run.
+ */
+
+using namespace std;
+
+struct BenchCase {
+    string name;
+    uint64_t bytes;
+    int window;
+    bool selectiveRepeat;
+    bool impaired;
+    bool sharedMemory;
+    ImpairmentProfile profile;
+    int runs;
+};
+
+struct BenchResult {
+    string name;
+    uint64_t bytes = 0;
+    int runs = 0;
+    int failures = 0;
+    double throughputMBps = 0;
+    double cpuSecondsPerGB = 0;
+    double p50Ms = 0;
+    double p99Ms = 0;
+    long peakRssKB = 0;
+};
+
+struct BenchOptions {
+    bool full = false;
+    int runs = 0;  // 0: depends on the transfer size
+    int basePort = 47000;
+    double tolerance = 0.25;
+    string filter;
+    string output;
+    string baseline;
+};
+
+static string sizeName(uint64_t bytes) {
+    static const char* UNITS[] = {"B", "KB", "MB", "GB"};
+    int unit = 0;
+    while (unit < 3 && bytes >= 1024 && bytes % 1024 == 0) {
+        bytes /= 1024;
+        unit++;
+    }
+    return to_string(bytes) + UNITS[unit];
+}
+
+static vector<BenchCase> buildCases(const BenchOptions& options) {
+    const uint64_t KB = 1024, MB = 1024 * KB, GB = 1024 * MB;
+
+    ImpairmentProfile wan;
+    wan.delayMs = 5;
+    wan.rateMbit = 200;
+    ImpairmentProfile lossy;
+    lossy.delayMs = 1;
+    lossy.loss = 0.005;
+
+    struct Profile { string name; bool impaired; bool sharedMemory; ImpairmentProfile profile; };
+    vector<Profile> profiles = {{"clean", false, false, {}}, {"wan", true, false, wan}, {"lossy", true, false, lossy},
+                                {"shm", false, true, {}}};
+
+    // Without congestion control a 255 segment burst overruns the receiver's
+    // socket buffer on loopback and every loss costs a retransmission timeout
+    vector<uint64_t> sizes = {KB, 64 * KB, MB, 16 * MB};
+    vector<int> windows = {3, 16, 64};
+    if (options.full) {
+        sizes.insert(sizes.end(), {256 * MB, GB, 10 * GB});
+        windows.push_back(255);
+    }
+
+    vector<BenchCase> cases;
+    for (const Profile& profile : profiles) {
+        for (bool selectiveRepeat : {false, true}) {
+            for (int window : windows) {
+                for (uint64_t bytes : sizes) {
+                    // Every loss costs a full retransmission timeout, keep impaired cases short
+                    if (profile.impaired && (bytes > (profile.name == "lossy" ? 256 * KB : 16 * MB) || window == 3)) {
+                        continue;
+                    }
+                    // Large transfers only with one wide window, the rest adds nothing but time
+                    if (bytes > 16 * MB && window != 64) {
+                        continue;
+                    }
+                    // Shared memory sends no data segments, window and mode do not matter
+                    if (profile.sharedMemory && (selectiveRepeat || window != 64)) {
+                        continue;
+                    }
+                    BenchCase benchCase;
+                    benchCase.name = profile.name + "/" + (selectiveRepeat ? "sr" : "gbn") + "/w" + to_string(window) + "/" + sizeName(bytes);
+                    benchCase.bytes = bytes;
+                    benchCase.window = window;
+                    benchCase.selectiveRepeat = selectiveRepeat;
+                    benchCase.impaired = profile.impaired;
+                    benchCase.sharedMemory = profile.sharedMemory;
+                    benchCase.profile = profile.profile;
+                    benchCase.runs = options.runs > 0 ? options.runs : bytes >= GB ? 1 : bytes >= 256 * MB || profile.impaired ? 3 : 5;
+                    if (options.filter.empty() || benchCase.name.find(options.filter) != string::npos) {
+                        cases.push_back(benchCase);
+                    }
+                }
+            }
+        }
+    }
+    return cases;
+}
+
+/**
+ * One transfer, from the handshake to the last byte read by the application
+ * @return Seconds, or -1 if the bytes read do not match
+ */
+static double runTransfer(const BenchCase& benchCase, int senderPort, int receiverPort, int proxyPort) {
+    StreamChannel sendChannel;
+    StreamChannel recvChannel;
+    uint64_t received = 0;
+
+    ImpairmentProxy* proxy = nullptr;
+    thread proxyThread;
+    if (benchCase.impaired) {
+        struct sockaddr_in target = {};
+        target.sin_family = AF_INET;
+        target.sin_port = htons(senderPort);
+        target.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        proxy = new ImpairmentProxy(proxyPort, target, benchCase.profile);
+        proxyThread = thread([proxy]() { proxy->run(); });
+    }
+
+    auto start = chrono::steady_clock::now();
+    chrono::steady_clock::time_point end;
+
+    thread sender([&]() {
+        TCPSocket socket("0.0.0.0", senderPort);
+        socket.setWindowSize(benchCase.window);
+        socket.setSelectiveRepeat(benchCase.selectiveRepeat);
+        socket.setSharedMemory(benchCase.sharedMemory);
+        socket.listen();
+        struct sockaddr_in peer = socket.createAddr("127.0.0.1", receiverPort);
+        if (socket.doHandshake(peer)) {
+            socket.sendStream(sendChannel);
+        } else {
+            // Unblock the producer
+            vector<uint8_t> discard(1 << 16);
+            while (sendChannel.read(discard.data(), discard.size()) > 0) {
+            }
+        }
+        socket.close();
+    });
+
+    thread producer([&]() {
+        vector<uint8_t> chunk(1 << 20);
+        for (size_t i = 0; i < chunk.size(); i++) {
+            chunk[i] = uint8_t(i * 31 + 7);
+        }
+        for (uint64_t sent = 0; sent < benchCase.bytes; ) {
+            size_t length = min<uint64_t>(chunk.size(), benchCase.bytes - sent);
+            sent += sendChannel.write(chunk.data(), length);
+        }
+        sendChannel.close();
+    });
+
+    thread receiver([&]() {
+        TCPSocket socket("0.0.0.0", receiverPort);
+        socket.setWindowSize(benchCase.window);
+        socket.setSelectiveRepeat(benchCase.selectiveRepeat);
+        socket.setSharedMemory(benchCase.sharedMemory);
+        struct sockaddr_in peer = socket.createAddr("127.0.0.1", benchCase.impaired ? proxyPort : senderPort);
+        if (socket.doHandshake(peer)) {
+            socket.recvStream(recvChannel);
+        } else {
+            recvChannel.close();
+        }
+        socket.close();
+    });
+
+    vector<uint8_t> buffer(1 << 20);
+    size_t n;
+    while ((n = recvChannel.read(buffer.data(), buffer.size())) > 0) {
+        received += n;
+    }
+    end = chrono::steady_clock::now();
+
+    producer.join();
+    receiver.join();
+    sender.join();
+    if (proxy) {
+        proxy->stop();
+        proxyThread.join();
+        delete proxy;
+    }
+
+    if (received != benchCase.bytes) {
+        return -1;
+    }
+    return chrono::duration<double>(end - start).count();
+}
+
+static double percentile(vector<double> values, double p) {
+    sort(values.begin(), values.end());
+    size_t rank = size_t(p * values.size() + 0.999999);
+    return values[min(values.size(), max<size_t>(rank, 1)) - 1];
+}
+
+/**
+ * Run every repetition of a case in a child process, CPU time and peak RSS
+ * then belong to this case alone
+ */
+static BenchResult runCase(const BenchCase& benchCase, int basePort) {
+    BenchResult result;
+    result.name = benchCase.name;
+    result.bytes = benchCase.bytes;
+    result.runs = benchCase.runs;
+
+    int pipeFds[2];
+    if (pipe(pipeFds) < 0) {
+        result.failures = benchCase.runs;
+        return result;
+    }
+
+    pid_t child = fork();
+    if (child == 0) {
+        ::close(pipeFds[0]);
+        // A stalled transfer kills the child, its runs count as failures
+        alarm(benchCase.runs * max<uint64_t>(60, benchCase.bytes / 5000000));
+        ostringstream times;
+        for (int run = 0; run < benchCase.runs; run++) {
+            // Fresh ports every run, a late segment of the previous one cannot interfere
+            int port = basePort + (run % 100) * 3;
+            times << runTransfer(benchCase, port, port + 1, port + 2) << "\n";
+        }
+        string text = times.str();
+        if (write(pipeFds[1], text.data(), text.size()) < 0) {
+            // The parent counts the missing runs as failures
+        }
+        Logger::flush();
+        _exit(0);
+    }
+    ::close(pipeFds[1]);
+
+    string text;
+    char chunk[256];
+    ssize_t n;
+    while ((n = read(pipeFds[0], chunk, sizeof(chunk))) > 0) {
+        text.append(chunk, n);
+    }
+    ::close(pipeFds[0]);
+
+    int status;
+    struct rusage usage;
+    wait4(child, &status, 0, &usage);
+
+    vector<double> seconds;
+    istringstream lines(text);
+    double value;
+    while (lines >> value) {
+        if (value >= 0) {
+            seconds.push_back(value);
+        }
+    }
+    result.failures = benchCase.runs - seconds.size();
+    if (seconds.empty()) {
+        return result;
+    }
+
+    double cpuSeconds = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+    result.p50Ms = percentile(seconds, 0.5) * 1000;
+    result.p99Ms = percentile(seconds, 0.99) * 1000;
+    result.throughputMBps = benchCase.bytes / 1e6 / (result.p50Ms / 1000);
+    result.cpuSecondsPerGB = cpuSeconds / (double(benchCase.bytes) * benchCase.runs / 1e9);
+    result.peakRssKB = usage.ru_maxrss;
+    return result;
+}
+
+static string toJson(const BenchResult& r) {
+    ostringstream json;
+    json << "{\"name\":\"" << r.name << "\",\"bytes\":" << r.bytes << ",\"runs\":" << r.runs
+         << ",\"failures\":" << r.failures << ",\"throughputMBps\":" << r.throughputMBps
+         << ",\"cpuSecondsPerGB\":" << r.cpuSecondsPerGB << ",\"p50Ms\":" << r.p50Ms
+         << ",\"p99Ms\":" << r.p99Ms << ",\"peakRssKB\":" << r.peakRssKB << "}";
+    return json.str();
+}
+
+static double jsonNumber(const string& line, const string& key) {
+    size_t at = line.find("\"" + key + "\":");
+    return at == string::npos ? -1 : stod(line.substr(at + key.size() + 3));
+}
+
+/**
+ * Cases of an earlier result file by name, as written by toJson (one per line)
+ */
+static map<string, BenchResult> loadBaseline(const string& path) {
+    map<string, BenchResult> baseline;
+    ifstream file(path);
+    string line;
+    while (getline(file, line)) {
+        size_t at = line.find("\"name\":\"");
+        if (at == string::npos) {
+            continue;
+        }
+        BenchResult result;
+        result.name = line.substr(at + 8, line.find('"', at + 8) - at - 8);
+        result.throughputMBps = jsonNumber(line, "throughputMBps");
+        result.p50Ms = jsonNumber(line, "p50Ms");
+        baseline[result.name] = result;
+    }
+    return baseline;
+}
+
+int main(int argc, char* argv[]) {
+    BenchOptions options;
+    for (int i = 1; i < argc; i++) {
+        string flag = argv[i];
+        if (flag == "--full") {
+            options.full = true;
+        } else if (flag == "--runs" && i + 1 < argc) {
+            options.runs = stoi(argv[++i]);
+        } else if (flag == "--port" && i + 1 < argc) {
+            options.basePort = stoi(argv[++i]);
+        } else if (flag == "--filter" && i + 1 < argc) {
+            options.filter = argv[++i];
+        } else if (flag == "--output" && i + 1 < argc) {
+            options.output = argv[++i];
+        } else if (flag == "--baseline" && i + 1 < argc) {
+            options.baseline = argv[++i];
+        } else if (flag == "--tolerance" && i + 1 < argc) {
+            options.tolerance = stod(argv[++i]);
+        } else {
+            cerr << "Usage: node_bench [--full] [--runs N] [--port BASE] [--filter TEXT] [--output FILE]"
+                 << " [--baseline FILE] [--tolerance FRACTION]" << endl;
+            return 1;
+        }
+    }
+
+    // Handshake and close lines of every run would drown the report
+    Logger::setLevel(LOG_LEVEL_ERROR);
+
+    map<string, BenchResult> baseline;
+    if (!options.baseline.empty()) {
+        baseline = loadBaseline(options.baseline);
+        if (baseline.empty()) {
+            cerr << "No cases in baseline " << options.baseline << ", comparing nothing" << endl;
+        }
+    }
+
+    vector<BenchCase> cases = buildCases(options);
+    vector<BenchResult> results;
+    int regressions = 0;
+    int failures = 0;
+    for (const BenchCase& benchCase : cases) {
+        BenchResult result = runCase(benchCase, options.basePort);
+        results.push_back(result);
+        failures += result.failures;
+
+        cerr << result.name << ": " << result.throughputMBps << " MB/s, p50 " << result.p50Ms << " ms, p99 "
+             << result.p99Ms << " ms, " << result.cpuSecondsPerGB << " CPU s/GB, " << result.peakRssKB << " KB RSS";
+        if (result.failures > 0) {
+            cerr << ", " << result.failures << " FAILED";
+        }
+        auto base = baseline.find(result.name);
+        if (base != baseline.end() && base->second.throughputMBps > 0) {
+            double change = result.throughputMBps / base->second.throughputMBps - 1;
+            cerr << " (" << (change >= 0 ? "+" : "") << change * 100 << "% vs baseline)";
+            if (change < -options.tolerance) {
+                cerr << " REGRESSION";
+                regressions++;
+            }
+        }
+        cerr << endl;
+    }
+
+    ofstream file;
+    if (!options.output.empty()) {
+        file.open(options.output);
+    }
+    ostream& out = options.output.empty() ? cout : file;
+    out << "{\"cases\":[\n";
+    for (size_t i = 0; i < results.size(); i++) {
+        out << toJson(results[i]) << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    out << "]}" << endl;
+
+    if (regressions > 0 || failures > 0) {
+        cerr << regressions << " regressions, " << failures << " failed runs" << endl;
+        return 1;
+    }
+    return 0;
+}
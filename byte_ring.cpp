@@ -0,0 +1,89 @@
+#include "header/byte_ring.hpp"
+#include <algorithm>
+#include <cstring>
+
+ByteRing::ByteRing(size_t capacity) :
+    readPos(0),
+    cachedWritePos(0),
+    writePos(0),
+    cachedReadPos(0),
+    closed(false) {
+
+    size = 1;
+    while (size < capacity) {
+        size <<= 1;
+    }
+    mask = size - 1;
+    buffer = new uint8_t[size];
+}
+
+ByteRing::~ByteRing() {
+    delete[] buffer;
+}
+
+size_t ByteRing::write(const uint8_t* data, size_t length) {
+    size_t tail = writePos.load(std::memory_order_relaxed);
+
+    // Only look at the consumer's position when the cached one says full
+    if (size - (tail - cachedReadPos) < length) {
+        cachedReadPos = readPos.load(std::memory_order_acquire);
+    }
+    length = std::min(length, size - (tail - cachedReadPos));
+    if (length == 0) {
+        return 0;
+    }
+
+    // At most two copies, the second one after wrapping around
+    size_t offset = tail & mask;
+    size_t first = std::min(length, size - offset);
+    std::memcpy(buffer + offset, data, first);
+    std::memcpy(buffer, data + first, length - first);
+
+    writePos.store(tail + length, std::memory_order_release);
+    return length;
+}
+
+size_t ByteRing::read(uint8_t* data, size_t length) {
+    size_t head = readPos.load(std::memory_order_relaxed);
+
+    if (cachedWritePos - head < length) {
+        cachedWritePos = writePos.load(std::memory_order_acquire);
+    }
+    length = std::min(length, cachedWritePos - head);
+    if (length == 0) {
+        return 0;
+    }
+
+    size_t offset = head & mask;
+    size_t first = std::min(length, size - offset);
+    std::memcpy(data, buffer + offset, first);
+    std::memcpy(data + first, buffer, length - first);
+
+    readPos.store(head + length, std::memory_order_release);
+    return length;
+}
+
+size_t ByteRing::readable() const {
+    return writePos.load(std::memory_order_acquire) - readPos.load(std::memory_order_relaxed);
+}
+
+size_t ByteRing::writable() const {
+    return size - (writePos.load(std::memory_order_relaxed) - readPos.load(std::memory_order_acquire));
+}
+
+size_t ByteRing::capacity() const {
+    return size;
+}
+
+void ByteRing::close() {
+    closed.store(true, std::memory_order_release);
+}
+
+bool ByteRing::isClosed() const {
+    return closed.load(std::memory_order_acquire);
+}
+
+bool ByteRing::isDrained() const {
+    // Closed first: every write happened before close, so readable() sees them
+    return isClosed() && readable() == 0;
+}
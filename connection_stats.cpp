@@ -0,0 +1,42 @@
+#include "header/connection_stats.hpp"
+#include <cmath>
+#include <sstream>
+
+// In TCPStatusEnum order, starting at CLOSED (-1)
+static const char* STATE_NAMES[TCP_STATE_COUNT] = {
+    "CLOSED", "LISTEN", "SYN_SENT", "SYN_RECEIVED", "ESTABLISHED", "FIN_WAIT_1",
+    "FIN_WAIT_2", "CLOSE_WAIT", "CLOSING", "LAST_ACK", "TIME_WAIT"
+};
+
+void ConnectionStats::addRttSample(double rttMs) {
+    if (rttSamples == 0) {
+        srttMs = rttMs;
+        rttvarMs = rttMs / 2;
+    } else {
+        rttvarMs = 0.75 * rttvarMs + 0.25 * std::fabs(srttMs - rttMs);
+        srttMs = 0.875 * srttMs + 0.125 * rttMs;
+    }
+    rttSamples++;
+}
+
+std::string ConnectionStats::toJson() const {
+    std::ostringstream json;
+    json << "{\"bytesSent\":" << bytesSent
+         << ",\"bytesReceived\":" << bytesReceived
+         << ",\"segmentsSent\":" << segmentsSent
+         << ",\"segmentsReceived\":" << segmentsReceived
+         << ",\"retransmits\":" << retransmits
+         << ",\"duplicateAcks\":" << duplicateAcks
+         << ",\"checksumFailures\":" << checksumFailures
+         << ",\"srttMs\":" << srttMs
+         << ",\"rttvarMs\":" << rttvarMs
+         << ",\"rttSamples\":" << rttSamples
+         << ",\"cwnd\":" << cwnd
+         << ",\"rwnd\":" << rwnd
+         << ",\"stateSeconds\":{";
+    for (int i = 0; i < TCP_STATE_COUNT; i++) {
+        json << (i > 0 ? "," : "") << "\"" << STATE_NAMES[i] << "\":" << stateSeconds[i];
+    }
+    json << "}}";
+    return json.str();
+}
@@ -0,0 +1,112 @@
+#include "header/connection_table.hpp"
+
+ConnectionKey makeConnectionKey(const struct sockaddr_in& remote, const struct sockaddr_in& local) {
+    ConnectionKey key;
+    key.remoteAddr = remote.sin_addr.s_addr;
+    key.localAddr = local.sin_addr.s_addr;
+    key.remotePort = remote.sin_port;
+    key.localPort = local.sin_port;
+    return key;
+}
+
+ConnectionTable::ConnectionTable(size_t capacity) : count(0) {
+    size_t size = 8;
+    while (size < capacity) {
+        size <<= 1;
+    }
+    slots.assign(size, Slot{});
+    mask = size - 1;
+}
+
+uint32_t ConnectionTable::hashKey(const ConnectionKey& key) {
+    uint64_t h = (static_cast<uint64_t>(key.remoteAddr) << 32) |
+                 (static_cast<uint64_t>(key.remotePort) << 16) | key.localPort;
+    h ^= static_cast<uint64_t>(key.localAddr) * 0x9e3779b97f4a7c15ULL;
+
+    // MurmurHash3 finalizer, spreads nearby addresses and ports over the table
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return static_cast<uint32_t>(h);
+}
+
+size_t ConnectionTable::probe(const ConnectionKey& key, uint32_t hash) const {
+    size_t index = hash & mask;
+    while (slots[index].value && !(slots[index].hash == hash && slots[index].key == key)) {
+        index = (index + 1) & mask;
+    }
+    return index;
+}
+
+void ConnectionTable::grow() {
+    std::vector<Slot> old;
+    old.swap(slots);
+    slots.assign(old.size() * 2, Slot{});
+    mask = slots.size() - 1;
+
+    for (const Slot& slot : old) {
+        if (slot.value) {
+            slots[probe(slot.key, slot.hash)] = slot;
+        }
+    }
+}
+
+ConnectionTransport* ConnectionTable::find(const ConnectionKey& key) const {
+    return slots[probe(key, hashKey(key))].value;
+}
+
+void ConnectionTable::insert(const ConnectionKey& key, ConnectionTransport* value) {
+    // Keep the load factor at or below one half
+    if ((count + 1) * 2 > slots.size()) {
+        grow();
+    }
+
+    uint32_t hash = hashKey(key);
+    Slot& slot = slots[probe(key, hash)];
+    if (!slot.value) {
+        count++;
+    }
+    slot.key = key;
+    slot.hash = hash;
+    slot.value = value;
+}
+
+bool ConnectionTable::erase(const ConnectionKey& key) {
+    size_t hole = probe(key, hashKey(key));
+    if (!slots[hole].value) {
+        return false;
+    }
+
+    // Backward shift: move later entries of the cluster into the hole when
+    // their home slot does not lie between the hole and their position
+    size_t index = hole;
+    while (true) {
+        index = (index + 1) & mask;
+        if (!slots[index].value) {
+            break;
+        }
+        size_t home = slots[index].hash & mask;
+        if (((index - home) & mask) >= ((index - hole) & mask)) {
+            slots[hole] = slots[index];
+            hole = index;
+        }
+    }
+
+    slots[hole].value = nullptr;
+    count--;
+    return true;
+}
+
+size_t ConnectionTable::size() const {
+    return count;
+}
+
+void ConnectionTable::forEach(const std::function<void(ConnectionTransport*)>& callback) const {
+    for (const Slot& slot : slots) {
+        if (slot.value) {
+            callback(slot.value);
+        }
+    }
+}
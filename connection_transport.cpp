@@ -0,0 +1,145 @@
+#include "header/connection_transport.hpp"
+#include "header/listener.hpp"
+#include "header/event_loop.hpp"
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <chrono>
+#include <stdexcept>
+
+ConnectionTransport::ConnectionTransport(TCPListener* listener, Transport* shared, const ConnectionKey& key, uint32_t connectionId) :
+    listener(listener),
+    shared(shared),
+    key(key),
+    connectionId(connectionId) {
+
+    readyFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (readyFd < 0) {
+        throw std::runtime_error("eventfd creation failed");
+    }
+}
+
+ConnectionTransport::~ConnectionTransport() {
+    close();
+}
+
+const ConnectionKey& ConnectionTransport::getKey() const {
+    return key;
+}
+
+uint32_t ConnectionTransport::getConnectionId() const {
+    return connectionId;
+}
+
+void ConnectionTransport::clearReady() {
+    uint64_t count;
+    while (read(readyFd, &count, sizeof(count)) == sizeof(count)) {}
+}
+
+void ConnectionTransport::deliver(const Segment& segment, const struct sockaddr_in& addr, int32_t length) {
+    if (readyFd < 0) {
+        return;
+    }
+
+    queue.emplace_back();
+    Datagram& datagram = queue.back();
+    if (!spare.empty()) {
+        datagram.payload.swap(spare.back());
+        spare.pop_back();
+    }
+
+    datagram.segment = segment;
+    datagram.payload.assign(segment.payload, segment.payload + segment.payloadSize);
+    datagram.addr = addr;
+    datagram.length = length;
+
+    if (queue.size() == 1) {
+        uint64_t one = 1;
+        if (write(readyFd, &one, sizeof(one)) < 0) {
+            // Counter saturated, the descriptor is readable anyway
+        }
+    }
+}
+
+void ConnectionTransport::orphan() {
+    listener = nullptr;
+    shared = nullptr;
+    queue.clear();
+    if (readyFd >= 0) {
+        clearReady();
+    }
+}
+
+bool ConnectionTransport::bind(const struct sockaddr_in& addr) {
+    // Already bound through the listener, only its own address can match
+    return shared != nullptr && addr.sin_addr.s_addr == key.localAddr && addr.sin_port == key.localPort;
+}
+
+bool ConnectionTransport::sendSegment(const Segment& segment, const struct sockaddr_in& addr) {
+    return shared && shared->sendSegment(segment, addr);
+}
+
+bool ConnectionTransport::sendSegments(const Segment* segments, int count, const struct sockaddr_in& addr) {
+    return shared && shared->sendSegments(segments, count, addr);
+}
+
+int32_t ConnectionTransport::receiveSegment(Segment& segment, struct sockaddr_in& addr, int timeoutMs) {
+    // The previous payload is no longer referenced, keep its buffer for the next datagram
+    if (current.payload.capacity() > 0) {
+        spare.emplace_back();
+        spare.back().swap(current.payload);
+    }
+
+    // Segments only arrive through the listener, which the thread's loop drives
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+    while (queue.empty()) {
+        if (!shared || timeoutMs == 0) {
+            return 0;
+        }
+
+        int waitMs = -1;
+        if (timeoutMs > 0) {
+            auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+                deadline - std::chrono::steady_clock::now()).count();
+            if (remaining <= 0) {
+                return 0;
+            }
+            waitMs = remaining;
+        }
+        if (EventLoop::threadLoop().runOnce(waitMs) < 0) {
+            return -1;
+        }
+    }
+
+    current = std::move(queue.front());
+    queue.pop_front();
+    if (queue.empty()) {
+        clearReady();
+    }
+
+    segment = current.segment;
+    segment.payload = current.payload.data();
+    addr = current.addr;
+    return current.length;
+}
+
+void ConnectionTransport::close() {
+    if (readyFd < 0) {
+        return;
+    }
+
+    if (listener) {
+        listener->release(this);
+    }
+    orphan();
+
+    ::close(readyFd);
+    readyFd = -1;
+}
+
+int ConnectionTransport::fd() const {
+    return shared ? shared->fd() : -1;
+}
+
+int ConnectionTransport::pollFd() const {
+    return readyFd;
+}
@@ -0,0 +1,262 @@
+#include "header/event_loop.hpp"
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include <errno.h>
+#include <cstring>
+#include <chrono>
+#include <algorithm>
+#include <stdexcept>
+
+EventLoop::EventLoop() :
+    nextWatchId(1),
+    virtualTime(false),
+    virtualNowUs(0),
+    armOrder(0),
+    nextVirtualTimerId(1 << 30) {
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (epollFd < 0) {
+        throw std::runtime_error("epoll_create1 failed");
+    }
+}
+
+EventLoop::~EventLoop() {
+    for (auto& timer : timers) {
+        if (timer.first >= 0) {
+            ::close(timer.first);
+        }
+    }
+    ::close(epollFd);
+}
+
+EventLoop& EventLoop::threadLoop() {
+    thread_local EventLoop loop;
+    return loop;
+}
+
+int EventLoop::watch(int fd, std::function<void()> onReadable) {
+    auto& list = watches[fd];
+    if (list.empty()) {
+        struct epoll_event event = {};
+        event.events = EPOLLIN;
+        event.data.fd = fd;
+        if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) < 0) {
+            watches.erase(fd);
+            throw std::runtime_error(std::string("epoll_ctl failed: ") + strerror(errno));
+        }
+    }
+
+    int id = nextWatchId++;
+    list.push_back({id, std::move(onReadable)});
+    watchFds[id] = fd;
+    return id;
+}
+
+void EventLoop::unwatch(int watchId) {
+    auto it = watchFds.find(watchId);
+    if (it == watchFds.end()) {
+        return;
+    }
+    int fd = it->second;
+    watchFds.erase(it);
+
+    auto& list = watches[fd];
+    for (size_t i = 0; i < list.size(); i++) {
+        if (list[i].id == watchId) {
+            list.erase(list.begin() + i);
+            break;
+        }
+    }
+
+    if (list.empty()) {
+        watches.erase(fd);
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr);
+    }
+}
+
+int EventLoop::addTimer(std::function<void()> onExpired) {
+    if (virtualTime) {
+        // Ids share the timers map with timerfds, start them above any descriptor
+        int id = nextVirtualTimerId++;
+        timers[id] = std::move(onExpired);
+        return id;
+    }
+
+    int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (fd < 0) {
+        throw std::runtime_error("timerfd_create failed");
+    }
+
+    struct epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.fd = fd;
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) < 0) {
+        ::close(fd);
+        throw std::runtime_error("epoll_ctl failed for timer");
+    }
+
+    timers[fd] = std::move(onExpired);
+    return fd;
+}
+
+void EventLoop::armTimer(int timerId, int timeoutMs) {
+    armTimerUs(timerId, int64_t(timeoutMs) * 1000);
+}
+
+void EventLoop::armTimerUs(int timerId, int64_t timeoutUs) {
+    if (virtualTime) {
+        if (timeoutUs > 0) {
+            virtualDeadlines[timerId] = {virtualNowUs + timeoutUs, armOrder++};
+        } else {
+            virtualDeadlines.erase(timerId);
+        }
+        return;
+    }
+
+    struct itimerspec spec = {};
+    spec.it_value.tv_sec = timeoutUs / 1000000;
+    spec.it_value.tv_nsec = (timeoutUs % 1000000) * 1000L;
+    timerfd_settime(timerId, 0, &spec, nullptr);
+}
+
+void EventLoop::removeTimer(int timerId) {
+    if (virtualTime) {
+        timers.erase(timerId);
+        virtualDeadlines.erase(timerId);
+        return;
+    }
+    if (timers.erase(timerId) > 0) {
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, timerId, nullptr);
+        ::close(timerId);
+    }
+}
+
+void EventLoop::post(std::function<void()> callback) {
+    posted.push_back(std::move(callback));
+}
+
+int EventLoop::runPosted() {
+    // Callbacks posted while running wait for the next iteration
+    size_t count = posted.size();
+    for (size_t i = 0; i < count; i++) {
+        std::function<void()> callback = std::move(posted.front());
+        posted.pop_front();
+        callback();
+    }
+    return count;
+}
+
+void EventLoop::dispatch(int fd) {
+    auto timer = timers.find(fd);
+    if (timer != timers.end()) {
+        // Clear the expiration count, a disarmed or re-armed timer reads nothing
+        uint64_t expirations;
+        if (read(fd, &expirations, sizeof(expirations)) != sizeof(expirations)) {
+            return;
+        }
+        std::function<void()> callback = timer->second;
+        callback();
+        return;
+    }
+
+    auto it = watches.find(fd);
+    if (it == watches.end()) {
+        return;
+    }
+
+    // Callbacks may unwatch themselves, iterate over a snapshot of the ids
+    std::vector<int> ids;
+    for (auto& watch : it->second) {
+        ids.push_back(watch.id);
+    }
+    for (int id : ids) {
+        auto current = watches.find(fd);
+        if (current == watches.end()) {
+            break;
+        }
+        for (auto& watch : current->second) {
+            if (watch.id == id) {
+                std::function<void()> callback = watch.callback;
+                callback();
+                break;
+            }
+        }
+    }
+}
+
+int EventLoop::runVirtualTimer(int timeoutMs) {
+    auto earliest = virtualDeadlines.end();
+    for (auto it = virtualDeadlines.begin(); it != virtualDeadlines.end(); ++it) {
+        if (earliest == virtualDeadlines.end() || it->second < earliest->second) {
+            earliest = it;
+        }
+    }
+    if (earliest == virtualDeadlines.end()) {
+        return 0;
+    }
+
+    int64_t deadline = earliest->second.first;
+    if (timeoutMs >= 0 && deadline > virtualNowUs + int64_t(timeoutMs) * 1000) {
+        virtualNowUs += int64_t(timeoutMs) * 1000;
+        return 0;
+    }
+
+    int id = earliest->first;
+    virtualDeadlines.erase(earliest);
+    virtualNowUs = std::max(virtualNowUs, deadline);
+    std::function<void()> callback = timers[id];
+    callback();
+    return 1;
+}
+
+int EventLoop::runOnce(int timeoutMs) {
+    struct epoll_event events[64];
+    // Virtual time only waits on descriptors when no timer could move the clock
+    bool waitReal = posted.empty() && (!virtualTime || virtualDeadlines.empty());
+    int count = epoll_wait(epollFd, events, 64, waitReal ? timeoutMs : 0);
+    if (count < 0) {
+        if (errno != EINTR) {
+            return -1;
+        }
+        count = 0;
+    }
+
+    for (int i = 0; i < count; i++) {
+        dispatch(events[i].data.fd);
+    }
+    count += runPosted();
+
+    if (virtualTime && count == 0 && timeoutMs != 0) {
+        count = runVirtualTimer(timeoutMs);
+    }
+    return count;
+}
+
+void EventLoop::runUntil(const std::function<bool()>& done) {
+    while (!done()) {
+        if (runOnce(-1) < 0) {
+            break;
+        }
+    }
+}
+
+void EventLoop::setVirtualTime(bool enabled) {
+    if (!timers.empty()) {
+        throw std::logic_error("EventLoop time base changed with timers in use");
+    }
+    virtualTime = enabled;
+    virtualNowUs = 0;
+    virtualDeadlines.clear();
+}
+
+bool EventLoop::isVirtualTime() const {
+    return virtualTime;
+}
+
+int64_t EventLoop::nowUs() const {
+    if (virtualTime) {
+        return virtualNowUs;
+    }
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
@@ -0,0 +1,243 @@
+#ifndef async_h
+#define async_h
+
+#include <coroutine>
+#include <exception>
+#include <functional>
+#include <optional>
+#include <utility>
+#include "event_loop.hpp"
+
+template <typename T>
+class Task;
+
+namespace detail
+{
+    struct TaskPromiseBase
+    {
+        // Coroutine awaiting this task, resumed when it finishes
+        std::coroutine_handle<> continuation;
+
+        // Started with spawn, the frame frees itself when it finishes
+        bool detached = false;
+
+        std::exception_ptr exception;
+
+        struct FinalAwaiter
+        {
+            bool await_ready() noexcept { return false; }
+
+            template <typename Promise>
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept {
+                TaskPromiseBase& promise = handle.promise();
+                if (promise.continuation) {
+                    return promise.continuation;
+                }
+                if (promise.detached) {
+                    handle.destroy();
+                }
+                return std::noop_coroutine();
+            }
+
+            void await_resume() noexcept {}
+        };
+
+        std::suspend_always initial_suspend() noexcept { return {}; }
+
+        FinalAwaiter final_suspend() noexcept { return {}; }
+
+        void unhandled_exception() {
+            // Nobody can observe the failure of a detached task
+            if (detached) {
+                std::terminate();
+            }
+            exception = std::current_exception();
+        }
+    };
+
+    template <typename T>
+    struct TaskPromise : TaskPromiseBase
+    {
+        std::optional<T> value;
+
+        Task<T> get_return_object();
+
+        void return_value(T result) { value = std::move(result); }
+
+        T result() {
+            if (exception) {
+                std::rethrow_exception(exception);
+            }
+            return std::move(*value);
+        }
+    };
+
+    template <>
+    struct TaskPromise<void> : TaskPromiseBase
+    {
+        Task<void> get_return_object();
+
+        void return_void() {}
+
+        void result() {
+            if (exception) {
+                std::rethrow_exception(exception);
+            }
+        }
+    };
+}
+
+/**
+ * Lazily started coroutine returning T.
+ *
+ * A task runs when it is awaited (co_await), passed to spawn or to syncWait.
+ * Socket operations suspend it until the thread's EventLoop completes them,
+ * so one thread can drive many transfers written as straight-line code.
+ */
+template <typename T = void>
+class Task
+{
+public:
+    using promise_type = detail::TaskPromise<T>;
+
+    explicit Task(std::coroutine_handle<promise_type> handle) : handle(handle) {}
+
+    Task(Task&& other) noexcept : handle(std::exchange(other.handle, nullptr)) {}
+
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+
+    ~Task() {
+        if (handle) {
+            handle.destroy();
+        }
+    }
+
+    bool isReady() const { return !handle || handle.done(); }
+
+    bool await_ready() const noexcept { return false; }
+
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+        handle.promise().continuation = awaiting;
+        return handle;
+    }
+
+    T await_resume() { return handle.promise().result(); }
+
+    friend void spawn(Task<void> task);
+
+    template <typename U>
+    friend U syncWait(Task<U> task);
+
+private:
+    std::coroutine_handle<promise_type> handle;
+};
+
+namespace detail
+{
+    template <typename T>
+    Task<T> TaskPromise<T>::get_return_object() {
+        return Task<T>(std::coroutine_handle<TaskPromise<T>>::from_promise(*this));
+    }
+
+    inline Task<void> TaskPromise<void>::get_return_object() {
+        return Task<void>(std::coroutine_handle<TaskPromise<void>>::from_promise(*this));
+    }
+}
+
+/**
+ * Start the task without waiting for it, it frees itself when done
+ */
+inline void spawn(Task<void> task) {
+    std::coroutine_handle<detail::TaskPromise<void>> handle = std::exchange(task.handle, nullptr);
+    handle.promise().detached = true;
+    handle.resume();
+}
+
+/**
+ * Start the task and run the thread's EventLoop until it is done
+ */
+template <typename U>
+U syncWait(Task<U> task) {
+    task.handle.resume();
+    EventLoop::threadLoop().runUntil([&]() { return task.handle.done(); });
+    return task.handle.promise().result();
+}
+
+/**
+ * Awaitable wrapper around a callback based operation (TCPSocket::start*).
+ *
+ * The coroutine is resumed through EventLoop::post rather than from inside
+ * the completion callback, so it may start new operations or destroy the
+ * socket without pulling state from under the handler that completed it.
+ */
+template <typename T>
+class OperationAwaiter
+{
+public:
+    using Starter = std::function<void(std::function<void(T)>)>;
+
+    OperationAwaiter(EventLoop& loop, Starter start) : loop(loop), start(std::move(start)) {}
+
+    bool await_ready() const noexcept { return false; }
+
+    bool await_suspend(std::coroutine_handle<> handle) {
+        start([this, handle](T value) {
+            result = std::move(value);
+            if (suspended) {
+                loop.post([handle]() { handle.resume(); });
+            }
+        });
+
+        // Finished inside start, carry on without suspending
+        if (result) {
+            return false;
+        }
+        suspended = true;
+        return true;
+    }
+
+    T await_resume() { return std::move(*result); }
+
+private:
+    EventLoop& loop;
+    Starter start;
+    std::optional<T> result;
+    bool suspended = false;
+};
+
+template <>
+class OperationAwaiter<void>
+{
+public:
+    using Starter = std::function<void(std::function<void()>)>;
+
+    OperationAwaiter(EventLoop& loop, Starter start) : loop(loop), start(std::move(start)) {}
+
+    bool await_ready() const noexcept { return false; }
+
+    bool await_suspend(std::coroutine_handle<> handle) {
+        start([this, handle]() {
+            finished = true;
+            if (suspended) {
+                loop.post([handle]() { handle.resume(); });
+            }
+        });
+
+        if (finished) {
+            return false;
+        }
+        suspended = true;
+        return true;
+    }
+
+    void await_resume() {}
+
+private:
+    EventLoop& loop;
+    Starter start;
+    bool finished = false;
+    bool suspended = false;
+};
+
+#endif
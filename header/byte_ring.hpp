@@ -0,0 +1,81 @@
+#ifndef byte_ring_h
+#define byte_ring_h
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+
+/**
+ * Bounded lock-free single-producer/single-consumer byte ring.
+ *
+ * One thread writes, one thread reads, neither ever takes a lock. The read
+ * and write positions only grow and are masked into a power of two buffer;
+ * each lives on its own cache line, and each side caches the other's
+ * position so it only reloads it when the ring looks full (or empty).
+ */
+class ByteRing
+{
+private:
+    uint8_t* buffer;
+    size_t size;
+    size_t mask;
+
+    // Consumer side
+    alignas(64) std::atomic<size_t> readPos;
+    size_t cachedWritePos;
+
+    // Producer side
+    alignas(64) std::atomic<size_t> writePos;
+    size_t cachedReadPos;
+
+    alignas(64) std::atomic<bool> closed;
+
+public:
+    /**
+     * @param capacity Size in bytes, rounded up to a power of two
+     */
+    explicit ByteRing(size_t capacity);
+
+    ~ByteRing();
+
+    ByteRing(const ByteRing&) = delete;
+    ByteRing& operator=(const ByteRing&) = delete;
+
+    /**
+     * Producer: copy as much of data as fits
+     * @return Number of bytes written, 0 when the ring is full
+     */
+    size_t write(const uint8_t* data, size_t length);
+
+    /**
+     * Consumer: copy up to length bytes out of the ring
+     * @return Number of bytes read, 0 when the ring is empty
+     */
+    size_t read(uint8_t* data, size_t length);
+
+    /**
+     * Bytes the consumer can read
+     */
+    size_t readable() const;
+
+    /**
+     * Bytes the producer can write
+     */
+    size_t writable() const;
+
+    size_t capacity() const;
+
+    /**
+     * Producer: no more writes, the consumer drains what is left
+     */
+    void close();
+
+    bool isClosed() const;
+
+    /**
+     * Closed and everything read
+     */
+    bool isDrained() const;
+};
+
+#endif
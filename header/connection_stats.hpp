@@ -0,0 +1,48 @@
+#ifndef connection_stats_h
+#define connection_stats_h
+
+#include <cstdint>
+#include <string>
+
+/**
+ * Number of TCPStatusEnum values, CLOSED (-1) through TIME_WAIT (9)
+ */
+const int TCP_STATE_COUNT = 11;
+
+/**
+ * Counters of one connection, see TCPSocket::getStats.
+ *
+ * Byte counts are payload bytes, segment counts include control segments and
+ * retransmissions. RTT samples follow Karn's rule (retransmitted segments are
+ * never sampled) and are smoothed as in RFC 6298.
+ */
+struct ConnectionStats
+{
+    uint64_t bytesSent = 0;
+    uint64_t bytesReceived = 0;
+    uint64_t segmentsSent = 0;
+    uint64_t segmentsReceived = 0;
+
+    uint64_t retransmits = 0;
+    uint64_t duplicateAcks = 0;
+    uint64_t checksumFailures = 0;
+
+    double srttMs = 0;
+    double rttvarMs = 0;
+    uint64_t rttSamples = 0;
+
+    uint32_t cwnd = 0;  // Send window in segments, fixed: there is no congestion control
+    uint32_t rwnd = 0;  // Receive window the peer last advertised, in segments
+
+    // Seconds spent in each state, indexed by TCPStatusEnum + 1
+    double stateSeconds[TCP_STATE_COUNT] = {};
+
+    void addRttSample(double rttMs);
+
+    /**
+     * One JSON object, states keyed by name
+     */
+    std::string toJson() const;
+};
+
+#endif
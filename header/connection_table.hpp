@@ -0,0 +1,77 @@
+#ifndef connection_table_h
+#define connection_table_h
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <functional>
+#include <netinet/in.h>
+
+class ConnectionTransport;
+
+/**
+ * Address 4-tuple of a connection, in network byte order
+ */
+struct ConnectionKey
+{
+    uint32_t remoteAddr;
+    uint32_t localAddr;
+    uint16_t remotePort;
+    uint16_t localPort;
+
+    bool operator==(const ConnectionKey& other) const {
+        return remoteAddr == other.remoteAddr && remotePort == other.remotePort &&
+               localAddr == other.localAddr && localPort == other.localPort;
+    }
+};
+
+ConnectionKey makeConnectionKey(const struct sockaddr_in& remote, const struct sockaddr_in& local);
+
+/**
+ * Open addressing hash table from 4-tuple to connection.
+ *
+ * Linear probing over a power of two array of slots kept at most half full,
+ * so a lookup per datagram touches one or two adjacent slots. Erasing shifts
+ * the following entries back instead of leaving tombstones.
+ */
+class ConnectionTable
+{
+private:
+    struct Slot {
+        ConnectionKey key;
+        uint32_t hash;
+        ConnectionTransport* value;  // nullptr marks an empty slot
+    };
+
+    std::vector<Slot> slots;
+    size_t mask;
+    size_t count;
+
+    static uint32_t hashKey(const ConnectionKey& key);
+
+    // Index of the slot holding key, or of the empty slot ending its probe sequence
+    size_t probe(const ConnectionKey& key, uint32_t hash) const;
+
+    void grow();
+
+public:
+    /**
+     * @param capacity Initial number of slots, rounded up to a power of two
+     */
+    ConnectionTable(size_t capacity = 64);
+
+    ConnectionTransport* find(const ConnectionKey& key) const;
+
+    /**
+     * Add or replace the connection stored under key
+     */
+    void insert(const ConnectionKey& key, ConnectionTransport* value);
+
+    bool erase(const ConnectionKey& key);
+
+    size_t size() const;
+
+    void forEach(const std::function<void(ConnectionTransport*)>& callback) const;
+};
+
+#endif
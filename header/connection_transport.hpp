@@ -0,0 +1,85 @@
+#ifndef connection_transport_h
+#define connection_transport_h
+
+#include <vector>
+#include <deque>
+#include "transport.hpp"
+#include "connection_table.hpp"
+
+class TCPListener;
+
+/**
+ * One connection of a TCPListener.
+ *
+ * Sends go out through the listener's shared transport. Receives come from
+ * a queue the listener fills after looking the source up in its
+ * ConnectionTable, so every connection keeps its own TCPSocket state.
+ */
+class ConnectionTransport : public Transport
+{
+private:
+    TCPListener* listener;
+    Transport* shared;
+
+    ConnectionKey key;
+
+    /**
+     * Initial sequence number of the SYN that opened the connection. A SYN
+     * from the same 4-tuple with another one starts a new connection.
+     */
+    uint32_t connectionId;
+
+    struct Datagram {
+        Segment segment;
+        std::vector<uint8_t> payload;
+        struct sockaddr_in addr;
+        int32_t length;
+    };
+
+    std::deque<Datagram> queue;
+    // Datagram returned last, its payload stays valid until the next receive
+    Datagram current;
+    // Payload buffers kept for reuse
+    std::vector<std::vector<uint8_t>> spare;
+
+    // eventfd readable while the queue is not empty
+    int readyFd;
+
+    void clearReady();
+
+public:
+    ConnectionTransport(TCPListener* listener, Transport* shared, const ConnectionKey& key, uint32_t connectionId);
+
+    ~ConnectionTransport();
+
+    const ConnectionKey& getKey() const;
+
+    uint32_t getConnectionId() const;
+
+    /**
+     * Queue a segment received on the shared transport, copying its payload
+     */
+    void deliver(const Segment& segment, const struct sockaddr_in& addr, int32_t length);
+
+    /**
+     * Detach from the listener, the connection stops receiving and sending
+     */
+    void orphan();
+
+    // Connections are bound by the listener, fails for any other address than its own
+    bool bind(const struct sockaddr_in& addr) override;
+
+    bool sendSegment(const Segment& segment, const struct sockaddr_in& addr) override;
+
+    bool sendSegments(const Segment* segments, int count, const struct sockaddr_in& addr) override;
+
+    int32_t receiveSegment(Segment& segment, struct sockaddr_in& addr, int timeoutMs) override;
+
+    void close() override;
+
+    int fd() const override;
+
+    int pollFd() const override;
+};
+
+#endif
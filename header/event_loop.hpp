@@ -0,0 +1,128 @@
+#ifndef event_loop_h
+#define event_loop_h
+
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+#include <deque>
+
+/**
+ * Single threaded reactor built on epoll and timerfd.
+ *
+ * Sockets register their descriptor and a timer, the loop calls them back on
+ * readiness and expiry. Blocking calls run the loop until their operation is
+ * done, so one thread can drive any number of connections without busy waiting.
+ *
+ * With virtual time (setVirtualTime) timers are not timerfds: whenever
+ * nothing is ready the clock jumps to the earliest deadline and fires it, so
+ * a simulation never sleeps and always takes the same course.
+ */
+class EventLoop
+{
+private:
+    int epollFd;
+
+    struct Watch {
+        int id;
+        std::function<void()> callback;
+    };
+
+    // Several watches may share a descriptor (transports sharing one io_uring)
+    std::unordered_map<int, std::vector<Watch>> watches;
+    std::unordered_map<int, int> watchFds;  // watch id -> fd
+
+    // timerfd -> expiry callback
+    std::unordered_map<int, std::function<void()>> timers;
+
+    // Callbacks deferred to the next iteration, in post order
+    std::deque<std::function<void()>> posted;
+
+    int nextWatchId;
+
+    // Virtual time: armed timer id -> deadline (µs) and arm order, ties fire in that order
+    bool virtualTime;
+    int64_t virtualNowUs;
+    std::unordered_map<int, std::pair<int64_t, uint64_t>> virtualDeadlines;
+    uint64_t armOrder;
+    int nextVirtualTimerId;
+
+    void dispatch(int fd);
+    int runPosted();
+
+    /**
+     * Advance the virtual clock to the earliest deadline, at most by timeoutMs
+     * (-1 unbounded), and fire that timer
+     * @return Number of timers fired
+     */
+    int runVirtualTimer(int timeoutMs);
+
+public:
+    EventLoop();
+
+    ~EventLoop();
+
+    /**
+     * Loop shared by every socket of the calling thread
+     */
+    static EventLoop& threadLoop();
+
+    /**
+     * Call back whenever fd is readable (level triggered)
+     * @return Watch id for unwatch
+     */
+    int watch(int fd, std::function<void()> onReadable);
+
+    void unwatch(int watchId);
+
+    /**
+     * Create a one-shot timer, disarmed until armTimer is called
+     * @return Timer id
+     */
+    int addTimer(std::function<void()> onExpired);
+
+    /**
+     * (Re)arm a timer to fire once after timeoutMs, 0 disarms it
+     */
+    void armTimer(int timerId, int timeoutMs);
+
+    /**
+     * Same in microseconds
+     */
+    void armTimerUs(int timerId, int64_t timeoutUs);
+
+    void removeTimer(int timerId);
+
+    /**
+     * Run callback from the loop on its next iteration, outside of the
+     * handler currently executing (used to resume coroutines)
+     */
+    void post(std::function<void()> callback);
+
+    /**
+     * Wait up to timeoutMs (-1 forever) and dispatch ready events once, then
+     * run the posted callbacks. Never waits while callbacks are posted.
+     * @return Number of events and callbacks dispatched
+     */
+    int runOnce(int timeoutMs);
+
+    /**
+     * Dispatch events until done() holds
+     */
+    void runUntil(const std::function<bool()>& done);
+
+    /**
+     * Run on a virtual clock starting at 0 instead of CLOCK_MONOTONIC. Must
+     * be set before the first timer is added. Descriptors are still polled,
+     * but never waited on while a timer is armed.
+     */
+    void setVirtualTime(bool enabled);
+    bool isVirtualTime() const;
+
+    /**
+     * Current time of this loop in µs: CLOCK_MONOTONIC, or the virtual clock
+     */
+    int64_t nowUs() const;
+};
+
+#endif
@@ -0,0 +1,181 @@
+#ifndef impairment_h
+#define impairment_h
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <map>
+#include <queue>
+#include <random>
+#include <netinet/in.h>
+
+/**
+ * What the emulated network does to each packet, like a netem qdisc
+ */
+struct ImpairmentProfile
+{
+    double loss = 0;          // Bernoulli, per packet
+    double geEnter = 0;       // Gilbert-Elliott good -> bad transition, per packet (0: off)
+    double geExit = 1;        // bad -> good
+    double geLossGood = 0;
+    double geLossBad = 1;
+    double delayMs = 0;
+    double jitterMs = 0;      // Uniform in [-jitter, +jitter], never before the link is done
+    double reorder = 0;       // Probability a packet is held back...
+    double reorderMs = 5;     // ...by this much, letting later ones overtake it
+    double duplicate = 0;
+    double rateMbit = 0;      // 0: unlimited
+    size_t queueLimit = 1000; // Packets waiting or in flight per direction, netem's limit
+    uint64_t seed = 1;
+
+    /**
+     * Set the field of a command line flag (--loss, --delay, ..., --seed)
+     * @return false if flag is not one of them
+     * @throws std::invalid_argument if value is not a number
+     */
+    bool setOption(const std::string& flag, const std::string& value);
+
+    /**
+     * Help text of those flags, one per line
+     */
+    static const char* OPTIONS_HELP;
+};
+
+/**
+ * State and counters of one direction through the proxy
+ */
+struct ImpairmentDirection
+{
+    const char* name = "";
+    bool bad = false;         // Gilbert-Elliott state
+    int64_t linkFreeNs = 0;   // When the emulated link finishes its current packet
+    size_t queued = 0;
+
+    uint64_t received = 0;
+    uint64_t forwarded = 0;
+    uint64_t lost = 0;
+    uint64_t duplicated = 0;
+    uint64_t reordered = 0;
+    uint64_t queueDrops = 0;
+
+    std::string toString() const;
+};
+
+/**
+ * Decides the fate of every packet and holds the survivors until they are due.
+ * Time is passed in by the caller (CLOCK_MONOTONIC or a virtual clock), the
+ * caller also delivers what take() hands back.
+ */
+class Impairment
+{
+public:
+    struct Packet {
+        int64_t deliverAt;
+        uint64_t order;       // Ties keep arrival order
+        int fd;               // Socket it leaves on, -1 if the caller does not need one
+        struct sockaddr_in source;
+        struct sockaddr_in dest;
+        std::vector<uint8_t> data;
+        ImpairmentDirection* direction;
+    };
+
+private:
+    struct LaterFirst {
+        bool operator()(const Packet* a, const Packet* b) const {
+            return a->deliverAt != b->deliverAt ? a->deliverAt > b->deliverAt : a->order > b->order;
+        }
+    };
+
+    ImpairmentProfile profile;
+    std::mt19937_64 random;
+    std::uniform_real_distribution<double> uniform;
+    std::priority_queue<Packet*, std::vector<Packet*>, LaterFirst> pending;
+    uint64_t order;
+
+    bool chance(double probability);
+    bool dropped(ImpairmentDirection& direction);
+    void schedule(ImpairmentDirection& direction, int64_t nowNs, const Packet& packet);
+
+public:
+    explicit Impairment(const ImpairmentProfile& profile);
+    ~Impairment();
+
+    Impairment(const Impairment&) = delete;
+    Impairment& operator=(const Impairment&) = delete;
+
+    /**
+     * A packet (fd, addresses and data set) arrived at nowNs, drop it or
+     * schedule it and maybe a duplicate
+     */
+    void submit(ImpairmentDirection& direction, int64_t nowNs, const Packet& packet);
+
+    /**
+     * Move the earliest packet due by nowNs into packet
+     * @return false if none is due
+     */
+    bool take(int64_t nowNs, Packet& packet);
+
+    /**
+     * When the next packet is due, -1 if none is pending
+     */
+    int64_t nextDue() const;
+};
+
+/**
+ * UDP proxy between two nodes on one machine, impairing both directions.
+ *
+ * Every client address gets its own upstream socket, so a --serve sender
+ * sees one peer per receiver. Both directions share the profile but keep
+ * their own state. Delivery runs off an absolute timerfd, delays and rate
+ * pacing are not rounded to milliseconds.
+ */
+class ImpairmentProxy
+{
+private:
+    int listenFd;
+    int timerFd;
+    int stopFd;
+    struct sockaddr_in target;
+    Impairment impairment;
+    ImpairmentDirection forward;  // Client to target
+    ImpairmentDirection reverse;  // Target to client
+
+    struct Session {
+        struct sockaddr_in client;
+        int upstreamFd;
+    };
+    std::map<uint64_t, Session> sessions;
+    std::map<int, Session*> byUpstream;
+
+    /**
+     * Send every packet that is due
+     * @return When the next one is due (CLOCK_MONOTONIC ns), -1 if none is pending
+     */
+    int64_t deliver();
+
+public:
+    /**
+     * @throws std::runtime_error if listenPort cannot be bound
+     */
+    ImpairmentProxy(int listenPort, const struct sockaddr_in& target, const ImpairmentProfile& profile);
+    ~ImpairmentProxy();
+
+    ImpairmentProxy(const ImpairmentProxy&) = delete;
+    ImpairmentProxy& operator=(const ImpairmentProxy&) = delete;
+
+    /**
+     * Relay until stop() is called
+     */
+    void run();
+
+    /**
+     * Make run() return, from any thread or a signal handler
+     */
+    void stop();
+
+    const ImpairmentDirection& getForward() const;
+    const ImpairmentDirection& getReverse() const;
+};
+
+#endif
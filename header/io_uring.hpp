@@ -0,0 +1,111 @@
+#ifndef io_uring_h
+#define io_uring_h
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <linux/io_uring.h>
+
+/**
+ * Abstract class.
+ *
+ * Receives the completions of the requests it submitted on an IoUring.
+ */
+class IoUringHandler
+{
+public:
+    virtual ~IoUringHandler() {}
+    virtual void handleCompletion(uint8_t op, int32_t result, uint32_t flags) = 0;
+};
+
+/**
+ * Minimal io_uring wrapper on the raw system calls (no liburing).
+ *
+ * One ring is shared by every IoUringTransport on a thread, so a single
+ * io_uring_enter submits and reaps the work of all their connections.
+ */
+class IoUring
+{
+private:
+    int ringFd;
+
+    void* ringPtr;
+    size_t ringSize;
+    void* cqRingPtr;
+    size_t cqRingSize;
+    struct io_uring_sqe* sqes;
+    size_t sqesSize;
+
+    // Submission queue, shared with the kernel
+    unsigned* sqHead;
+    unsigned* sqTail;
+    unsigned sqMask;
+    unsigned sqEntries;
+    unsigned* sqArray;
+
+    // Completion queue, shared with the kernel
+    unsigned* cqHead;
+    unsigned* cqTail;
+    unsigned cqMask;
+    struct io_uring_cqe* cqes;
+
+    // SQEs filled in but not yet passed to io_uring_enter
+    unsigned pendingSubmissions;
+
+    // Buffer group ids: never used yet from nextBufferGroup up, or given back
+    uint32_t nextBufferGroup;
+    std::vector<uint16_t> freeBufferGroups;
+
+    int enter(unsigned toSubmit, unsigned minComplete, int timeoutMs);
+    unsigned reapCompletions();
+
+public:
+    // Low bits of user_data carry the operation, handlers are at least 8 byte aligned
+    static const uint64_t OP_MASK = 0x7;
+
+    IoUring(unsigned entries);
+
+    ~IoUring();
+
+    /**
+     * Ring shared by all transports of the calling thread
+     */
+    static IoUring& threadRing();
+
+    /**
+     * Ring descriptor, pollable for available completions
+     */
+    int fd() const;
+
+    /**
+     * Next free submission entry, cleared and tagged for handler.
+     * Flushes pending entries to the kernel when the queue is full.
+     */
+    struct io_uring_sqe* getSqe(IoUringHandler* handler, uint8_t op);
+
+    /**
+     * Submit pending entries without waiting
+     */
+    int submit();
+
+    /**
+     * Submit pending entries, wait up to timeoutMs (-1 forever) for at least one
+     * completion and dispatch every available completion to its handler.
+     * @return Number of completions dispatched, negative errno on failure
+     */
+    int run(int timeoutMs);
+
+    /**
+     * Register a provided buffer ring (kernel 5.19+) under a group id no
+     * other ring of this IoUring holds, reusing those unregistered before
+     * @return Group id, or -1 if the kernel refused or all ids are taken
+     */
+    int registerBufferRing(struct io_uring_buf_ring* ring, unsigned entries);
+
+    /**
+     * Unregister the ring of groupId, the id can be handed out again
+     */
+    void unregisterBufferRing(uint16_t groupId);
+};
+
+#endif
@@ -0,0 +1,125 @@
+#ifndef io_uring_transport_h
+#define io_uring_transport_h
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <sys/socket.h>
+#include "transport.hpp"
+#include "io_uring.hpp"
+
+/**
+ * io_uring backend.
+ *
+ * Receives with a single multishot IORING_OP_RECVMSG into a provided buffer
+ * ring, so the kernel keeps filling buffers without a system call per datagram.
+ * A window is sent as one batch of IORING_OP_SENDMSG entries and a single
+ * io_uring_enter, without waiting for it: the batch keeps its encoded
+ * datagrams until its completions come in. All transports of a thread share
+ * IoUring::threadRing(), which the thread's EventLoop reaps.
+ */
+class IoUringTransport : public Transport, public IoUringHandler
+{
+private:
+    enum Operation : uint8_t
+    {
+        OP_RECV = 1,
+        OP_SEND = 2,
+        OP_CANCEL = 3
+    };
+
+    static const unsigned BUFFER_COUNT = 256;  // power of two
+    static const unsigned BUFFER_SIZE = 2048;  // recvmsg_out + address + one datagram
+    static const unsigned MAX_SEND_BATCHES = 8;  // Windows in flight before a send waits
+
+    // One window of sends in flight, owns what the kernel reads until its
+    // last completion. Completions go to the batch itself.
+    struct SendBatch : public IoUringHandler {
+        IoUringTransport* owner;
+        std::vector<uint8_t> buffer;
+        std::vector<struct iovec> iovs;
+        std::vector<struct msghdr> headers;
+        struct sockaddr_in addr;
+        uint32_t inFlight;
+
+        void handleCompletion(uint8_t op, int32_t result, uint32_t flags) override;
+    };
+
+    IoUring& ring;
+
+    /**
+     * Socket descriptor
+     */
+    int32_t socket;
+
+    // Provided buffer ring and the buffers it hands out
+    struct io_uring_buf_ring* bufferRing;
+    size_t bufferRingSize;
+    uint8_t* buffers;
+    int bufferGroup;
+    uint16_t bufferTail;
+
+    // Template for the multishot receive, the kernel only reads name and control lengths
+    struct msghdr recvHeader;
+    bool recvArmed;
+    bool cancelInFlight;
+
+    struct Datagram {
+        uint16_t bufferId;
+        uint8_t* data;
+        uint32_t length;
+        struct sockaddr_in addr;
+    };
+
+    // Received datagrams not yet handed to the caller
+    std::deque<Datagram> ready;
+    // eventfd readable while ready is not empty. Completions for this transport
+    // may be reaped by any user of the shared ring, the ring fd alone would miss them.
+    int readyFd;
+    // Buffer of the datagram returned last, recycled on the next receive
+    int currentBuffer;
+
+    std::vector<std::unique_ptr<SendBatch>> sendBatches;
+    std::vector<SendBatch*> freeBatches;
+    bool sendFailed;  // A completed send failed, reported by the next send
+
+    void armReceive();
+    void clearReady();
+    void recycleBuffer(uint16_t bufferId);
+    SendBatch* takeBatch();
+    bool isBusy() const;
+
+public:
+    IoUringTransport();
+
+    ~IoUringTransport();
+
+    bool bind(const struct sockaddr_in& addr) override;
+
+    bool sendSegment(const Segment& segment, const struct sockaddr_in& addr) override;
+
+    /**
+     * Submit the datagrams and return, a failure of an earlier batch is
+     * reported here
+     */
+    bool sendSegments(const Segment* segments, int count, const struct sockaddr_in& addr) override;
+
+    int32_t receiveSegment(Segment& segment, struct sockaddr_in& addr, int timeoutMs) override;
+
+    /**
+     * Waits for the receive's cancellation and every send in flight, the
+     * kernel may touch the buffers until their last completion
+     */
+    void close() override;
+
+    int fd() const override;
+
+    /**
+     * Readable while received datagrams wait in this transport
+     */
+    int pollFd() const override;
+
+    void handleCompletion(uint8_t op, int32_t result, uint32_t flags) override;
+};
+
+#endif
@@ -0,0 +1,90 @@
+#ifndef listener_h
+#define listener_h
+
+#include <string>
+#include <deque>
+#include <functional>
+#include "socket.hpp"
+#include "transport.hpp"
+#include "connection_table.hpp"
+#include "connection_transport.hpp"
+#include "event_loop.hpp"
+#include "async.hpp"
+
+/**
+ * Serves any number of peers on one UDP port.
+ *
+ * Every datagram on the bound transport is demultiplexed by its 4-tuple
+ * through a ConnectionTable. A SYN from an unknown peer creates a new
+ * TCPSocket on a ConnectionTransport, waiting to be accepted. Accepted sockets
+ * complete the handshake themselves (doHandshake or async_accept), so a slow
+ * client never holds up the others.
+ *
+ * The listener must outlive the sockets it hands out.
+ */
+class TCPListener
+{
+private:
+    string ip;
+    int32_t port;
+
+    Transport* transport;
+    struct sockaddr_in localAddr;
+
+    EventLoop& loop;
+    int watchId;
+    bool accepting;  // New peers get a connection
+
+    ConnectionTable connections;
+
+    // Connections created by a SYN, not yet handed out by accept
+    std::deque<TCPSocket*> pending;
+    std::deque<std::function<void(TCPSocket*)>> acceptWaiters;
+
+    static const size_t MAX_PENDING = 1024;
+
+    void onReadable();
+    void handleSegment(const Segment& segment, const struct sockaddr_in& addr, int32_t length);
+
+public:
+    /**
+     * @param reusePort Join the SO_REUSEPORT group of the port, the kernel then
+     *                  spreads peers over every listener bound to it by 4-tuple hash
+     */
+    TCPListener(string ip, int32_t port, TransportType transportType = UDP_SOCKET_TRANSPORT, bool reusePort = false);
+
+    ~TCPListener();
+
+    /**
+     * Next connection, blocking until a peer sends a SYN. The returned socket
+     * is owned by the caller and still has to complete its handshake.
+     */
+    TCPSocket* accept();
+
+    void startAccept(std::function<void(TCPSocket*)> onAccepted);
+
+    OperationAwaiter<TCPSocket*> async_accept();
+
+    /**
+     * Number of live connections, accepted or not
+     */
+    size_t connectionCount() const;
+
+    Transport* getTransport() const;
+
+    /**
+     * Called by a ConnectionTransport when it closes
+     */
+    void release(ConnectionTransport* connection);
+
+    /**
+     * Hand out no more connections: sockets not accepted yet are dropped,
+     * waiting accepts get nullptr and SYNs from new peers are ignored.
+     * Accepted connections keep receiving until close.
+     */
+    void stopAccepting();
+
+    void close();
+};
+
+#endif
@@ -0,0 +1,134 @@
+#ifndef logger_h
+#define logger_h
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <atomic>
+#include <type_traits>
+#include <charconv>
+#include "color.hpp"
+
+enum LogLevel
+{
+    LOG_LEVEL_PACKET = 0,  // One line per segment or ACK
+    LOG_LEVEL_DEBUG = 1,
+    LOG_LEVEL_INFO = 2,
+    LOG_LEVEL_WARN = 3,
+    LOG_LEVEL_ERROR = 4,
+    LOG_LEVEL_OFF = 5
+};
+
+/**
+ * Longer lines are truncated
+ */
+const size_t LOG_MAX_LINE = 1024;
+
+/**
+ * Levels below this are compiled out entirely, arguments included
+ * (-DLOG_COMPILE_LEVEL=2 drops packet and debug lines from the binary)
+ */
+#ifndef LOG_COMPILE_LEVEL
+#define LOG_COMPILE_LEVEL 0
+#endif
+
+/**
+ * Asynchronous logger.
+ *
+ * Every thread formats its lines into a stack buffer and appends them to its
+ * own lock-free ByteRing, a background thread drains the rings and writes
+ * them out in batches (WARN and above to stderr, the rest to stdout). Logging
+ * never flushes or takes a lock on the calling thread; a thread only waits
+ * when its ring is full, which bounds memory if the output cannot keep up.
+ */
+class Logger
+{
+public:
+    static bool enabled(LogLevel level) {
+        return level >= runtimeLevel.load(std::memory_order_relaxed);
+    }
+
+    static void setLevel(LogLevel level);
+    static LogLevel getLevel();
+
+    /**
+     * Parse "packet", "debug", "info", "warn", "error" or "off"
+     * @return false if name is none of them
+     */
+    static bool parseLevel(const std::string& name, LogLevel& level);
+
+    /**
+     * Queue one formatted line (without newline)
+     */
+    static void write(LogLevel level, const char* data, size_t length);
+
+    /**
+     * Wait until every line queued so far has been written
+     */
+    static void flush();
+
+private:
+    static inline std::atomic<int> runtimeLevel{LOG_LEVEL_INFO};
+};
+
+/**
+ * One line being formatted, queued when it goes out of scope
+ */
+class LogLine
+{
+private:
+    LogLevel level;
+    size_t length;
+    char buffer[LOG_MAX_LINE];
+
+    void append(const char* data, size_t size);
+
+public:
+    explicit LogLine(LogLevel level) : level(level), length(0) {}
+
+    ~LogLine() {
+        Logger::write(level, buffer, length);
+    }
+
+    LogLine(const LogLine&) = delete;
+    LogLine& operator=(const LogLine&) = delete;
+
+    LogLine& operator<<(const char* text);
+    LogLine& operator<<(const std::string& text);
+    LogLine& operator<<(char c);
+    LogLine& operator<<(double value);
+
+    template <typename T, typename = std::enable_if_t<std::is_integral_v<T> && !std::is_same_v<T, char> && !std::is_same_v<T, bool>>>
+    LogLine& operator<<(T value) {
+        char digits[24];
+        auto result = std::to_chars(digits, digits + sizeof(digits), value);
+        append(digits, result.ptr - digits);
+        return *this;
+    }
+
+    LogLine& operator<<(bool value) {
+        return *this << (value ? "true" : "false");
+    }
+};
+
+/**
+ * LOG_INFO(Color::YELLOW << "[i]" << Color::RESET << " Text " << number);
+ * The message is neither formatted nor evaluated unless the level is enabled.
+ */
+#define LOG_AT(level, message) \
+    do { \
+        if constexpr ((level) >= LOG_COMPILE_LEVEL) { \
+            if (Logger::enabled(level)) { \
+                LogLine logLine(level); \
+                logLine << message; \
+            } \
+        } \
+    } while (0)
+
+#define LOG_PACKET(message) LOG_AT(LOG_LEVEL_PACKET, message)
+#define LOG_DEBUG(message) LOG_AT(LOG_LEVEL_DEBUG, message)
+#define LOG_INFO(message) LOG_AT(LOG_LEVEL_INFO, message)
+#define LOG_WARN(message) LOG_AT(LOG_LEVEL_WARN, message)
+#define LOG_ERROR(message) LOG_AT(LOG_LEVEL_ERROR, message)
+
+#endif
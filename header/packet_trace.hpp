@@ -0,0 +1,97 @@
+#ifndef packet_trace_h
+#define packet_trace_h
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <atomic>
+
+enum TraceEvent
+{
+    TRACE_SEND = 0,        // Segment put on the wire for the first time (data, ACKs, control)
+    TRACE_RETRANSMIT = 1,  // Data segment sent again
+    TRACE_ACK = 2,         // ACK received by the sender
+    TRACE_RECEIVE = 3,     // Data segment accepted by the receiver
+    TRACE_DROP = 4,        // Segment discarded: bad checksum, out of order, no room
+    TRACE_STATE = 5        // Connection state change, state holds the new state
+};
+
+/**
+ * One event, fixed size so a trace can be indexed without parsing
+ */
+struct TraceRecord
+{
+    uint64_t timestampNs;  // CLOCK_MONOTONIC
+    uint32_t seqNum;
+    uint32_t ackNum;
+    uint32_t window;       // Receive window the peer last advertised, in segments
+    uint32_t cwnd;         // Send window, in segments
+    uint16_t connection;   // Peer port, tells the connections of a --serve trace apart
+    uint16_t length;       // Payload bytes
+    uint8_t event;         // TraceEvent
+    int8_t state;          // TCPStatusEnum after the event
+    uint8_t reserved[2];
+};
+
+static_assert(sizeof(TraceRecord) == 32, "TraceRecord is part of the file format");
+
+struct TraceHeader
+{
+    char magic[8];         // "TCPTRACE"
+    uint32_t version;
+    uint32_t recordSize;
+    uint64_t records;      // Filled in when the trace is closed, 0 if the process died
+    uint64_t capacity;
+};
+
+/**
+ * Binary event trace in a memory-mapped file.
+ *
+ * The file is sized for maxRecords up front (sparse, pages are only allocated
+ * as they are written) and every record is a plain store into the mapping:
+ * no system call and no lock per event, threads claim slots with one atomic
+ * increment. Events past the capacity are counted and dropped. The file is
+ * truncated to the records written when the trace is destroyed.
+ */
+class PacketTrace
+{
+private:
+    int fd;
+    TraceHeader* header;
+    TraceRecord* records;
+    size_t capacity;
+    std::atomic<uint64_t> next;
+    std::atomic<uint64_t> overflow;
+
+public:
+    static const uint32_t VERSION = 1;
+    static const size_t DEFAULT_RECORDS = 1 << 22;  // 128 MB
+
+    /**
+     * @throws std::runtime_error if the file cannot be created or mapped
+     */
+    PacketTrace(const std::string& path, size_t maxRecords = DEFAULT_RECORDS);
+    ~PacketTrace();
+
+    PacketTrace(const PacketTrace&) = delete;
+    PacketTrace& operator=(const PacketTrace&) = delete;
+
+    void record(TraceEvent event, uint16_t connection, int8_t state, uint32_t seqNum, uint32_t ackNum,
+                uint16_t length, uint32_t window, uint32_t cwnd);
+
+    uint64_t getRecords() const;
+
+    /**
+     * Events lost because the file was full
+     */
+    uint64_t getOverflow() const;
+
+    /**
+     * Read a trace file back, also one left behind by a process that never closed it
+     * @throws std::runtime_error if path is not a trace
+     */
+    static std::vector<TraceRecord> load(const std::string& path);
+};
+
+#endif
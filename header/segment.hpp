@@ -2,6 +2,7 @@
 #define segment_h
 
 #include <cstdint>
+#include <cstddef>
 
 struct Segment
 {
@@ -28,7 +29,7 @@ struct Segment
         unsigned int fin : 1;
     } flags;
 
-    uint16_t window;
+    uint16_t window;  // Free receive space in segments, only set on window update ACKs
     uint16_t checksum;
     uint16_t urgentPointer;
     // uint8_t options[40]; // Because it is rarely used
@@ -36,6 +37,12 @@ struct Segment
     uint8_t *payload; // data
 } __attribute__((packed));
 
+/**
+ * Size of the segment header on the wire: every field except the payload pointer.
+ * A datagram carries the header immediately followed by payloadSize bytes of data.
+ */
+const uint32_t SEGMENT_HEADER_SIZE = offsetof(Segment, payload);
+
 const uint8_t FIN_FLAG = 1;
 const uint8_t SYN_FLAG = 2;
 const uint8_t ACK_FLAG = 16;
@@ -82,6 +89,20 @@ Segment updateChecksum(Segment segment);
  */
 bool isValidChecksum(Segment segment);
 
+/**
+ * Serialize a segment (header followed by payload) into buffer.
+ * Buffer must hold at least SEGMENT_HEADER_SIZE + payloadSize bytes.
+ * @return Number of bytes written
+ */
+uint32_t encodeSegment(const Segment& segment, uint8_t* buffer);
+
+/**
+ * Parse a datagram into a segment. The payload is not copied, it points into buffer
+ * and stays valid only as long as buffer does.
+ * @return false if the datagram is truncated or its payloadSize does not match
+ */
+bool decodeSegment(uint8_t* buffer, uint32_t length, Segment& segment);
+
 /**
  * Generate a secure sequence number
  */
@@ -2,34 +2,80 @@
 #define segment_handler_h
 
 #include "segment.hpp"
+#include "byte_ring.hpp"
 #include <vector>
-#include <ctime>
+#include <unordered_map>
+#include <unordered_set>
 
+/**
+ * Error control of a connection, both ends have to use the same one
+ */
+enum ArqMode
+{
+    GO_BACK_N = 0,         // Cumulative ACKs, a timeout resends the whole window
+    SELECTIVE_REPEAT = 1   // Per-segment ACKs and timers, only lost segments are resent
+};
+
+/**
+ * Sender side of the sliding window.
+ *
+ * segmentBuffer holds the window: sendBase is the first unacknowledged byte,
+ * nextSeqNum the first byte not transmitted yet and the window edge the end
+ * of the last buffered segment. Sequence numbers start at 0 with the first
+ * data byte of the connection and continue across sends.
+ *
+ * In SELECTIVE_REPEAT mode every segment also has its own ACK state and
+ * retransmission deadline, set by markAcknowledged and expiredSegments.
+ */
 class SegmentHandler
 {
 private:
     uint8_t windowSize;
-    uint32_t currentSeqNum;
-    uint32_t currentAckNum;
+    ArqMode mode;
+    uint32_t currentSeqNum;  // Sequence number of the next segment generated
     uint8_t *dataStream;  
     uint32_t dataSize;
     uint32_t dataIndex;
+    ByteRing *source;  // Streaming input instead of dataStream, read on this thread only
     
-    uint32_t LAR;  // Last ACK Received
-    uint32_t LFS;  // Last Frame Sent
+    uint32_t sendBase;    // First byte not acknowledged
+    uint32_t nextSeqNum;  // First byte not transmitted
+
+    static const uint32_t MAX_SEQ_NUM = 0xFFFFFFFF;
+    bool validateWindowSize();
 
+    // Per-segment state, parallel to segmentBuffer
     struct SegmentTimer {
-        time_t sentTime;
+        int64_t sentAt;    // First transmission, µs
+        int64_t deadline;  // Retransmission time in µs, only meaningful once sent
         bool acknowledged;
+        bool sent;
+        bool retransmitted;  // Never used as an RTT sample (Karn)
     };
-
-    static const uint32_t MAX_SEQ_NUM = 0xFFFFFFFF;
-    bool validateWindowSize();
     std::vector<SegmentTimer> segmentTimers;
 
-    static const time_t TIMEOUT_SECONDS = 5;
+    uint64_t retransmits;
+    int64_t rttSample;  // Latest RTT sample in µs, -1 if none since the last take
+
+    void acknowledge(size_t index, int64_t now);
+
+    /**
+     * Drop acknowledged segments from the front of the window and refill it
+     * @return Number of segments dropped
+     */
+    uint32_t slideWindow();
+
+    /**
+     * Fill the window up to windowSize segments from the data stream
+     */
     void generateSegments();
 
+    // Payloads the kernel may still read (MSG_ZEROCOPY), with their pin count
+    std::unordered_map<uint8_t*, uint32_t> pinnedPayloads;
+    // Acknowledged payloads waiting for their last unpin before being freed
+    std::unordered_set<uint8_t*> retiredPayloads;
+    void releasePayload(uint8_t* payload);
+
 public:
     std::vector<Segment> segmentBuffer; 
     static const uint32_t MAX_SEGMENT_SIZE = 1460;
@@ -38,15 +84,105 @@ public:
     ~SegmentHandler();
     
     void setDataStream(uint8_t *dataStream, uint32_t dataSize);
+
+    /**
+     * Take the data from a ring filled by another thread instead. Segments are
+     * cut once a full one is available, or the rest once the ring is closed.
+     */
+    void setDataSource(ByteRing* source);
+
+    /**
+     * Fill free window slots with data that reached the source since
+     */
+    void pullSegments();
     uint8_t getWindowSize();
-    Segment *advanceWindow(uint8_t size, int helper);
+
+    /**
+     * Segments in flight at once, takes effect as the window next refills
+     */
+    void setWindowSize(uint8_t windowSize);
+
+    void setMode(ArqMode mode);
+    ArqMode getMode() const;
+
+    uint32_t getSendBase() const;
+    uint32_t getNextSeqNum() const;
+    uint32_t getWindowEdge() const;
+
+    /**
+     * Segments inside the window that were not transmitted yet, contiguous in
+     * segmentBuffer. They count as transmitted once returned.
+     * @param count   Set to the number of segments returned
+     * @param now     Current time (µs, steady clock)
+     * @param timeout Retransmission timeout of the returned segments (µs)
+     * @return First segment, nullptr when count is 0
+     */
+    Segment *nextSegments(int& count, int64_t now, int64_t timeout);
+
+    /**
+     * Go back to the send base, every unacknowledged segment is transmitted again
+     */
+    void rewind();
 
     bool isInWindow(uint32_t seqNum);
-    void handleAck(uint32_t ackNum);
 
-    void checkTimeouts();
-    void markAcknowledged(uint32_t seqNum);
+    /**
+     * Cumulative ACK, ackNum is the next byte the receiver expects.
+     * Slides the window by exactly the acknowledged segments and generates one
+     * new segment per freed slot. Stale, duplicate or out of range ACKs are ignored.
+     * @return Number of segments acknowledged
+     */
+    uint32_t handleAck(uint32_t ackNum, int64_t now);
+
+    /**
+     * Selective ACK of the segment starting at seqNum. Slides the window when
+     * it was the oldest unacknowledged one.
+     * @return Number of segments the window slid by
+     */
+    uint32_t markAcknowledged(uint32_t seqNum, int64_t now);
+
+    /**
+     * Transmitted, unacknowledged segments whose deadline passed. Their
+     * deadline is moved to newDeadline, the caller resends them.
+     */
+    std::vector<Segment*> expiredSegments(int64_t now, int64_t newDeadline);
+
+    /**
+     * Earliest deadline of a transmitted, unacknowledged segment, -1 if none
+     */
+    int64_t nextDeadline() const;
+
+    /**
+     * Segments transmitted more than once, over the handler's lifetime
+     */
+    uint64_t getRetransmits() const;
+
+    /**
+     * RTT of the latest segment acknowledged on its first transmission, in µs.
+     * Returns -1 if there was none since the previous call.
+     */
+    int64_t takeRttSample();
+
+    /**
+     * Every byte of the data stream is acknowledged
+     */
+    bool isComplete() const;
+
     void cleanupSegment(Segment& segment);
+
+    /**
+     * Keep a payload alive while the kernel still references it.
+     * An acknowledged segment is only freed after its last unpin.
+     */
+    void pinPayload(uint8_t* payload);
+    void unpinPayload(uint8_t* payload);
 };
 
+/**
+ * a < b in 32-bit sequence space, correct across wraparound
+ */
+inline bool seqLess(uint32_t a, uint32_t b) {
+    return static_cast<int32_t>(a - b) < 0;
+}
+
 #endif
\ No newline at end of file
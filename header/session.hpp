@@ -0,0 +1,209 @@
+#ifndef session_h
+#define session_h
+
+#include <cstdint>
+#include <string>
+#include <deque>
+#include <vector>
+#include <functional>
+#include <filesystem>
+#include "stream_channel.hpp"
+
+enum TransferKind
+{
+    TRANSFER_SINGLE = 0,
+    TRANSFER_PACK = 1,
+    TRANSFER_MANIFEST = 2
+};
+
+/**
+ * In front of every transfer of a session, followed by the name and then
+ * size bytes of data. The data of a pack is a uint32_t file count, one
+ * PackEntry per file, their names and then their contents, back to back.
+ * A manifest is the same without the contents: it lists files that follow
+ * later in the session.
+ */
+struct TransferHeader
+{
+    uint32_t magic;
+    uint32_t id;          // Position of the transfer in the session, from 0 (a pack or manifest: of its first file)
+    uint64_t size;
+    uint32_t mode;        // Permission bits of a file, 0 for a message
+    uint16_t nameLength;
+    uint16_t kind;        // TransferKind
+} __attribute__((packed));
+
+enum PackEntryFlags
+{
+    PACK_ENTRY_DIRECTORY = 1  // A directory of a manifest, size 0 and no data follows
+};
+
+/**
+ * One file of a pack or manifest, in its index
+ */
+struct PackEntry
+{
+    uint64_t size;
+    uint32_t mode;
+    uint16_t nameLength;
+    uint16_t flags;       // PackEntryFlags
+} __attribute__((packed));
+
+struct TransferInfo
+{
+    uint32_t id;
+    std::string name;
+    uint64_t size;
+    uint32_t mode;
+    bool directory = false;  // Only in a manifest
+};
+
+/**
+ * Sender side of a session: one connection, one stream, many transfers.
+ *
+ * Each transfer is framed into the send channel of the connection (see
+ * TCPSocket::sendStream) back to back with the previous one, so a segment
+ * never waits for the end of a file and handshake and close are paid once
+ * per session. A transfer is complete once the peer acknowledged its last
+ * byte, which the writer learns from the channel's delivered count.
+ *
+ * Small files are not framed one by one: they are gathered into a pack, one
+ * transfer with an index up front, which goes out once it is full or before
+ * anything else is framed. The reader returns its files like any other.
+ *
+ * A directory goes out as a manifest of all its directories and files
+ * followed by the files themselves, so the receiver can lay them out before
+ * their data arrives.
+ */
+class SessionWriter
+{
+private:
+    StreamChannel& channel;
+    uint64_t written;  // Stream bytes framed so far
+    uint32_t nextId;
+    std::deque<std::pair<uint64_t, TransferInfo>> unacknowledged;  // By end offset in the stream
+    std::vector<uint8_t> chunk;
+
+    // Small files waiting for the next pack
+    std::vector<TransferInfo> packFiles;
+    std::vector<uint8_t> packData;
+
+    void writeHeader(const TransferInfo& info);
+    void writeData(const uint8_t* data, size_t length);
+    std::vector<uint8_t> buildIndex(TransferKind kind, const std::vector<TransferInfo>& files, uint64_t dataSize);
+    void flushPack();
+
+public:
+    static const uint16_t MAX_NAME_LENGTH = 4096;
+    static const uint32_t SMALL_FILE_SIZE = 64 << 10;  // Largest file put into a pack
+    static const uint32_t PACK_SIZE = 1 << 20;         // File bytes per pack
+    static const uint32_t PACK_FILES = 4096;           // Also files per manifest
+
+    /**
+     * Called on the writer's thread for each acknowledged transfer, in order
+     */
+    std::function<void(const TransferInfo&)> onCompleted;
+
+    explicit SessionWriter(StreamChannel& channel);
+
+    /**
+     * Frame one transfer, blocking while the channel is full
+     * @return Its id
+     */
+    uint32_t write(const std::string& name, const uint8_t* data, uint64_t size, uint32_t mode = 0);
+
+    /**
+     * Frame a file read in chunks, or add it to the pack when it is small.
+     * name is what the receiver sees. Throws std::runtime_error if it cannot
+     * be opened (nothing is framed then) or shrinks while being read (the
+     * rest of the transfer is zeros).
+     */
+    uint32_t writeFile(const std::string& path, const std::string& name);
+
+    /**
+     * Frame the manifest of path itself and the directories and regular
+     * files under it, then the files, named by their path relative to
+     * path's parent ("dir/sub/file"). Directories take an id but no
+     * transfer. The next file is read ahead while one is framed. A file
+     * that cannot be read is skipped and the others still go out, the
+     * first failure is thrown at the end.
+     * @return Number of entries in the manifest
+     */
+    uint32_t writeDirectory(const std::string& path);
+
+    /**
+     * Report the transfers acknowledged so far, write and writeFile do it
+     * after each transfer
+     */
+    void pollCompleted();
+
+    /**
+     * End of the session, the stream ends after the last transfer (and pack)
+     */
+    void close();
+};
+
+/**
+ * Receiver side of a session, splits the receive channel (see
+ * TCPSocket::recvStream) back into transfers. The files of a pack come
+ * straight out of the stream one after the other, the pack is never
+ * buffered whole.
+ */
+class SessionReader
+{
+private:
+    StreamChannel& channel;
+    uint64_t remaining;  // Data bytes of the current transfer not read yet
+    bool failed;
+    std::vector<uint8_t> skipBuffer;
+    std::deque<TransferInfo> packFiles;  // Rest of the current pack, read from the stream in order
+
+    // Small reads are served from here, so a pack of tiny files costs one
+    // channel read per buffer instead of a few per file
+    std::vector<uint8_t> buffer;
+    size_t bufferPos;
+    size_t bufferEnd;
+
+    size_t take(uint8_t* data, size_t length);
+    bool readExactly(uint8_t* data, size_t length);
+    bool readSingle(const TransferHeader& header, TransferInfo& info);
+    bool readIndex(const TransferHeader& header, bool contents, std::vector<TransferInfo>& files);
+
+public:
+    /**
+     * Called from next() with the files of each manifest, before any of them
+     */
+    std::function<void(const std::vector<TransferInfo>&)> onManifest;
+
+    explicit SessionReader(StreamChannel& channel);
+
+    /**
+     * Header of the next transfer, skipping whatever is left of the current one
+     * @return false at the end of the session, or if the stream is not a session
+     */
+    bool next(TransferInfo& info);
+
+    /**
+     * Data of the current transfer
+     * @return Number of bytes read, 0 once the transfer is read to its end
+     */
+    size_t read(uint8_t* data, size_t length);
+
+    /**
+     * The stream ended inside a transfer or did not hold one
+     */
+    bool isFailed() const;
+
+    /**
+     * Read the stream to its end, so the connection can finish
+     */
+    void drain();
+};
+
+/**
+ * name as a relative path of plain components, empty if it has none or
+ * would leave the directory it is saved into (absolute, "..")
+ */
+std::filesystem::path safeTransferPath(const std::string& name);
+
+#endif
@@ -0,0 +1,81 @@
+#ifndef sharded_listener_h
+#define sharded_listener_h
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <functional>
+#include "listener.hpp"
+#include "async.hpp"
+
+/**
+ * One TCPListener per core on the same port (SO_REUSEPORT).
+ *
+ * Each shard runs on its own thread with its own socket, EventLoop, io_uring
+ * ring and connections, sharing nothing with the others. The kernel hashes a
+ * peer's 4-tuple to pick the shard, so a connection always lands on the same
+ * thread and receive throughput grows with the number of cores.
+ */
+class ShardedListener
+{
+public:
+    /**
+     * Coroutine serving one accepted connection, runs on the shard that
+     * accepted it and owns the socket
+     */
+    using Handler = std::function<Task<void>(TCPSocket*)>;
+
+    /**
+     * Called on the shard's thread once its listener is bound
+     */
+    using Setup = std::function<void(TCPListener&)>;
+
+    /**
+     * @param shardCount Number of sockets and threads, 0 uses one per core
+     * @param pinCpus    Pin shard i to CPU i (modulo the core count)
+     */
+    ShardedListener(string ip, int32_t port, int shardCount = 0,
+                    TransportType transportType = UDP_SOCKET_TRANSPORT, bool pinCpus = false);
+
+    ~ShardedListener();
+
+    /**
+     * Start every shard, each accepting connections and spawning handler for them
+     */
+    void start(Handler handler, Setup setup = nullptr);
+
+    /**
+     * Stop accepting on every shard. A shard keeps serving the connections it
+     * accepted and its thread exits once all their handlers have finished.
+     */
+    void stop();
+
+    /**
+     * Wait for every shard thread to exit
+     */
+    void join();
+
+    int getShardCount() const;
+
+    uint64_t getAcceptedCount(int shard) const;
+
+private:
+    struct Shard {
+        std::thread thread;
+        int wakeFd;  // eventfd, written by stop
+        std::atomic<uint64_t> accepted;
+    };
+
+    string ip;
+    int32_t port;
+    TransportType transportType;
+    bool pinCpus;
+
+    std::vector<std::unique_ptr<Shard>> shards;
+
+    void runShard(int index, Handler handler, Setup setup);
+};
+
+#endif
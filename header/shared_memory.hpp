@@ -0,0 +1,147 @@
+#ifndef shared_memory_h
+#define shared_memory_h
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <netinet/in.h>
+#include "segment.hpp"
+
+/**
+ * Payload of a SYN offering shared memory, echoed in the SYN-ACK that accepts it
+ */
+struct SharedMemoryOffer
+{
+    uint32_t magic;
+    int32_t pid;        // Process that created the memfd
+    int32_t fd;         // The memfd in that process, opened through /proc/<pid>/fd/<fd>
+    uint32_t ringSize;
+    uint64_t token;     // Random, also stored in the mapping
+} __attribute__((packed));
+
+/**
+ * A SYN whose payload is a shared memory offer
+ */
+bool isSharedMemoryOffer(const Segment& segment);
+
+/**
+ * addr is a loopback address or one of this host's interfaces
+ */
+bool isSameHost(const struct sockaddr_in& addr);
+
+/**
+ * One direction of a SharedMemoryChannel, in the mapping. Positions only
+ * grow, a message ends at endPos once ends is incremented.
+ */
+struct SharedRingHeader
+{
+    // Reader side
+    alignas(64) std::atomic<uint64_t> readPos;
+    std::atomic<uint64_t> endsConsumed;  // Messages read to their end
+    std::atomic<uint32_t> writerWaiting;
+
+    // Writer side
+    alignas(64) std::atomic<uint64_t> writePos;
+    std::atomic<uint64_t> endPos;
+    std::atomic<uint64_t> ends;
+    std::atomic<uint32_t> readerWaiting;
+};
+
+struct SharedMemoryLayout;
+
+/**
+ * Data path of a connection between two processes of the same host.
+ *
+ * A memfd holds two single-producer/single-consumer byte rings, one per
+ * direction, created by the side that sends the SYN and mapped by the peer.
+ * Bytes never pass through the kernel; a side that runs out of data (or
+ * space) sets its waiting flag in the ring and the other side asks the
+ * socket to ring the doorbell after its next progress, a UDP segment that
+ * wakes the peer's EventLoop like any other.
+ *
+ * A send is one message, it is complete once the reader consumed its end:
+ * the same moment every byte would have been acknowledged.
+ */
+class SharedMemoryChannel
+{
+private:
+    SharedMemoryLayout* layout;
+    size_t mappedSize;
+    int fd;
+    SharedMemoryOffer offer;
+
+    SharedRingHeader* out;
+    uint8_t* outData;
+    SharedRingHeader* in;
+    uint8_t* inData;
+    uint64_t mask;
+
+    bool doorbell;
+
+    void map(bool initiator);
+
+public:
+    static const uint32_t DEFAULT_RING_SIZE = 4 << 20;
+
+    /**
+     * Create the memfd, for the side offering it
+     * @param ringSize Bytes per direction, rounded up to a power of two
+     */
+    explicit SharedMemoryChannel(uint32_t ringSize = DEFAULT_RING_SIZE);
+
+    /**
+     * Map the peer's memfd, throws std::runtime_error if it cannot be opened
+     * or is not the one offered
+     */
+    explicit SharedMemoryChannel(const SharedMemoryOffer& offer);
+
+    ~SharedMemoryChannel();
+
+    SharedMemoryChannel(const SharedMemoryChannel&) = delete;
+    SharedMemoryChannel& operator=(const SharedMemoryChannel&) = delete;
+
+    const SharedMemoryOffer& getOffer() const;
+
+    /**
+     * Writer: copy as much of data as fits
+     * @return Number of bytes written
+     */
+    size_t write(const uint8_t* data, size_t length);
+
+    size_t writable() const;
+
+    /**
+     * Writer: the bytes written so far end the current message
+     */
+    void endMessage();
+
+    /**
+     * Writer: the reader reached the end of the last message
+     */
+    bool isMessageConsumed() const;
+
+    /**
+     * Writer: bytes the reader took out of the ring so far
+     */
+    uint64_t getConsumed() const;
+
+    /**
+     * Reader: copy up to length bytes, never past the end of a message
+     * @param messageEnd Set once the current message was read to its end
+     * @return Number of bytes read
+     */
+    size_t read(uint8_t* data, size_t length, bool& messageEnd);
+
+    /**
+     * Both directions wait: the peer asks for the doorbell on its next progress.
+     * Look at the rings again afterwards, the peer may have moved in between.
+     */
+    void requestDoorbell();
+
+    /**
+     * The peer waits for the progress made since the last call
+     */
+    bool takeDoorbell();
+};
+
+#endif
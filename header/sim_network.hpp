@@ -0,0 +1,128 @@
+#ifndef sim_network_h
+#define sim_network_h
+
+#include <map>
+#include <deque>
+#include <vector>
+#include "transport.hpp"
+#include "event_loop.hpp"
+#include "impairment.hpp"
+
+class SimTransport;
+
+/**
+ * In-memory network between the SimTransports of one thread.
+ *
+ * Datagrams pass through an Impairment (loss, delay, jitter, reordering,
+ * duplication, rate) and are delivered from a timer of the thread's
+ * EventLoop, which the network switches to virtual time. Retransmission and
+ * close timeouts then take no wall-clock time, and the same profile and seed
+ * always give the same run, as long as every socket runs on that thread.
+ */
+class SimNetwork
+{
+private:
+    EventLoop& loop;
+    Impairment impairment;
+    int timerId;
+
+    std::map<uint64_t, SimTransport*> endpoints;  // By bound address
+    // Impairment state and counters of every source -> destination pair
+    std::map<std::pair<uint64_t, uint64_t>, ImpairmentDirection> links;
+    uint16_t nextEphemeralPort;
+
+    /**
+     * Hand every due datagram to its endpoint and arm the timer for the next one
+     */
+    void deliver();
+
+public:
+    /**
+     * Switches the calling thread's EventLoop to virtual time, so it has to
+     * be created before the thread's first socket. The network must outlive
+     * its transports.
+     */
+    explicit SimNetwork(const ImpairmentProfile& profile);
+    ~SimNetwork();
+
+    SimNetwork(const SimNetwork&) = delete;
+    SimNetwork& operator=(const SimNetwork&) = delete;
+
+    /**
+     * Bind transport to addr, port 0 picks a free one and writes it back
+     * @return false if the address is taken
+     */
+    bool attach(SimTransport* transport, struct sockaddr_in& addr);
+
+    void detach(const struct sockaddr_in& addr);
+
+    /**
+     * Put a datagram on the wire, it is copied
+     */
+    void send(const struct sockaddr_in& source, const struct sockaddr_in& dest, const uint8_t* data, uint32_t length);
+
+    /**
+     * Counters of every link added up
+     */
+    ImpairmentDirection getTotals() const;
+
+    /**
+     * Virtual time in µs since the network was created
+     */
+    int64_t nowUs() const;
+};
+
+/**
+ * Transport on a SimNetwork. Like a UDP socket it binds an ephemeral address
+ * on its first send, received datagrams queue up until they are read.
+ */
+class SimTransport : public Transport
+{
+private:
+    SimNetwork* network;
+    struct sockaddr_in local;
+    bool bound;
+
+    struct Datagram {
+        std::vector<uint8_t> data;
+        struct sockaddr_in addr;
+    };
+
+    std::deque<Datagram> queue;
+    // Datagram returned last, its payload stays valid until the next receive
+    Datagram current;
+
+    // eventfd readable while the queue is not empty
+    int readyFd;
+
+    void clearReady();
+
+public:
+    explicit SimTransport(SimNetwork& network);
+
+    ~SimTransport();
+
+    /**
+     * Queue a datagram the network delivers to this transport
+     */
+    void deliver(std::vector<uint8_t>&& data, const struct sockaddr_in& addr);
+
+    bool bind(const struct sockaddr_in& addr) override;
+
+    bool sendSegment(const Segment& segment, const struct sockaddr_in& addr) override;
+
+    bool sendSegments(const Segment* segments, int count, const struct sockaddr_in& addr) override;
+
+    /**
+     * A non-zero timeout runs the thread's loop, which moves virtual time forward
+     */
+    int32_t receiveSegment(Segment& segment, struct sockaddr_in& addr, int timeoutMs) override;
+
+    void close() override;
+
+    int fd() const override;
+
+    int pollFd() const override;
+};
+
+#endif
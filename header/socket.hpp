@@ -5,8 +5,18 @@
 #include <string>
 #include <netinet/in.h>
 #include <functional>
+#include <vector>
+#include <map>
+#include <chrono>
 #include "segment.hpp"
 #include "segment_handler.hpp"
+#include "transport.hpp"
+#include "event_loop.hpp"
+#include "async.hpp"
+#include "stream_channel.hpp"
+#include "connection_stats.hpp"
+#include "packet_trace.hpp"
+#include "shared_memory.hpp"
 
 using namespace std;
 
@@ -32,29 +42,235 @@ private:
     int32_t port;
 
     /**
-     * Socket descriptor
+     * Network backend (plain UDP socket, io_uring, ...)
      */
-    int32_t socket;
+    Transport *transport;
 
     SegmentHandler *segmentHandler;
 
     TCPStatusEnum status;
 
+    ConnectionStats stats;
+    int64_t stateSinceUs;  // On the loop's clock, like every time in here
+
+    /**
+     * Every state change goes through here, for the time-in-state counters
+     */
+    void setStatus(TCPStatusEnum next);
+
+    // Shared by every traced socket, nullptr when tracing is off
+    PacketTrace* trace;
+    void traceSegment(TraceEvent event, const Segment& segment);
+
     struct sockaddr_in peerAddr;
 
     bool peerAddrSet; 
 
+    /**
+     * Reactor of the thread that created the socket
+     */
+    EventLoop& loop;
+    int watchId;
+    int timerId;
+
+    static const int RETRANSMIT_TIMEOUT_MS = 1000;
+    static const int MAX_HANDSHAKE_RETRIES = 30;
+    static const int CLOSE_TIMEOUT_MS = 5000;
+    // A lost doorbell only delays a shared memory transfer by this much
+    static const int SHARED_MEMORY_POLL_MS = 100;
+
+    // Last SYN, SYN-ACK or handshake ACK sent, repeated when it gets lost
+    Segment handshakeSegment;
+    int retries;
+
+    struct HandshakeOperation {
+        bool active;
+        std::function<void(bool)> onDone;
+    } handshakeOp;
+
+    // Full-duplex send: the ACK stage (handleAckSegment) slides the window as
+    // ACKs arrive, the TX stage (transmitPending) sends what the freed slots allow
+    // once per batch of received segments, instead of a whole window per round trip
+    struct SendOperation {
+        bool active;
+        bool slotsFreed;  // Window slots freed since the last TX stage run
+        bool rewindPending;  // Go-Back-N window update seen, the TX stage resends from the send base
+        bool timerRunning;
+        StreamChannel* stream;  // Data written by another thread, nullptr for a buffer send
+        int streamWatchId;
+        // Shared memory: the part of a buffer send not in the ring yet, and
+        // whether the whole message is
+        const uint8_t* pending;
+        uint32_t pendingSize;
+        bool ended;
+        uint64_t sharedConsumed;  // Ring bytes the peer had read when last counted as delivered
+        std::function<void()> onDone;
+    } sendOp;
+
+    // Next in-order data byte expected from the peer, acknowledged cumulatively
+    uint32_t expectedSeqNum;
+
+    // Selective Repeat: segments received ahead of expectedSeqNum, by sequence number
+    std::map<uint32_t, std::vector<uint8_t>> reorderBuffer;
+
+    struct RecvOperation {
+        bool active;
+        std::vector<uint8_t>* buffer;
+        StreamChannel* stream;  // Read by another thread instead of buffer
+        int spaceWatchId;
+        bool starved;  // An in-order segment was dropped because the ring was full
+        uint32_t length;
+        uint32_t totalReceived;
+        int segCount;
+        std::function<void(int32_t)> onDone;
+    } recvOp;
+
+    // Rings of a same-host peer, set by the handshake when both ends enable them
+    bool sharedMemoryEnabled;
+    SharedMemoryChannel* sharedMemory;
+    std::vector<uint8_t> sharedBounce;  // Stream bytes between a StreamChannel and the rings
+
+    bool closing;
+    int64_t closeDeadlineUs;
+    std::function<void()> closeDone;
+
     // Helper Method
-    void setTimeout(int seconds);
-    bool sendSegment(const Segment& segment, const struct sockaddr_in& addr);
-    int32_t receiveSegment(Segment& segment, struct sockaddr_in& addr);
+    bool sendSegment(const Segment& segment, const struct sockaddr_in& addr, TraceEvent event = TRACE_SEND);
+    // The first `retransmitted` segments are traced as retransmissions
+    bool sendSegments(const Segment* segments, int count, const struct sockaddr_in& addr, int retransmitted = 0);
+    int32_t receiveSegment(Segment& segment, struct sockaddr_in& addr, int timeoutMs = -1);
+
+    // Event handlers, called from the loop
+    void onReadable();
+    void onTimer();
+    void handleSegment(const Segment& segment, struct sockaddr_in& addr);
+    void handleFin();
+    void handleAckSegment(const Segment& segment);
+    void handleData(const Segment& segment);
+    void handleSelectiveData(const Segment& segment);
+    void onStreamData();
+    void onStreamSpace();
+    bool drainReorderBuffer();
+    void retransmitExpired(int64_t nowUs);
+    uint32_t recvSpace() const;
+    void deliverPayload(const uint8_t* data, uint32_t size);
+
+    void offerSharedMemory();
+    void acceptSharedMemory(const Segment& synSegment);
+    void confirmSharedMemory(const Segment& synAckSegment);
+    void releaseSharedMemory();
+    void pumpSharedMemory();
+    bool pumpSharedSend();
+    bool pumpSharedRecv();
+
+    void transmitPending();
+    bool isBusy() const;
+    void updateWatch();
+    void armTimer(int timeoutMs);
+    void armRetransmitTimer();
+    void detach();
+
+    void finishHandshake(bool established);
+    void finishSend();
+    void finishRecv();
+    void finishClose();
 
 public:
-    TCPSocket(string ip, int32_t port);
+    TCPSocket(string ip, int32_t port, TransportType transportType = UDP_SOCKET_TRANSPORT);
+
+    /**
+     * Socket on an existing transport, which it takes ownership of
+     * (connections handed out by TCPListener)
+     */
+    TCPSocket(string ip, int32_t port, Transport* transport);
 
     ~TCPSocket();
 
-    struct sockaddr_in createAddr(string ip, int32_t port);
+    /**
+     * IPv4 address of ip (dotted quad, or "localhost" for 127.0.0.1) and port.
+     * Throws std::runtime_error if ip is neither.
+     */
+    static struct sockaddr_in createAddr(const string& ip, int32_t port);
+
+    /**
+     * Send each window as one large buffer split by the kernel (UDP_SEGMENT).
+     * Falls back to sendmmsg batching when GSO is unavailable.
+     */
+    void setGso(bool enabled);
+
+    /**
+     * Let the kernel coalesce incoming datagrams (UDP_GRO) and split them here.
+     */
+    void setGro(bool enabled);
+
+    /**
+     * Send data segments straight from the SegmentHandler buffers (SO_ZEROCOPY).
+     * Acknowledged payloads stay pinned until the kernel reports completion.
+     * Takes precedence over GSO, which needs a contiguous copy of the window.
+     */
+    void setZeroCopy(bool enabled);
+
+    /**
+     * Use Selective Repeat instead of Go-Back-N: per-segment ACKs and timers,
+     * out-of-order segments are buffered by the receiver. Both ends must enable it.
+     */
+    void setSelectiveRepeat(bool enabled);
+
+    /**
+     * Window in segments (default 3, at most 255). In Selective Repeat mode it
+     * is also the receive window, both ends should use the same size.
+     */
+    void setWindowSize(uint8_t segments);
+
+    /**
+     * Move the data of a connection to a peer on the same host through shared
+     * memory (a memfd mapped by both processes) instead of UDP segments. The
+     * handshake, doorbells and close stay on the transport. Both ends must
+     * enable it, otherwise (or if the peer cannot map the memory) the
+     * connection falls back to segments.
+     */
+    void setSharedMemory(bool enabled);
+
+    /**
+     * Snapshot of the connection's counters, dump with ConnectionStats::toJson
+     */
+    ConnectionStats getStats() const;
+
+    /**
+     * Record this connection's segment events and state changes into trace,
+     * which must outlive the socket. nullptr turns tracing off.
+     */
+    void setTrace(PacketTrace* trace);
+
+    /**
+     * Non-blocking operations. Each returns at once, onDone is called from the
+     * thread's EventLoop when the operation finishes.
+     */
+    void startHandshake(const struct sockaddr_in& destAddr, std::function<void(bool)> onDone);
+    void startSend(void* dataStream, uint32_t dataSize, std::function<void()> onDone);
+    void startRecv(std::vector<uint8_t>& buffer, uint32_t length, std::function<void(int32_t)> onDone);
+    void startClose(std::function<void()> onDone);
+
+    /**
+     * Streaming operations: the application writes into (or reads from) the
+     * channel on its own thread while this socket's thread runs the protocol.
+     * A send ends once the channel is closed and every byte acknowledged, a
+     * receive closes the channel after the last segment.
+     */
+    void startSendStream(StreamChannel& channel, std::function<void()> onDone);
+    void startRecvStream(StreamChannel& channel, std::function<void(int32_t)> onDone);
+
+    /**
+     * Coroutine operations, e.g. `co_await socket.async_recv(buffer, length)`.
+     * They suspend the calling Task until the thread's EventLoop finishes them.
+     */
+    OperationAwaiter<bool> async_connect(const struct sockaddr_in& destAddr);
+    OperationAwaiter<bool> async_accept();
+    OperationAwaiter<void> async_send(void* dataStream, uint32_t dataSize);
+    OperationAwaiter<int32_t> async_recv(std::vector<uint8_t>& buffer, uint32_t length);
+    OperationAwaiter<void> async_close();
+
+    // Blocking wrappers, run the EventLoop until the operation is done
 
     bool doHandshake(struct sockaddr_in& destAddr);
 
@@ -68,6 +284,10 @@ public:
 
     int32_t recv(std::vector<uint8_t>& buffer, uint32_t length);
 
+    void sendStream(StreamChannel& channel);
+
+    int32_t recvStream(StreamChannel& channel);
+
     void recvFile(void* buffer, uint32_t length);
 
     void receiveFileMetadata(string& fileName, uintmax_t& fileSize);
@@ -0,0 +1,84 @@
+#ifndef stream_channel_h
+#define stream_channel_h
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include "byte_ring.hpp"
+
+/**
+ * One direction of a connection between an application thread and the
+ * protocol thread running the socket.
+ *
+ * Bytes go through a ByteRing, so the data path takes no lock. Two eventfds
+ * only wake the other side: dataFd when bytes (or the end of the stream) were
+ * published, spaceFd when bytes were consumed. A full ring blocks the writer,
+ * which is the back-pressure from a slow peer or a slow reader.
+ */
+class StreamChannel
+{
+private:
+    ByteRing ring;
+    int dataFd;
+    int spaceFd;
+    std::atomic<uint64_t> deliveredBytes;
+
+    static void signal(int fd);
+    static void clear(int fd);
+    static void wait(int fd);
+
+public:
+    /**
+     * @param capacity Ring size in bytes, rounded up to a power of two
+     */
+    explicit StreamChannel(size_t capacity = 1 << 20);
+
+    ~StreamChannel();
+
+    StreamChannel(const StreamChannel&) = delete;
+    StreamChannel& operator=(const StreamChannel&) = delete;
+
+    /**
+     * Producer: append data, blocking while the ring is full
+     * @return length, or fewer bytes when block is false and the ring filled up
+     */
+    size_t write(const uint8_t* data, size_t length, bool block = true);
+
+    /**
+     * Consumer: take up to length bytes, blocking while the ring is empty
+     * @return Number of bytes read, 0 once the stream is closed and drained
+     *         (or at once when block is false)
+     */
+    size_t read(uint8_t* data, size_t length, bool block = true);
+
+    /**
+     * Producer: end of stream
+     */
+    void close();
+
+    /**
+     * Consumer side for the protocol thread, which polls dataFd from its
+     * EventLoop and calls consumed() after reading the ring directly
+     */
+    ByteRing& getRing();
+    int getDataFd() const;
+    void acknowledgeData();
+    void consumed();
+
+    /**
+     * Send direction: the protocol thread counts the bytes the peer
+     * acknowledged, any thread may read the total
+     */
+    void delivered(uint64_t bytes);
+    uint64_t getDelivered() const;
+
+    /**
+     * Producer side for the protocol thread (receive direction): publish
+     * bytes written to the ring directly
+     */
+    void published();
+    int getSpaceFd() const;
+    void acknowledgeSpace();
+};
+
+#endif
@@ -0,0 +1,54 @@
+#ifndef stripe_h
+#define stripe_h
+
+#include <cstdint>
+#include <string>
+#include <filesystem>
+#include "stream_channel.hpp"
+
+/**
+ * In front of each stripe of a striped file transfer, followed by the name
+ * and then length bytes of the file from offset. Every stripe has its own
+ * connection and carries the whole header, so they can arrive in any order.
+ */
+struct StripeHeader
+{
+    uint32_t magic;
+    uint16_t index;       // From 0
+    uint16_t count;
+    uint64_t fileSize;
+    uint64_t offset;
+    uint64_t length;
+    uint32_t mode;        // Permission bits of the file
+    uint16_t nameLength;
+    uint16_t reserved;
+} __attribute__((packed));
+
+static const uint16_t MAX_STRIPES = 64;
+
+/**
+ * Byte range of stripe index when a file of size bytes is split into count
+ * stripes: equal parts rounded up to 1 MB, the last ones may be short or empty
+ */
+void stripeRange(uint64_t size, uint16_t index, uint16_t count, uint64_t& offset, uint64_t& length);
+
+/**
+ * Frame stripe index of count of the file at path into channel, the data is
+ * read with pread so every stripe reads the file independently. Throws
+ * std::runtime_error if the file cannot be read, the channel is not closed.
+ */
+void writeStripe(StreamChannel& channel, const std::string& path, const std::string& name,
+                 uint16_t index, uint16_t count);
+
+/**
+ * Read one stripe from channel and pwrite it at its offset into its file
+ * under directory. The first stripe to arrive creates the file at its full
+ * size, the others write into the same file. The file gets the header's
+ * mode plus owner write, the caller drops that once every stripe is in.
+ * Throws std::runtime_error if the stream is not a valid stripe, ends early
+ * or the file cannot be written.
+ * @return The stripe's header
+ */
+StripeHeader readStripe(StreamChannel& channel, const std::filesystem::path& directory, std::string& name);
+
+#endif
@@ -0,0 +1,81 @@
+#ifndef transport_h
+#define transport_h
+
+#include <netinet/in.h>
+#include <functional>
+#include "segment.hpp"
+#include "segment_handler.hpp"
+
+enum TransportType
+{
+    UDP_SOCKET_TRANSPORT = 0,
+    IO_URING_TRANSPORT = 1,
+    XDP_TRANSPORT = 2
+};
+
+/**
+ * Abstract class.
+ *
+ * Moves segments between a TCPSocket and the network. The protocol logic
+ * stays in TCPSocket, a transport only deals with datagrams.
+ */
+class Transport
+{
+public:
+    static const uint32_t MAX_DATAGRAM_SIZE = SEGMENT_HEADER_SIZE + SegmentHandler::MAX_SEGMENT_SIZE;
+
+    /**
+     * Called when a payload passed to sendSegments is still referenced by the
+     * kernel after the call returns, and again once it is released (MSG_ZEROCOPY).
+     */
+    std::function<void(uint8_t*)> onPayloadPinned;
+    std::function<void(uint8_t*)> onPayloadReleased;
+
+    virtual ~Transport() {}
+
+    virtual bool bind(const struct sockaddr_in& addr) = 0;
+
+    virtual bool sendSegment(const Segment& segment, const struct sockaddr_in& addr) = 0;
+
+    /**
+     * Send a whole window in as few system calls as the backend allows
+     */
+    virtual bool sendSegments(const Segment* segments, int count, const struct sockaddr_in& addr) = 0;
+
+    /**
+     * Receive one segment. The payload is not copied, it stays valid until the
+     * next receiveSegment call on this transport.
+     * @param timeoutMs Milliseconds to wait, 0 never blocks, -1 blocks until a datagram arrives
+     * @return Datagram length, 0 on timeout, -1 on error
+     */
+    virtual int32_t receiveSegment(Segment& segment, struct sockaddr_in& addr, int timeoutMs) = 0;
+
+    /**
+     * Wait for outstanding kernel work and release the descriptor. Idempotent.
+     */
+    virtual void close() = 0;
+
+    /**
+     * Underlying descriptor, -1 if the backend has none
+     */
+    virtual int fd() const = 0;
+
+    /**
+     * Descriptor an event loop waits on before calling receiveSegment with a
+     * zero timeout. Readable whenever a receive may make progress.
+     */
+    virtual int pollFd() const;
+
+    // Linux UDP offloads, backends without support keep them off and return false
+    virtual bool setGso(bool enabled);
+    virtual bool setGro(bool enabled);
+    virtual bool setZeroCopy(bool enabled);
+};
+
+/**
+ * Create a transport of the given type. Falls back to plain UDP sockets
+ * when the requested backend is not available on this kernel.
+ */
+Transport* createTransport(TransportType type);
+
+#endif
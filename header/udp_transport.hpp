@@ -0,0 +1,111 @@
+#ifndef udp_transport_h
+#define udp_transport_h
+
+#include <vector>
+#include <deque>
+#include "transport.hpp"
+
+/**
+ * Plain UDP socket backend with optional GSO, GRO and MSG_ZEROCOPY offloads.
+ */
+class UdpTransport : public Transport
+{
+private:
+    /**
+     * Socket descriptor
+     */
+    int32_t socket;
+
+    /**
+     * Receive timeout currently applied with SO_RCVTIMEO, only changed when it differs
+     */
+    int currentTimeoutMs;
+
+    /**
+     * UDP GSO (UDP_SEGMENT) transmit offload, Linux only.
+     * Cleared automatically when the kernel rejects the cmsg.
+     */
+    bool gsoEnabled;
+
+    /**
+     * UDP GRO receive coalescing, Linux only. One read may return many
+     * datagrams of gso_size bytes, which are split in place.
+     */
+    bool groEnabled;
+
+    /**
+     * MSG_ZEROCOPY data sends, Linux only. Payloads stay pinned through
+     * onPayloadPinned until the kernel reports the send as completed.
+     */
+    bool zeroCopyEnabled;
+
+    struct ZeroCopySend {
+        uint32_t id;
+        uint8_t* payload;
+        bool completed;
+        uint8_t header[SEGMENT_HEADER_SIZE];
+    };
+
+    // Zerocopy sends waiting for their completion notification, in id order.
+    // Elements are only pushed at the back and popped at the front so headers never move.
+    std::deque<ZeroCopySend> zeroCopyPending;
+    uint32_t zeroCopyNextId;
+
+    static const uint32_t MAX_UDP_PAYLOAD = 65507;
+    static const uint32_t GSO_MAX_SEGMENTS = MAX_UDP_PAYLOAD / MAX_DATAGRAM_SIZE;
+    static const uint32_t MAX_GRO_BUFFER = 65535;
+
+    std::vector<uint8_t> txBuffer;
+    std::vector<uint8_t> rxBuffer;
+
+    // Datagrams left in rxBuffer from the last (possibly coalesced) read
+    uint32_t rxLength;
+    uint32_t rxOffset;
+    uint32_t rxSegmentSize;
+    struct sockaddr_in rxAddr;
+
+    // Helper Method
+    void setTimeout(int timeoutMs);
+    bool sendGsoBatch(const uint8_t* data, uint32_t length, uint16_t gsoSize, const struct sockaddr_in& addr);
+    bool sendBatch(const uint8_t* data, const std::vector<uint32_t>& lengths, const struct sockaddr_in& addr);
+    bool sendZeroCopy(const Segment* segments, int count, const struct sockaddr_in& addr);
+    void reapZeroCopyCompletions();
+    void waitZeroCopyCompletions(int timeoutMs);
+    int32_t receiveDatagrams(int flags);
+
+public:
+    UdpTransport();
+
+    ~UdpTransport();
+
+    bool bind(const struct sockaddr_in& addr) override;
+
+    bool sendSegment(const Segment& segment, const struct sockaddr_in& addr) override;
+
+    bool sendSegments(const Segment* segments, int count, const struct sockaddr_in& addr) override;
+
+    int32_t receiveSegment(Segment& segment, struct sockaddr_in& addr, int timeoutMs) override;
+
+    void close() override;
+
+    int fd() const override;
+
+    /**
+     * Send each window as one large buffer split by the kernel (UDP_SEGMENT).
+     * Falls back to sendmmsg batching when GSO is unavailable.
+     */
+    bool setGso(bool enabled) override;
+
+    /**
+     * Let the kernel coalesce incoming datagrams (UDP_GRO) and split them here.
+     */
+    bool setGro(bool enabled) override;
+
+    /**
+     * Send data segments straight from the caller's buffers (SO_ZEROCOPY).
+     * Takes precedence over GSO, which needs a contiguous copy of the window.
+     */
+    bool setZeroCopy(bool enabled) override;
+};
+
+#endif
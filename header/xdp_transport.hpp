@@ -0,0 +1,132 @@
+#ifndef xdp_transport_h
+#define xdp_transport_h
+
+#include <string>
+#include <vector>
+#include <map>
+#include <array>
+#include <chrono>
+#include <linux/if_xdp.h>
+#include "transport.hpp"
+#include "udp_transport.hpp"
+
+/**
+ * AF_XDP backend, Linux 5.9+.
+ *
+ * Datagrams for the bound port bypass the kernel network stack: a small XDP
+ * program on the interface redirects them into an AF_XDP socket on queue 0,
+ * whose frames live in a UMEM shared with this process. Received frames go
+ * back to the fill ring on the next receive. A window is written to the TX
+ * ring as complete Ethernet/IPv4/UDP frames and sent with one wakeup, and
+ * sent frames come back through the completion ring.
+ *
+ * A plain UDP socket stays bound to the same port. It reserves the port,
+ * receives whatever the program passes to the kernel (other RX queues,
+ * fragments), and sends what XDP cannot: local destinations, datagrams
+ * larger than the MTU and peers whose MAC address is not resolved yet.
+ */
+class XdpTransport : public Transport
+{
+private:
+    // Producer/consumer ring shared with the kernel
+    struct Ring {
+        uint32_t* producer;
+        uint32_t* consumer;
+        void* descs;
+        uint32_t mask;
+        void* map;
+        size_t mapSize;
+    };
+
+    static const uint32_t FRAME_SIZE = 2048;
+    static const uint32_t FRAME_COUNT = 4096;  // First half receives, second half sends
+    static const uint32_t RING_SIZE = 2048;
+
+    static std::string defaultInterface;
+
+    std::string interfaceName;
+    int ifindex;
+    uint8_t localMac[6];
+    uint32_t localIp;  // Network order
+    uint32_t mtu;
+
+    UdpTransport fallback;
+    bool bound;
+    uint16_t localPort;  // Network order
+
+    int xsk;
+    int epollFd;
+    int mapFd;
+    int progFd;
+    int linkFd;
+    bool attached;  // The XDP program runs, received frames reach the socket
+
+    uint8_t* umem;
+    Ring rx;
+    Ring tx;
+    Ring fill;
+    Ring completion;
+    std::vector<uint64_t> freeFrames;  // Send frames not in the TX ring
+    int64_t currentFrame;  // Frame of the segment returned last, -1 if none
+    uint16_t nextIpId;
+
+    // Destination -> MAC address of its next hop, from the kernel's neighbour
+    // table or learned from frames of directly connected peers
+    std::map<uint32_t, std::array<uint8_t, 6>> neighbours;
+    std::chrono::steady_clock::time_point neighboursRead;
+    std::map<uint32_t, uint32_t> hops;  // Destination -> next hop on this interface, 0 if none
+
+    void mapRing(Ring& ring, const struct xdp_ring_offset& offset, uint64_t pgoff, size_t descSize);
+    void unmapRing(Ring& ring);
+    bool ensureBound();
+    bool attachProgram();
+    void recycleFrame();
+    bool takeFrame(Segment& segment, struct sockaddr_in& addr, int32_t& length);
+    void reclaimFrames();
+    bool resolveNextHop(uint32_t dest, uint8_t* mac);
+    uint32_t nextHop(uint32_t dest);
+    uint32_t buildFrame(uint8_t* frame, const Segment& segment, const struct sockaddr_in& addr, const uint8_t* mac);
+    void kick();
+
+public:
+    /**
+     * Interface createTransport uses for XDP_TRANSPORT
+     */
+    static void setDefaultInterface(const std::string& name);
+
+    static const std::string& getDefaultInterface();
+
+    /**
+     * Socket on queue 0 of interface, throws std::runtime_error when AF_XDP
+     * is not available (kernel, privileges, queue taken by another socket)
+     */
+    explicit XdpTransport(const std::string& interface);
+
+    ~XdpTransport();
+
+    /**
+     * Also attaches the XDP program for addr's port. If that fails the
+     * transport keeps working on the plain UDP socket.
+     */
+    bool bind(const struct sockaddr_in& addr) override;
+
+    bool sendSegment(const Segment& segment, const struct sockaddr_in& addr) override;
+
+    bool sendSegments(const Segment* segments, int count, const struct sockaddr_in& addr) override;
+
+    int32_t receiveSegment(Segment& segment, struct sockaddr_in& addr, int timeoutMs) override;
+
+    void close() override;
+
+    /**
+     * The AF_XDP socket
+     */
+    int fd() const override;
+
+    /**
+     * epoll descriptor over the AF_XDP and the UDP socket
+     */
+    int pollFd() const override;
+};
+
+#endif
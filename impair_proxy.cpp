@@ -0,0 +1,87 @@
+#include <iostream>
+#include <string>
+#include <csignal>
+#include <arpa/inet.h>
+#include "header/impairment.hpp"
+
+/**
+ * UDP proxy between two nodes that impairs the traffic like netem, without
+ * root or a qdisc: loss (Bernoulli and Gilbert-Elliott), delay, jitter,
+ * reordering, duplication and a bandwidth limit with a drop-tail queue.
+ *
+ * The receiver is pointed at the proxy's port instead of the sender's. Every
+ * client address gets its own upstream socket, so a --serve sender sees one
+ * peer per receiver. Both directions are impaired with the same profile but
+ * independent state. Runs are reproducible with --seed.
+ */
+
+using namespace std;
+
+static ImpairmentProxy* proxy = nullptr;
+
+static void onSignal(int) {
+    if (proxy) {
+        proxy->stop();
+    }
+}
+
+static void usage() {
+    cerr << "Usage: impair_proxy LISTEN_PORT TARGET_HOST:TARGET_PORT [options]\n"
+         << ImpairmentProfile::OPTIONS_HELP;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 3) {
+        usage();
+        return 1;
+    }
+
+    ImpairmentProfile profile;
+    int listenPort;
+    struct sockaddr_in target = {};
+    try {
+        listenPort = stoi(argv[1]);
+        string targetSpec = argv[2];
+        size_t colon = targetSpec.rfind(':');
+        if (colon == string::npos) {
+            throw invalid_argument("target");
+        }
+        string host = targetSpec.substr(0, colon);
+        target.sin_family = AF_INET;
+        target.sin_port = htons(stoi(targetSpec.substr(colon + 1)));
+        if (inet_pton(AF_INET, host == "localhost" ? "127.0.0.1" : host.c_str(), &target.sin_addr) != 1) {
+            throw invalid_argument("host");
+        }
+
+        for (int i = 3; i < argc; i += 2) {
+            if (i + 1 >= argc || !profile.setOption(argv[i], argv[i + 1])) {
+                throw invalid_argument(argv[i]);
+            }
+        }
+    } catch (const exception&) {
+        usage();
+        return 1;
+    }
+
+    try {
+        ImpairmentProxy impairmentProxy(listenPort, target, profile);
+        proxy = &impairmentProxy;
+        signal(SIGINT, onSignal);
+        signal(SIGTERM, onSignal);
+
+        char targetHost[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &target.sin_addr, targetHost, sizeof(targetHost));
+        cout << "Proxying port " << listenPort << " to " << targetHost << ":" << ntohs(target.sin_port)
+             << ", Ctrl+C prints the counters" << endl;
+
+        impairmentProxy.run();
+        proxy = nullptr;
+
+        cout << impairmentProxy.getForward().toString() << endl;
+        cout << impairmentProxy.getReverse().toString() << endl;
+    } catch (const exception& e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+    return 0;
+}
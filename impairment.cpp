@@ -0,0 +1,312 @@
+#include "header/impairment.hpp"
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <sys/eventfd.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <unistd.h>
+#include <time.h>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include <algorithm>
+
+static int64_t monotonicNs() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return int64_t(now.tv_sec) * 1000000000 + now.tv_nsec;
+}
+
+static uint64_t addressKey(const struct sockaddr_in& addr) {
+    return (uint64_t(addr.sin_addr.s_addr) << 16) | addr.sin_port;
+}
+
+static int openSocket(int port) {
+    int fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    // Bursts are absorbed by the emulated queue, not dropped by the kernel
+    int size = 8 << 20;
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port);
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+const char* ImpairmentProfile::OPTIONS_HELP =
+    "  --loss P              drop each packet with probability P\n"
+    "  --ge-enter P          Gilbert-Elliott: good to bad state probability per packet\n"
+    "  --ge-exit P           bad to good state probability (default 1)\n"
+    "  --ge-loss-good P      loss in the good state (default 0)\n"
+    "  --ge-loss-bad P       loss in the bad state (default 1)\n"
+    "  --delay MS            one-way delay\n"
+    "  --jitter MS           uniform delay variation, +-MS\n"
+    "  --reorder P           hold a packet back with probability P...\n"
+    "  --reorder-delay MS    ...by MS (default 5)\n"
+    "  --duplicate P         send a packet twice with probability P\n"
+    "  --rate MBIT           bandwidth limit in Mbit/s\n"
+    "  --queue N             packets queued per direction before drop-tail (default 1000)\n"
+    "  --seed N              random seed (default 1)\n";
+
+bool ImpairmentProfile::setOption(const std::string& flag, const std::string& value) {
+    std::map<std::string, double*> numbers = {
+        {"--loss", &loss}, {"--ge-enter", &geEnter}, {"--ge-exit", &geExit},
+        {"--ge-loss-good", &geLossGood}, {"--ge-loss-bad", &geLossBad},
+        {"--delay", &delayMs}, {"--jitter", &jitterMs}, {"--reorder", &reorder},
+        {"--reorder-delay", &reorderMs}, {"--duplicate", &duplicate}, {"--rate", &rateMbit},
+    };
+    auto number = numbers.find(flag);
+    if (number != numbers.end()) {
+        *number->second = std::stod(value);
+    } else if (flag == "--queue") {
+        queueLimit = std::stoul(value);
+    } else if (flag == "--seed") {
+        seed = std::stoull(value);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+std::string ImpairmentDirection::toString() const {
+    std::ostringstream out;
+    out << name << ": received " << received << ", forwarded " << forwarded << ", lost " << lost;
+    if (received > 0) {
+        out << " (" << 100.0 * lost / received << "%)";
+    }
+    out << ", duplicated " << duplicated << ", reordered " << reordered << ", queue drops " << queueDrops;
+    return out.str();
+}
+
+Impairment::Impairment(const ImpairmentProfile& profile) :
+    profile(profile),
+    random(profile.seed),
+    uniform(0.0, 1.0),
+    order(0) {}
+
+Impairment::~Impairment() {
+    while (!pending.empty()) {
+        delete pending.top();
+        pending.pop();
+    }
+}
+
+bool Impairment::chance(double probability) {
+    return probability > 0 && uniform(random) < probability;
+}
+
+bool Impairment::dropped(ImpairmentDirection& direction) {
+    if (profile.geEnter > 0) {
+        if (direction.bad ? chance(profile.geExit) : chance(profile.geEnter)) {
+            direction.bad = !direction.bad;
+        }
+        if (chance(direction.bad ? profile.geLossBad : profile.geLossGood)) {
+            return true;
+        }
+    }
+    return chance(profile.loss);
+}
+
+void Impairment::schedule(ImpairmentDirection& direction, int64_t nowNs, const Packet& packet) {
+    if (direction.queued >= profile.queueLimit) {
+        direction.queueDrops++;
+        return;
+    }
+
+    int64_t departure = nowNs;
+    if (profile.rateMbit > 0) {
+        // Serialization: a packet starts once the previous one is on the wire
+        int64_t start = std::max(nowNs, direction.linkFreeNs);
+        direction.linkFreeNs = start + int64_t(packet.data.size() * 8 * 1000 / profile.rateMbit);
+        departure = direction.linkFreeNs;
+    }
+
+    double delayMs = profile.delayMs;
+    if (profile.jitterMs > 0) {
+        delayMs += (uniform(random) * 2 - 1) * profile.jitterMs;
+    }
+    if (chance(profile.reorder)) {
+        delayMs += profile.reorderMs;
+        direction.reordered++;
+    }
+
+    Packet* scheduled = new Packet(packet);
+    scheduled->deliverAt = departure + int64_t(std::max(0.0, delayMs) * 1e6);
+    scheduled->order = order++;
+    scheduled->direction = &direction;
+    direction.queued++;
+    pending.push(scheduled);
+}
+
+void Impairment::submit(ImpairmentDirection& direction, int64_t nowNs, const Packet& packet) {
+    direction.received++;
+    if (dropped(direction)) {
+        direction.lost++;
+        return;
+    }
+    schedule(direction, nowNs, packet);
+    if (chance(profile.duplicate)) {
+        direction.duplicated++;
+        schedule(direction, nowNs, packet);
+    }
+}
+
+bool Impairment::take(int64_t nowNs, Packet& packet) {
+    if (pending.empty() || pending.top()->deliverAt > nowNs) {
+        return false;
+    }
+    Packet* due = pending.top();
+    pending.pop();
+    due->direction->queued--;
+    packet = std::move(*due);
+    delete due;
+    return true;
+}
+
+int64_t Impairment::nextDue() const {
+    return pending.empty() ? -1 : pending.top()->deliverAt;
+}
+
+ImpairmentProxy::ImpairmentProxy(int listenPort, const struct sockaddr_in& target, const ImpairmentProfile& profile) :
+    listenFd(-1),
+    timerFd(-1),
+    stopFd(-1),
+    target(target),
+    impairment(profile) {
+
+    forward.name = "forward";
+    reverse.name = "reverse";
+
+    listenFd = openSocket(listenPort);
+    timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    stopFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (listenFd < 0 || timerFd < 0 || stopFd < 0) {
+        std::string reason = strerror(errno);
+        for (int fd : {listenFd, timerFd, stopFd}) {
+            if (fd >= 0) {
+                ::close(fd);
+            }
+        }
+        throw std::runtime_error("Cannot open proxy port " + std::to_string(listenPort) + ": " + reason);
+    }
+}
+
+ImpairmentProxy::~ImpairmentProxy() {
+    for (auto& entry : sessions) {
+        ::close(entry.second.upstreamFd);
+    }
+    ::close(stopFd);
+    ::close(timerFd);
+    ::close(listenFd);
+}
+
+int64_t ImpairmentProxy::deliver() {
+    int64_t now = monotonicNs();
+    Impairment::Packet packet;
+    while (impairment.take(now, packet)) {
+        if (sendto(packet.fd, packet.data.data(), packet.data.size(), 0,
+                   (struct sockaddr*)&packet.dest, sizeof(packet.dest)) >= 0) {
+            packet.direction->forwarded++;
+        }
+    }
+    return impairment.nextDue();
+}
+
+void ImpairmentProxy::run() {
+    std::vector<uint8_t> buffer(65536);
+    std::vector<struct pollfd> fds;
+    Impairment::Packet packet = {};
+
+    while (true) {
+        int64_t next = deliver();
+        struct itimerspec timer = {};
+        if (next >= 0) {
+            timer.it_value.tv_sec = next / 1000000000;
+            timer.it_value.tv_nsec = next % 1000000000;
+        }
+        timerfd_settime(timerFd, TFD_TIMER_ABSTIME, &timer, nullptr);
+
+        fds.clear();
+        fds.push_back({stopFd, POLLIN, 0});
+        fds.push_back({timerFd, POLLIN, 0});
+        fds.push_back({listenFd, POLLIN, 0});
+        for (auto& entry : byUpstream) {
+            fds.push_back({entry.first, POLLIN, 0});
+        }
+        if (poll(fds.data(), fds.size(), -1) < 0) {
+            continue;  // EINTR, a signal handler calls stop()
+        }
+        if (fds[0].revents & POLLIN) {
+            return;
+        }
+
+        uint64_t expirations;
+        if (read(timerFd, &expirations, sizeof(expirations)) < 0) {
+            // Not expired yet
+        }
+
+        if (fds[2].revents & POLLIN) {
+            // Client to target, through the client's own upstream socket
+            struct sockaddr_in from;
+            socklen_t fromLength = sizeof(from);
+            ssize_t n;
+            while ((n = recvfrom(listenFd, buffer.data(), buffer.size(), 0, (struct sockaddr*)&from, &fromLength)) >= 0) {
+                fromLength = sizeof(from);
+                auto found = sessions.find(addressKey(from));
+                if (found == sessions.end()) {
+                    int upstreamFd = openSocket(0);
+                    if (upstreamFd < 0) {
+                        continue;
+                    }
+                    found = sessions.emplace(addressKey(from), Session{from, upstreamFd}).first;
+                    byUpstream[upstreamFd] = &found->second;
+                }
+                packet.fd = found->second.upstreamFd;
+                packet.source = from;
+                packet.dest = target;
+                packet.data.assign(buffer.data(), buffer.data() + n);
+                impairment.submit(forward, monotonicNs(), packet);
+            }
+        }
+
+        for (size_t i = 3; i < fds.size(); i++) {
+            if (!(fds[i].revents & POLLIN)) {
+                continue;
+            }
+            // Target to client, from the proxy's public port
+            Session* session = byUpstream[fds[i].fd];
+            ssize_t n;
+            while ((n = recv(fds[i].fd, buffer.data(), buffer.size(), 0)) >= 0) {
+                packet.fd = listenFd;
+                packet.source = target;
+                packet.dest = session->client;
+                packet.data.assign(buffer.data(), buffer.data() + n);
+                impairment.submit(reverse, monotonicNs(), packet);
+            }
+        }
+    }
+}
+
+void ImpairmentProxy::stop() {
+    uint64_t one = 1;
+    if (::write(stopFd, &one, sizeof(one)) < 0) {
+        // Already signalled
+    }
+}
+
+const ImpairmentDirection& ImpairmentProxy::getForward() const {
+    return forward;
+}
+
+const ImpairmentDirection& ImpairmentProxy::getReverse() const {
+    return reverse;
+}
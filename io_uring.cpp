@@ -0,0 +1,219 @@
+#include "header/io_uring.hpp"
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+#include <cstring>
+#include <ctime>
+#include <stdexcept>
+
+const uint64_t IoUring::OP_MASK;
+
+IoUring::IoUring(unsigned entries) :
+    ringFd(-1),
+    ringPtr(MAP_FAILED),
+    ringSize(0),
+    cqRingPtr(MAP_FAILED),
+    cqRingSize(0),
+    sqes(nullptr),
+    sqesSize(0),
+    pendingSubmissions(0),
+    nextBufferGroup(0) {
+
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CLAMP;
+
+    ringFd = syscall(__NR_io_uring_setup, entries, &params);
+    if (ringFd < 0) {
+        throw std::runtime_error(std::string("io_uring_setup failed: ") + strerror(errno));
+    }
+
+    if (!(params.features & IORING_FEAT_SINGLE_MMAP) || !(params.features & IORING_FEAT_EXT_ARG)) {
+        ::close(ringFd);
+        throw std::runtime_error("io_uring kernel support too old");
+    }
+
+    // With SINGLE_MMAP the SQ and CQ rings share one mapping
+    size_t sqSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    size_t cqSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    ringSize = sqSize > cqSize ? sqSize : cqSize;
+    ringPtr = mmap(nullptr, ringSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                   ringFd, IORING_OFF_SQ_RING);
+    if (ringPtr == MAP_FAILED) {
+        ::close(ringFd);
+        throw std::runtime_error("io_uring ring mmap failed");
+    }
+
+    sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    void* sqePtr = mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        ringFd, IORING_OFF_SQES);
+    if (sqePtr == MAP_FAILED) {
+        munmap(ringPtr, ringSize);
+        ::close(ringFd);
+        throw std::runtime_error("io_uring sqe mmap failed");
+    }
+    sqes = static_cast<struct io_uring_sqe*>(sqePtr);
+
+    uint8_t* base = static_cast<uint8_t*>(ringPtr);
+    sqHead = reinterpret_cast<unsigned*>(base + params.sq_off.head);
+    sqTail = reinterpret_cast<unsigned*>(base + params.sq_off.tail);
+    sqMask = *reinterpret_cast<unsigned*>(base + params.sq_off.ring_mask);
+    sqEntries = *reinterpret_cast<unsigned*>(base + params.sq_off.ring_entries);
+    sqArray = reinterpret_cast<unsigned*>(base + params.sq_off.array);
+
+    cqHead = reinterpret_cast<unsigned*>(base + params.cq_off.head);
+    cqTail = reinterpret_cast<unsigned*>(base + params.cq_off.tail);
+    cqMask = *reinterpret_cast<unsigned*>(base + params.cq_off.ring_mask);
+    cqes = reinterpret_cast<struct io_uring_cqe*>(base + params.cq_off.cqes);
+
+    // Identity mapping, SQE index i always sits in array slot i
+    for (unsigned i = 0; i < sqEntries; i++) {
+        sqArray[i] = i;
+    }
+}
+
+IoUring::~IoUring() {
+    munmap(sqes, sqesSize);
+    munmap(ringPtr, ringSize);
+    ::close(ringFd);
+}
+
+IoUring& IoUring::threadRing() {
+    thread_local IoUring ring(256);
+    return ring;
+}
+
+int IoUring::fd() const {
+    return ringFd;
+}
+
+int IoUring::enter(unsigned toSubmit, unsigned minComplete, int timeoutMs) {
+    unsigned flags = 0;
+    struct __kernel_timespec ts;
+    struct io_uring_getevents_arg arg;
+    memset(&arg, 0, sizeof(arg));
+
+    if (minComplete > 0) {
+        flags |= IORING_ENTER_GETEVENTS;
+        if (timeoutMs >= 0) {
+            ts.tv_sec = timeoutMs / 1000;
+            ts.tv_nsec = (timeoutMs % 1000) * 1000000L;
+            arg.ts = reinterpret_cast<uint64_t>(&ts);
+        }
+        flags |= IORING_ENTER_EXT_ARG;
+    }
+
+    int ret = syscall(__NR_io_uring_enter, ringFd, toSubmit, minComplete, flags,
+                      (flags & IORING_ENTER_EXT_ARG) ? &arg : nullptr,
+                      (flags & IORING_ENTER_EXT_ARG) ? sizeof(arg) : 0);
+    return ret < 0 ? -errno : ret;
+}
+
+struct io_uring_sqe* IoUring::getSqe(IoUringHandler* handler, uint8_t op) {
+    unsigned head = __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+    unsigned tail = *sqTail;
+    if (tail - head >= sqEntries) {
+        submit();
+        head = __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+        if (tail - head >= sqEntries) {
+            return nullptr;
+        }
+    }
+
+    struct io_uring_sqe* sqe = &sqes[tail & sqMask];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->user_data = reinterpret_cast<uint64_t>(handler) | op;
+
+    // Publish the entry, the kernel only consumes it on the next io_uring_enter
+    __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+    pendingSubmissions++;
+    return sqe;
+}
+
+int IoUring::submit() {
+    if (pendingSubmissions == 0) {
+        return 0;
+    }
+
+    int ret = enter(pendingSubmissions, 0, -1);
+    if (ret > 0) {
+        pendingSubmissions -= ret;
+    }
+    return ret;
+}
+
+unsigned IoUring::reapCompletions() {
+    unsigned head = *cqHead;
+    unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+    unsigned count = 0;
+
+    while (head != tail) {
+        struct io_uring_cqe cqe = cqes[head & cqMask];
+        head++;
+        count++;
+
+        // Free the slot before dispatching, handlers may submit again
+        __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+
+        IoUringHandler* handler = reinterpret_cast<IoUringHandler*>(cqe.user_data & ~OP_MASK);
+        if (handler) {
+            handler->handleCompletion(cqe.user_data & OP_MASK, cqe.res, cqe.flags);
+        }
+        tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+    }
+
+    return count;
+}
+
+int IoUring::run(int timeoutMs) {
+    unsigned reaped = reapCompletions();
+    if (reaped > 0) {
+        int ret = submit();
+        return ret < 0 ? ret : reaped;
+    }
+
+    int ret = enter(pendingSubmissions, timeoutMs == 0 ? 0 : 1, timeoutMs);
+    if (ret >= 0) {
+        pendingSubmissions -= ret;
+    } else if (ret != -ETIME && ret != -EINTR && ret != -EAGAIN && ret != -EBUSY) {
+        return ret;
+    }
+
+    return reapCompletions();
+}
+
+int IoUring::registerBufferRing(struct io_uring_buf_ring* ring, unsigned entries) {
+    uint16_t groupId;
+    if (!freeBufferGroups.empty()) {
+        groupId = freeBufferGroups.back();
+        freeBufferGroups.pop_back();
+    } else if (nextBufferGroup <= UINT16_MAX) {
+        groupId = nextBufferGroup++;
+    } else {
+        return -1;
+    }
+
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = reinterpret_cast<uint64_t>(ring);
+    reg.ring_entries = entries;
+    reg.bgid = groupId;
+
+    if (syscall(__NR_io_uring_register, ringFd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        // The id is still free for the next transport
+        freeBufferGroups.push_back(groupId);
+        return -1;
+    }
+    return groupId;
+}
+
+void IoUring::unregisterBufferRing(uint16_t groupId) {
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.bgid = groupId;
+    if (syscall(__NR_io_uring_register, ringFd, IORING_UNREGISTER_PBUF_RING, &reg, 1) == 0) {
+        freeBufferGroups.push_back(groupId);
+    }
+}
@@ -0,0 +1,354 @@
+#include "header/io_uring_transport.hpp"
+#include "header/event_loop.hpp"
+#include "header/logger.hpp"
+#include <sys/mman.h>
+#include <sys/eventfd.h>
+#include <netinet/in.h>
+#include <unistd.h>
+#include <errno.h>
+#include <cstring>
+#include <chrono>
+#include <stdexcept>
+
+const unsigned IoUringTransport::BUFFER_COUNT;
+const unsigned IoUringTransport::BUFFER_SIZE;
+const unsigned IoUringTransport::MAX_SEND_BATCHES;
+
+// Completions are reaped by the thread's event loop once, for all transports on the ring
+static void watchRing(IoUring& ring) {
+    thread_local bool watched = false;
+    if (!watched) {
+        EventLoop::threadLoop().watch(ring.fd(), [&ring]() { ring.run(0); });
+        watched = true;
+    }
+}
+
+IoUringTransport::IoUringTransport() :
+    ring(IoUring::threadRing()),
+    bufferRing(nullptr),
+    bufferRingSize(BUFFER_COUNT * sizeof(struct io_uring_buf)),
+    buffers(nullptr),
+    bufferGroup(-1),
+    bufferTail(0),
+    recvArmed(false),
+    cancelInFlight(false),
+    readyFd(-1),
+    currentBuffer(-1),
+    sendFailed(false) {
+
+    socket = ::socket(AF_INET, SOCK_DGRAM, 0);
+    if (socket < 0) {
+        throw std::runtime_error("Socket creation failed");
+    }
+
+    // The buffer ring must be page aligned
+    void* ringMemory = mmap(nullptr, bufferRingSize, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ringMemory == MAP_FAILED) {
+        ::close(socket);
+        throw std::runtime_error("Buffer ring allocation failed");
+    }
+    bufferRing = static_cast<struct io_uring_buf_ring*>(ringMemory);
+    buffers = new uint8_t[BUFFER_COUNT * BUFFER_SIZE];
+
+    bufferGroup = ring.registerBufferRing(bufferRing, BUFFER_COUNT);
+    if (bufferGroup < 0) {
+        munmap(bufferRing, bufferRingSize);
+        delete[] buffers;
+        ::close(socket);
+        throw std::runtime_error("io_uring provided buffer rings not supported");
+    }
+
+    for (unsigned i = 0; i < BUFFER_COUNT; i++) {
+        recycleBuffer(i);
+    }
+
+    // Multishot recvmsg lays out io_uring_recvmsg_out, the source address and the payload
+    memset(&recvHeader, 0, sizeof(recvHeader));
+    recvHeader.msg_namelen = sizeof(struct sockaddr_in);
+
+    readyFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (readyFd < 0) {
+        ring.unregisterBufferRing(bufferGroup);
+        munmap(bufferRing, bufferRingSize);
+        delete[] buffers;
+        ::close(socket);
+        throw std::runtime_error("eventfd creation failed");
+    }
+    watchRing(ring);
+}
+
+IoUringTransport::~IoUringTransport() {
+    close();
+}
+
+void IoUringTransport::armReceive() {
+    struct io_uring_sqe* sqe = ring.getSqe(this, OP_RECV);
+    if (!sqe) {
+        return;
+    }
+
+    sqe->opcode = IORING_OP_RECVMSG;
+    sqe->fd = socket;
+    sqe->addr = reinterpret_cast<uint64_t>(&recvHeader);
+    sqe->len = 1;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = bufferGroup;
+
+    recvArmed = true;
+    ring.submit();
+}
+
+void IoUringTransport::clearReady() {
+    uint64_t count;
+    while (read(readyFd, &count, sizeof(count)) == sizeof(count)) {}
+}
+
+void IoUringTransport::recycleBuffer(uint16_t bufferId) {
+    // Index the entries from the ring start, the uapi flexible array member
+    // picks up a padding prefix when compiled as C++
+    struct io_uring_buf* entries = reinterpret_cast<struct io_uring_buf*>(bufferRing);
+    struct io_uring_buf* buf = &entries[bufferTail & (BUFFER_COUNT - 1)];
+    buf->addr = reinterpret_cast<uint64_t>(buffers + bufferId * BUFFER_SIZE);
+    buf->len = BUFFER_SIZE;
+    buf->bid = bufferId;
+    bufferTail++;
+
+    // Make the entry visible to the kernel
+    __atomic_store_n(&bufferRing->tail, bufferTail, __ATOMIC_RELEASE);
+}
+
+void IoUringTransport::SendBatch::handleCompletion(uint8_t, int32_t result, uint32_t) {
+    if (result < 0) {
+        owner->sendFailed = true;
+    }
+    if (--inFlight == 0) {
+        owner->freeBatches.push_back(this);
+    }
+}
+
+void IoUringTransport::handleCompletion(uint8_t op, int32_t result, uint32_t flags) {
+    if (op == OP_CANCEL) {
+        cancelInFlight = false;
+        return;
+    }
+
+    // Multishot stops on errors (ENOBUFS when every buffer is in use), rearmed on next receive
+    if (!(flags & IORING_CQE_F_MORE)) {
+        recvArmed = false;
+    }
+
+    if (result < 0 || !(flags & IORING_CQE_F_BUFFER)) {
+        return;
+    }
+
+    uint16_t bufferId = flags >> IORING_CQE_BUFFER_SHIFT;
+    uint8_t* buffer = buffers + bufferId * BUFFER_SIZE;
+    struct io_uring_recvmsg_out* out = reinterpret_cast<struct io_uring_recvmsg_out*>(buffer);
+    uint32_t prefix = sizeof(*out) + recvHeader.msg_namelen + recvHeader.msg_controllen;
+
+    if (static_cast<uint32_t>(result) < prefix || (out->flags & MSG_TRUNC) ||
+        out->namelen < sizeof(struct sockaddr_in)) {
+        recycleBuffer(bufferId);
+        return;
+    }
+
+    Datagram datagram;
+    datagram.bufferId = bufferId;
+    datagram.data = buffer + prefix;
+    datagram.length = out->payloadlen;
+    memcpy(&datagram.addr, buffer + sizeof(*out), sizeof(datagram.addr));
+    ready.push_back(datagram);
+
+    if (ready.size() == 1) {
+        uint64_t one = 1;
+        if (write(readyFd, &one, sizeof(one)) < 0) {
+            // Counter saturated, the descriptor is readable anyway
+        }
+    }
+}
+
+bool IoUringTransport::bind(const struct sockaddr_in& addr) {
+    return ::bind(socket, (const struct sockaddr*)&addr, sizeof(addr)) == 0;
+}
+
+IoUringTransport::SendBatch* IoUringTransport::takeBatch() {
+    // Completions the event loop has not dispatched yet free batches too
+    ring.run(0);
+
+    while (freeBatches.empty()) {
+        if (sendBatches.size() < MAX_SEND_BATCHES) {
+            sendBatches.emplace_back(new SendBatch());
+            sendBatches.back()->owner = this;
+            sendBatches.back()->inFlight = 0;
+            return sendBatches.back().get();
+        }
+        // Every batch is in flight: the kernel is behind, wait for it
+        if (ring.run(-1) < 0) {
+            return nullptr;
+        }
+    }
+
+    SendBatch* batch = freeBatches.back();
+    freeBatches.pop_back();
+    return batch;
+}
+
+bool IoUringTransport::isBusy() const {
+    return recvArmed || cancelInFlight || freeBatches.size() < sendBatches.size();
+}
+
+bool IoUringTransport::sendSegment(const Segment& segment, const struct sockaddr_in& addr) {
+    return sendSegments(&segment, 1, addr);
+}
+
+bool IoUringTransport::sendSegments(const Segment* segments, int count, const struct sockaddr_in& addr) {
+    if (count <= 0) {
+        return true;
+    }
+
+    SendBatch* batch = takeBatch();
+    if (!batch) {
+        return false;
+    }
+    if (batch->buffer.size() < count * MAX_DATAGRAM_SIZE) {
+        batch->buffer.resize(count * MAX_DATAGRAM_SIZE);
+    }
+    batch->iovs.resize(count);
+    batch->headers.resize(count);
+    batch->addr = addr;
+
+    bool failed = sendFailed;
+    sendFailed = false;
+
+    uint32_t offset = 0;
+    for (int i = 0; i < count; i++) {
+        uint32_t length = encodeSegment(segments[i], batch->buffer.data() + offset);
+        batch->iovs[i].iov_base = batch->buffer.data() + offset;
+        batch->iovs[i].iov_len = length;
+        offset += length;
+
+        memset(&batch->headers[i], 0, sizeof(batch->headers[i]));
+        batch->headers[i].msg_name = &batch->addr;
+        batch->headers[i].msg_namelen = sizeof(batch->addr);
+        batch->headers[i].msg_iov = &batch->iovs[i];
+        batch->headers[i].msg_iovlen = 1;
+
+        struct io_uring_sqe* sqe = ring.getSqe(batch, OP_SEND);
+        if (!sqe) {
+            failed = true;
+            break;
+        }
+        sqe->opcode = IORING_OP_SENDMSG;
+        sqe->fd = socket;
+        sqe->addr = reinterpret_cast<uint64_t>(&batch->headers[i]);
+        sqe->len = 1;
+        batch->inFlight++;
+    }
+    if (batch->inFlight == 0) {
+        freeBatches.push_back(batch);
+    }
+
+    // One io_uring_enter for the whole window, its completions are reaped later
+    if (ring.submit() < 0) {
+        failed = true;
+    }
+    return !failed;
+}
+
+int32_t IoUringTransport::receiveSegment(Segment& segment, struct sockaddr_in& addr, int timeoutMs) {
+    // The previous payload is no longer referenced, give its buffer back to the kernel
+    if (currentBuffer >= 0) {
+        recycleBuffer(currentBuffer);
+        currentBuffer = -1;
+    }
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+    while (ready.empty()) {
+        if (!recvArmed) {
+            armReceive();
+        }
+
+        int waitMs = -1;
+        if (timeoutMs >= 0) {
+            auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+                deadline - std::chrono::steady_clock::now()).count();
+            waitMs = remaining > 0 ? remaining : 0;
+        }
+
+        if (ring.run(waitMs) < 0) {
+            return -1;
+        }
+
+        if (ready.empty() && timeoutMs >= 0 && std::chrono::steady_clock::now() >= deadline) {
+            return 0;
+        }
+    }
+
+    Datagram datagram = ready.front();
+    ready.pop_front();
+    if (ready.empty()) {
+        clearReady();
+    }
+    currentBuffer = datagram.bufferId;
+    addr = datagram.addr;
+
+    if (!decodeSegment(datagram.data, datagram.length, segment)) {
+        return -1;
+    }
+    return datagram.length;
+}
+
+void IoUringTransport::close() {
+    if (socket < 0) {
+        return;
+    }
+
+    // Stop the multishot receive. No completion may reach this object or its
+    // buffers once they are gone: wait for the cancel and for the receive's
+    // final completion (no IORING_CQE_F_MORE), and for every send in flight.
+    bool failed = false;
+    while (isBusy() && !failed) {
+        if (recvArmed && !cancelInFlight) {
+            struct io_uring_sqe* sqe = ring.getSqe(this, OP_CANCEL);
+            if (sqe) {
+                sqe->opcode = IORING_OP_ASYNC_CANCEL;
+                sqe->addr = reinterpret_cast<uint64_t>(static_cast<IoUringHandler*>(this)) | OP_RECV;
+                cancelInFlight = true;
+            }
+        }
+        failed = ring.run(-1) < 0;
+    }
+
+    ::close(socket);
+    socket = -1;
+    ready.clear();
+    ::close(readyFd);
+    readyFd = -1;
+
+    if (failed) {
+        // The ring is unusable, its requests may still hold the buffers: keep them
+        LOG_ERROR(Color::RED << "[!]" << Color::RESET << " io_uring failed while closing, leaking its buffers");
+        for (std::unique_ptr<SendBatch>& batch : sendBatches) {
+            batch.release();
+        }
+        buffers = nullptr;
+        return;
+    }
+
+    ring.unregisterBufferRing(bufferGroup);
+    munmap(bufferRing, bufferRingSize);
+    delete[] buffers;
+    buffers = nullptr;
+    sendBatches.clear();
+    freeBatches.clear();
+}
+
+int IoUringTransport::fd() const {
+    return socket;
+}
+
+int IoUringTransport::pollFd() const {
+    return readyFd;
+}
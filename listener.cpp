@@ -0,0 +1,177 @@
+#include "header/listener.hpp"
+#include "header/logger.hpp"
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <stdexcept>
+
+const size_t TCPListener::MAX_PENDING;
+
+TCPListener::TCPListener(string ip, int32_t port, TransportType transportType, bool reusePort) :
+    ip(ip),
+    port(port),
+    transport(createTransport(transportType)),
+    loop(EventLoop::threadLoop()),
+    watchId(-1),
+    accepting(true) {
+
+    // Parsed like a TCPSocket's, ConnectionTransport::bind compares against it
+    localAddr = TCPSocket::createAddr(ip, port);
+
+    int enable = 1;
+    if (reusePort && setsockopt(transport->fd(), SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(enable)) < 0) {
+        delete transport;
+        throw runtime_error("SO_REUSEPORT not supported");
+    }
+
+    if (!transport->bind(localAddr)) {
+        delete transport;
+        throw runtime_error("Bind failed");
+    }
+
+    // Demultiplexing runs whenever the loop does, not only while accepting
+    watchId = loop.watch(transport->pollFd(), [this]() { onReadable(); });
+    onReadable();
+}
+
+TCPListener::~TCPListener() {
+    close();
+    delete transport;
+}
+
+void TCPListener::onReadable() {
+    while (watchId >= 0) {
+        Segment segment;
+        struct sockaddr_in addr;
+        int32_t bytes = transport->receiveSegment(segment, addr, 0);
+        if (bytes <= 0) {
+            break;
+        }
+        handleSegment(segment, addr, bytes);
+    }
+}
+
+void TCPListener::handleSegment(const Segment& segment, const struct sockaddr_in& addr, int32_t length) {
+    ConnectionKey key = makeConnectionKey(addr, localAddr);
+    ConnectionTransport* connection = connections.find(key);
+
+    // Data segments carry no meaningful flags, only an empty segment (or one
+    // offering shared memory) can be a SYN
+    bool isSyn = (segment.payloadSize == 0 || isSharedMemoryOffer(segment)) && segment.flags.syn && !segment.flags.ack;
+
+    if (connection && isSyn && connection->getConnectionId() != segment.seqNum) {
+        // Same 4-tuple, new connection ID: the peer restarted, drop the old session
+        connections.erase(key);
+        connection->orphan();
+        connection = nullptr;
+    }
+
+    if (!connection) {
+        if (!isSyn || !accepting) {
+            return;
+        }
+        if (pending.size() >= MAX_PENDING) {
+            LOG_ERROR(Color::RED << "[!]" << Color::RESET << " [Listener] Accept queue full, dropping SYN from "
+                 << inet_ntoa(addr.sin_addr) << ":" << ntohs(addr.sin_port));
+            return;
+        }
+
+        connection = new ConnectionTransport(this, transport, key, segment.seqNum);
+        connections.insert(key, connection);
+        connection->deliver(segment, addr, length);
+
+        // The socket picks the queued SYN up once its handshake starts
+        TCPSocket* socket = new TCPSocket(ip, port, connection);
+        socket->listen();
+
+        if (!acceptWaiters.empty()) {
+            std::function<void(TCPSocket*)> onAccepted = std::move(acceptWaiters.front());
+            acceptWaiters.pop_front();
+            onAccepted(socket);
+        } else {
+            pending.push_back(socket);
+        }
+        return;
+    }
+
+    connection->deliver(segment, addr, length);
+}
+
+TCPSocket* TCPListener::accept() {
+    TCPSocket* accepted = nullptr;
+    bool done = false;
+    startAccept([&](TCPSocket* socket) {
+        accepted = socket;
+        done = true;
+    });
+    loop.runUntil([&]() { return done; });
+    return accepted;
+}
+
+void TCPListener::startAccept(std::function<void(TCPSocket*)> onAccepted) {
+    if (!accepting) {
+        onAccepted(nullptr);
+        return;
+    }
+
+    if (!pending.empty()) {
+        TCPSocket* socket = pending.front();
+        pending.pop_front();
+        onAccepted(socket);
+        return;
+    }
+    acceptWaiters.push_back(std::move(onAccepted));
+}
+
+OperationAwaiter<TCPSocket*> TCPListener::async_accept() {
+    return OperationAwaiter<TCPSocket*>(loop, [this](std::function<void(TCPSocket*)> onDone) {
+        startAccept(onDone);
+    });
+}
+
+size_t TCPListener::connectionCount() const {
+    return connections.size();
+}
+
+Transport* TCPListener::getTransport() const {
+    return transport;
+}
+
+void TCPListener::release(ConnectionTransport* connection) {
+    if (connections.find(connection->getKey()) == connection) {
+        connections.erase(connection->getKey());
+    }
+}
+
+void TCPListener::stopAccepting() {
+    if (!accepting) {
+        return;
+    }
+    accepting = false;
+
+    // Sockets never handed out are still ours
+    for (TCPSocket* socket : pending) {
+        delete socket;
+    }
+    pending.clear();
+
+    while (!acceptWaiters.empty()) {
+        std::function<void(TCPSocket*)> onAccepted = std::move(acceptWaiters.front());
+        acceptWaiters.pop_front();
+        onAccepted(nullptr);
+    }
+}
+
+void TCPListener::close() {
+    if (watchId < 0) {
+        return;
+    }
+    stopAccepting();
+    loop.unwatch(watchId);
+    watchId = -1;
+
+    // Accepted sockets outliving the listener just stop receiving
+    connections.forEach([](ConnectionTransport* connection) { connection->orphan(); });
+    connections = ConnectionTable();
+
+    transport->close();
+}
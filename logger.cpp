@@ -0,0 +1,189 @@
+#include "header/logger.hpp"
+#include "header/byte_ring.hpp"
+#include <unistd.h>
+#include <cstring>
+#include <algorithm>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <memory>
+#include <chrono>
+
+namespace {
+
+// Ring of every thread that logged, records are [level][length, 2 bytes][text]
+const size_t RING_SIZE = 1 << 20;
+const size_t RECORD_HEADER = 3;
+
+struct LoggerState
+{
+    std::mutex ringsMutex;  // Taken when a thread logs for the first time, never per line
+    std::vector<std::unique_ptr<ByteRing>> rings;
+
+    std::thread writer;
+    std::atomic<bool> stopping{false};
+    std::atomic<bool> busy{false};  // Writer holds lines taken from the rings
+
+    std::string out;
+    std::string err;
+
+    LoggerState() {
+        writer = std::thread([this]() { run(); });
+    }
+
+    ~LoggerState() {
+        stopping = true;
+        writer.join();
+    }
+
+    static void writeAll(int fd, std::string& data) {
+        size_t offset = 0;
+        while (offset < data.size()) {
+            ssize_t n = ::write(fd, data.data() + offset, data.size() - offset);
+            if (n <= 0) {
+                break;
+            }
+            offset += n;
+        }
+        data.clear();
+    }
+
+    size_t drain() {
+        size_t lines = 0;
+        {
+            std::lock_guard<std::mutex> lock(ringsMutex);
+            for (auto& ring : rings) {
+                uint8_t header[RECORD_HEADER];
+                // A record is published by a single ring write, its body is there once its header is
+                while (ring->read(header, RECORD_HEADER) == RECORD_HEADER) {
+                    size_t length = header[1] | (header[2] << 8);
+                    std::string& target = header[0] >= LOG_LEVEL_WARN ? err : out;
+                    size_t offset = target.size();
+                    target.resize(offset + length);
+                    ring->read(reinterpret_cast<uint8_t*>(&target[offset]), length);
+                    lines++;
+                }
+            }
+        }
+        writeAll(STDOUT_FILENO, out);
+        writeAll(STDERR_FILENO, err);
+        return lines;
+    }
+
+    void run() {
+        while (true) {
+            bool stop = stopping;
+            busy = true;
+            size_t lines = drain();
+            busy = false;
+            if (lines == 0) {
+                if (stop) {
+                    break;
+                }
+                // Producers never signal, an idle writer just polls
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }
+    }
+
+    bool isIdle() {
+        std::lock_guard<std::mutex> lock(ringsMutex);
+        for (auto& ring : rings) {
+            if (ring->readable() > 0) {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+LoggerState& state() {
+    static LoggerState instance;
+    return instance;
+}
+
+ByteRing& threadRing() {
+    thread_local ByteRing* ring = nullptr;
+    if (!ring) {
+        LoggerState& logger = state();
+        std::lock_guard<std::mutex> lock(logger.ringsMutex);
+        logger.rings.emplace_back(new ByteRing(RING_SIZE));
+        ring = logger.rings.back().get();
+    }
+    return *ring;
+}
+
+}
+
+void Logger::setLevel(LogLevel level) {
+    runtimeLevel.store(level, std::memory_order_relaxed);
+}
+
+LogLevel Logger::getLevel() {
+    return static_cast<LogLevel>(runtimeLevel.load(std::memory_order_relaxed));
+}
+
+bool Logger::parseLevel(const std::string& name, LogLevel& level) {
+    static const char* NAMES[] = {"packet", "debug", "info", "warn", "error", "off"};
+    for (int i = LOG_LEVEL_PACKET; i <= LOG_LEVEL_OFF; i++) {
+        if (name == NAMES[i]) {
+            level = static_cast<LogLevel>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+void Logger::write(LogLevel level, const char* data, size_t length) {
+    uint8_t record[RECORD_HEADER + LOG_MAX_LINE + 1];
+    length = std::min<size_t>(length, sizeof(record) - RECORD_HEADER - 1);
+    record[0] = level;
+    record[1] = (length + 1) & 0xff;
+    record[2] = (length + 1) >> 8;
+    std::memcpy(record + RECORD_HEADER, data, length);
+    record[RECORD_HEADER + length] = '\n';
+    size_t size = RECORD_HEADER + length + 1;
+
+    ByteRing& ring = threadRing();
+    // Full ring: the output is behind, wait for the writer rather than drop lines
+    while (ring.writable() < size) {
+        std::this_thread::yield();
+    }
+    ring.write(record, size);
+}
+
+void Logger::flush() {
+    LoggerState& logger = state();
+    while (!logger.isIdle() || logger.busy) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+void LogLine::append(const char* data, size_t size) {
+    size = std::min(size, LOG_MAX_LINE - length);
+    std::memcpy(buffer + length, data, size);
+    length += size;
+}
+
+LogLine& LogLine::operator<<(const char* text) {
+    append(text, std::strlen(text));
+    return *this;
+}
+
+LogLine& LogLine::operator<<(const std::string& text) {
+    append(text.data(), text.size());
+    return *this;
+}
+
+LogLine& LogLine::operator<<(char c) {
+    append(&c, 1);
+    return *this;
+}
+
+LogLine& LogLine::operator<<(double value) {
+    char digits[32];
+    int size = std::snprintf(digits, sizeof(digits), "%g", value);
+    append(digits, std::max(0, size));
+    return *this;
+}
@@ -3,28 +3,138 @@
 #include <string>
 #include <cstring>
 #include <filesystem>
+#include <memory>
+#include <thread>
+#include <set>
+#include <map>
+#include <atomic>
 #include <sys/types.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include "header/socket.hpp"
+#include "header/listener.hpp"
+#include "header/sharded_listener.hpp"
 #include "header/color.hpp" 
+#include "header/logger.hpp"
+#include "header/xdp_transport.hpp"
+#include "header/session.hpp"
+#include "header/stripe.hpp"
 #include "header/node.hpp"    
 
-void runSender(const std::string& host, int port);
-void runReceiver(const std::string& host, int port);
+// Optional transport tuning, set from command line flags
+struct NodeOptions {
+    bool gso = false;
+    bool gro = false;
+    bool zeroCopy = false;
+    bool serve = false;
+    int shards = 1;
+    bool pinCpus = false;
+    bool selectiveRepeat = false;
+    int window = 0;  // 0: SegmentHandler's default
+    bool sharedMemory = false;
+    bool session = false;
+    int streams = 1;  // Connections a file is striped over
+    bool stats = false;
+    string tracePath;
+    PacketTrace* trace = nullptr;
+    TransportType transport = UDP_SOCKET_TRANSPORT;
+};
+
+void runSender(const std::string& host, int port, const NodeOptions& options);
+void runReceiver(const std::string& host, int port, const NodeOptions& options);
+void serveReceivers(int port, const NodeOptions& options, const string& payload);
+void sendSession(TCPSocket& socket, struct sockaddr_in& destAddr, const NodeOptions& options,
+                 const std::function<void(SessionWriter&)>& produce);
+void receiveSession(TCPSocket& socket, const NodeOptions& options);
+void sendStriped(TCPSocket& socket, int port, const string& receiverIP, int receiverPort,
+                 const string& filePath, const NodeOptions& options);
+void receiveStriped(TCPSocket& socket, int port, const string& senderIP, int senderPort, const NodeOptions& options);
+void dumpStats(const TCPSocket& socket, const NodeOptions& options);
 
 int main(int argc, char* argv[]) {
     const string host = "0.0.0.0";
     int port;
+    NodeOptions options;
 
-    if (argc != 2) {
-        cerr << "Usage: node [port]" << endl;
+    if (argc < 2) {
+        cerr << "Usage: node [port] [--gso] [--gro] [--zerocopy] [--io-uring] [--xdp IFACE] [--serve] [--shards N] [--pin] [--selective-repeat] [--window N] [--shm] [--session] [--streams N] [--stats] [--log-level LEVEL] [--trace FILE]" << endl;
         return 1;
     }
 
+    for (int i = 2; i < argc; i++) {
+        string flag = argv[i];
+        if (flag == "--gso") {
+            options.gso = true;
+        } else if (flag == "--gro") {
+            options.gro = true;
+        } else if (flag == "--zerocopy") {
+            options.zeroCopy = true;
+        } else if (flag == "--io-uring") {
+            options.transport = IO_URING_TRANSPORT;
+        } else if (flag == "--xdp" && i + 1 < argc) {
+            options.transport = XDP_TRANSPORT;
+            XdpTransport::setDefaultInterface(argv[++i]);
+        } else if (flag == "--serve") {
+            options.serve = true;
+        } else if (flag == "--shards" && i + 1 < argc) {
+            options.serve = true;
+            options.shards = std::stoi(argv[++i]);
+        } else if (flag == "--pin") {
+            options.pinCpus = true;
+        } else if (flag == "--selective-repeat") {
+            options.selectiveRepeat = true;
+        } else if (flag == "--window" && i + 1 < argc) {
+            options.window = std::stoi(argv[++i]);
+            if (options.window < 1 || options.window > 255) {
+                cerr << "Window must be 1 to 255 segments" << endl;
+                return 1;
+            }
+        } else if (flag == "--shm") {
+            options.sharedMemory = true;
+        } else if (flag == "--session") {
+            options.session = true;
+        } else if (flag == "--streams" && i + 1 < argc) {
+            options.streams = std::stoi(argv[++i]);
+            if (options.streams < 1 || options.streams > MAX_STRIPES) {
+                cerr << "Streams must be 1 to " << MAX_STRIPES << endl;
+                return 1;
+            }
+        } else if (flag == "--stats") {
+            options.stats = true;
+        } else if (flag == "--log-level" && i + 1 < argc) {
+            LogLevel level;
+            if (!Logger::parseLevel(argv[++i], level)) {
+                cerr << "Unknown log level: " << argv[i] << " (packet, debug, info, warn, error or off)" << endl;
+                return 1;
+            }
+            Logger::setLevel(level);
+        } else if (flag == "--trace" && i + 1 < argc) {
+            options.tracePath = argv[++i];
+        } else {
+            cerr << "Unknown option: " << flag << endl;
+            cerr << "Usage: node [port] [--gso] [--gro] [--zerocopy] [--io-uring] [--xdp IFACE] [--serve] [--shards N] [--pin] [--selective-repeat] [--window N] [--shm] [--session] [--streams N] [--stats] [--log-level LEVEL] [--trace FILE]" << endl;
+            return 1;
+        }
+    }
+
+    if (options.streams > 1 && (options.session || options.serve)) {
+        cerr << Color::RED << "[!]" << Color::RESET << " --streams is not supported with --session or --serve, ignoring" << endl;
+        options.streams = 1;
+    }
+
     try {
         port = std::stoi(argv[1]);
 
+        // Closed (and truncated to its records) when main returns
+        std::unique_ptr<PacketTrace> trace;
+        if (!options.tracePath.empty()) {
+            trace.reset(new PacketTrace(options.tracePath));
+            options.trace = trace.get();
+        }
+
         cout << Color::YELLOW << "[i]" << Color::RESET << " Node started at " << host << ":" << port << endl;
         cout << Color::CYAN << "[?]" << Color::RESET << " Please choose the operating mode" << endl;
         cout << Color::CYAN << "[?]" << Color::RESET << " 1. Sender" << endl;
@@ -36,10 +146,10 @@ int main(int argc, char* argv[]) {
 
         if (mode == 1) {
             cout << Color::GREEN << "[+]" << Color::RESET << " Node is now a sender" << endl;
-            runSender(host, port);
+            runSender(host, port, options);
         } else if (mode == 2) {
             cout << Color::GREEN << "[+]" << Color::RESET << " Node is now a receiver" << endl;
-            runReceiver(host, port);
+            runReceiver(host, port, options);
         } else {
             cerr << Color::RED << "[!]" << Color::RESET << " Invalid mode selected. Exiting." << endl;
         }
@@ -52,8 +162,16 @@ int main(int argc, char* argv[]) {
     return 0;
 }
 
-void runSender(const std::string& host, int port) {
-    TCPSocket socket("0.0.0.0", port);
+void runSender(const std::string& host, int port, const NodeOptions& options) {
+    TCPSocket socket(host, port, options.transport);
+    socket.setGso(options.gso);
+    socket.setZeroCopy(options.zeroCopy);
+    socket.setSelectiveRepeat(options.selectiveRepeat);
+    socket.setSharedMemory(options.sharedMemory);
+    socket.setTrace(options.trace);
+    if (options.window > 0) {
+        socket.setWindowSize(options.window);
+    }
 
     // Get receiver's IP and port
     string receiverIP;
@@ -82,11 +200,27 @@ void runSender(const std::string& host, int port) {
         std::getline(std::cin, userInput);
         cout << Color::GREEN << "[+]" << Color::RESET << " User input has been successfully received." << endl;
 
+        if (options.session && !options.serve) {
+            sendSession(socket, destAddr, options, [&userInput](SessionWriter& writer) {
+                writer.write("", (const uint8_t*)userInput.data(), userInput.size());
+            });
+            return;
+        }
+
+        if (options.serve) {
+            serveReceivers(port, options, userInput);
+            return;
+        }
+
         socket.listen();
-        if (socket.doHandshake(destAddr)) {
+        bool connected = socket.doHandshake(destAddr);
+        // Socket lines are written asynchronously, keep them ahead of ours
+        Logger::flush();
+        if (connected) {
             cout << Color::GREEN << "[+]" << Color::RESET << " Handshake completed. Sending data..." << endl;
             socket.send(receiverIP, receiverPort, userInput.data(), userInput.size());
             socket.close();
+            dumpStats(socket, options);
         } else {
             cerr << Color::RED << "[!]" << Color::RESET << " Handshake failed. Exiting..." << endl;
             return;
@@ -102,6 +236,40 @@ void runSender(const std::string& host, int port) {
         // string filePath = "socket.cpp";
         getline(cin, filePath);
 
+        if (filesystem::is_directory(filePath) && (!options.session || options.serve)) {
+            cerr << Color::RED << "[!]" << Color::RESET << " Sending a directory needs --session on both ends" << endl;
+            return;
+        }
+
+        if (options.streams > 1) {
+            sendStriped(socket, port, receiverIP, receiverPort, filePath, options);
+            return;
+        }
+
+        if (options.session && !options.serve) {
+            // More paths, one per line, until an empty line or the end of the input
+            vector<string> paths = {filePath};
+            string path;
+            while (getline(cin, path) && !path.empty()) {
+                paths.push_back(path);
+            }
+            sendSession(socket, destAddr, options, [&paths](SessionWriter& writer) {
+                for (const string& path : paths) {
+                    try {
+                        if (filesystem::is_directory(path)) {
+                            uint32_t entries = writer.writeDirectory(path);
+                            cout << Color::YELLOW << "[i]" << Color::RESET << " Directory " << path << " framed: " << entries << " entries" << endl;
+                        } else {
+                            writer.writeFile(path, filesystem::path(path).filename().string());
+                        }
+                    } catch (const std::exception& e) {
+                        cerr << Color::RED << "[!]" << Color::RESET << " " << e.what() << endl;
+                    }
+                }
+            });
+            return;
+        }
+
         ifstream file(filePath, ios::binary);
         if (!file.is_open()) {
             cerr << Color::RED << "[!]" << Color::RESET << " Failed to open file: " << filePath << endl;
@@ -133,11 +301,19 @@ void runSender(const std::string& host, int port) {
         cout << Color::GREEN << "[+]" << Color::RESET << " File has been successfully read." << endl;
         cout << Color::YELLOW << "[i]" << Color::RESET << " Listening for connection..." << endl;
 
+        if (options.serve) {
+            serveReceivers(port, options, fullPayload);
+            return;
+        }
+
         socket.listen();
-        if (socket.doHandshake(destAddr)) {
+        bool connected = socket.doHandshake(destAddr);
+        Logger::flush();
+        if (connected) {
             cout << Color::GREEN << "[+]" << Color::RESET << " Handshake completed. Sending file data..." << endl;
             socket.send(receiverIP, receiverPort, fullPayload.data(), fullPayload.size());
             socket.close();
+            dumpStats(socket, options);
         } else {
             cerr << Color::RED << "[!]" << Color::RESET << " Handshake failed. Exiting..." << endl;
             return;
@@ -149,8 +325,72 @@ void runSender(const std::string& host, int port) {
 } 
 
 
-void runReceiver(const std::string& host, int port) {
-    TCPSocket socket("0.0.0.0", port);
+Task<void> serveReceiver(TCPSocket* socket, const string& payload, const NodeOptions& options) {
+    bool accepted = co_await socket->async_accept();
+    if (accepted) {
+        cout << Color::GREEN << "[+]" << Color::RESET << " Handshake completed. Sending data..." << endl;
+        co_await socket->async_send((void*)payload.data(), payload.size());
+    } else {
+        cerr << Color::RED << "[!]" << Color::RESET << " Handshake failed." << endl;
+    }
+    co_await socket->async_close();
+    dumpStats(*socket, options);
+    delete socket;
+}
+
+void serveReceivers(int port, const NodeOptions& options, const string& payload) {
+    if (options.zeroCopy) {
+        cerr << Color::RED << "[!]" << Color::RESET << " --zerocopy is not supported with --serve, ignoring" << endl;
+    }
+    if (options.session) {
+        cerr << Color::RED << "[!]" << Color::RESET << " --session is not supported with --serve, ignoring" << endl;
+    }
+
+    if (options.shards != 1) {
+        // One SO_REUSEPORT listener and thread per shard, the payload is only read
+        ShardedListener listener("0.0.0.0", port, options.shards, options.transport, options.pinCpus);
+        cout << Color::YELLOW << "[i]" << Color::RESET << " Serving every receiver on port " << port << " with "
+             << listener.getShardCount() << " shards, press Ctrl+C to stop" << endl;
+        listener.start(
+            [&payload, &options](TCPSocket* socket) {
+                socket->setSelectiveRepeat(options.selectiveRepeat);
+                socket->setSharedMemory(options.sharedMemory);
+                socket->setTrace(options.trace);
+                if (options.window > 0) {
+                    socket->setWindowSize(options.window);
+                }
+                return serveReceiver(socket, payload, options);
+            },
+            [&options](TCPListener& shard) { shard.getTransport()->setGso(options.gso); });
+        listener.join();
+        return;
+    }
+
+    // Every receiver contacting this port gets the payload, all on one thread
+    TCPListener listener("0.0.0.0", port, options.transport);
+    listener.getTransport()->setGso(options.gso);
+
+    cout << Color::YELLOW << "[i]" << Color::RESET << " Serving every receiver on port " << port << ", press Ctrl+C to stop" << endl;
+    while (TCPSocket* socket = listener.accept()) {
+        socket->setSelectiveRepeat(options.selectiveRepeat);
+        socket->setSharedMemory(options.sharedMemory);
+        socket->setTrace(options.trace);
+        if (options.window > 0) {
+            socket->setWindowSize(options.window);
+        }
+        spawn(serveReceiver(socket, payload, options));
+    }
+}
+
+void runReceiver(const std::string& host, int port, const NodeOptions& options) {
+    TCPSocket socket(host, port, options.transport);
+    socket.setGro(options.gro);
+    socket.setSelectiveRepeat(options.selectiveRepeat);
+    socket.setSharedMemory(options.sharedMemory);
+    socket.setTrace(options.trace);
+    if (options.window > 0) {
+        socket.setWindowSize(options.window);
+    }
 
     // Get sender's IP and port
     string senderIP;
@@ -163,12 +403,25 @@ void runReceiver(const std::string& host, int port) {
 
     cout << Color::GREEN << "[+]" << Color::RESET << " Trying to contact the sender at " << senderIP << ":" << serverPort << endl;
 
-    struct sockaddr_in serverAddr = socket.createAddr(senderIP, serverPort);
-    if (!socket.doHandshake(serverAddr)) {
+    // A bad address throws here, before any stripe thread starts
+    struct sockaddr_in serverAddr = TCPSocket::createAddr(senderIP, serverPort);
+    if (options.streams > 1) {
+        receiveStriped(socket, port, senderIP, serverPort, options);
+        return;
+    }
+
+    bool connected = socket.doHandshake(serverAddr);
+    Logger::flush();
+    if (!connected) {
         cout << Color::RED << "[!]" << Color::RESET << " Handshake failed" << endl;
         return;
     }
 
+    if (options.session) {
+        receiveSession(socket, options);
+        return;
+    }
+
     const string DELIMITER = "<<META_END>>";
 
     vector<uint8_t> totalBuffer;
@@ -243,4 +496,345 @@ void runReceiver(const std::string& host, int port) {
     }
 
     socket.close();
+    dumpStats(socket, options);
+}
+
+/**
+ * One connection for many transfers (--session): produce frames them into
+ * the stream on its own thread while this one runs the protocol
+ */
+void sendSession(TCPSocket& socket, struct sockaddr_in& destAddr, const NodeOptions& options,
+                 const std::function<void(SessionWriter&)>& produce) {
+    socket.listen();
+    bool connected = socket.doHandshake(destAddr);
+    Logger::flush();
+    if (!connected) {
+        cerr << Color::RED << "[!]" << Color::RESET << " Handshake failed. Exiting..." << endl;
+        return;
+    }
+    cout << Color::GREEN << "[+]" << Color::RESET << " Handshake completed. Starting session..." << endl;
+
+    StreamChannel channel;
+    SessionWriter writer(channel);
+    writer.onCompleted = [](const TransferInfo& info) {
+        cout << Color::GREEN << "[+]" << Color::RESET << " Transfer " << info.id << " delivered: "
+             << (info.name.empty() ? "message" : info.name) << " (" << info.size << " bytes)" << endl;
+    };
+
+    thread producer([&]() {
+        produce(writer);
+        writer.close();
+    });
+    socket.sendStream(channel);
+    producer.join();
+    // Acknowledged after the producer framed its last transfer
+    writer.pollCompleted();
+
+    socket.close();
+    dumpStats(socket, options);
+}
+
+/**
+ * Create a file of a manifest at its full size and with its mode (still
+ * writable for the owner until its data comes), so its data lands in place
+ * @return false if it could not be created
+ */
+static bool preallocateFile(const filesystem::path& path, uint64_t size, uint32_t mode) {
+    error_code error;
+    filesystem::create_directories(path.parent_path(), error);
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    if (mode != 0 && fchmod(fd, (mode & 07777) | S_IWUSR) < 0) {
+        close(fd);
+        return false;
+    }
+    // Not every filesystem reserves space, the file is still written
+    if (size > 0) {
+        fallocate(fd, 0, 0, size);
+    }
+    close(fd);
+    return true;
+}
+
+/**
+ * Write a received file over whatever is at path (a preallocated file
+ * keeps its blocks), cut to the received size and given the sender's mode
+ * (0: none sent, the file keeps its own)
+ * @return false if the file could not be written, the data is read anyway
+ */
+static bool saveTransfer(SessionReader& reader, const filesystem::path& path, uint32_t mode, vector<uint8_t>& buffer) {
+    error_code error;
+    filesystem::create_directories(path.parent_path(), error);
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+    bool saved = fd >= 0;
+    uint64_t written = 0;
+    size_t n;
+    while ((n = reader.read(buffer.data(), buffer.size())) > 0) {
+        for (size_t done = 0; saved && done < n; ) {
+            ssize_t result = write(fd, buffer.data() + done, n - done);
+            if (result <= 0) {
+                saved = false;
+                break;
+            }
+            done += result;
+        }
+        written += n;
+    }
+    if (fd >= 0) {
+        saved = ftruncate(fd, written) == 0 && saved;
+        if (mode != 0) {
+            saved = fchmod(fd, mode & 07777) == 0 && saved;
+        }
+        saved = close(fd) == 0 && saved;
+    }
+    return saved;
+}
+
+/**
+ * Save the transfers of a session into ./test/ until the sender ends it,
+ * messages are printed. Files announced by a manifest are created at their
+ * size up front, those that never arrive are removed at the end. Its
+ * directories are created up front too and get their modes at the end,
+ * after every file under them.
+ */
+void receiveSession(TCPSocket& socket, const NodeOptions& options) {
+    StreamChannel channel;
+    thread consumer([&channel]() {
+        SessionReader reader(channel);
+        TransferInfo info;
+        vector<uint8_t> buffer(1 << 16);
+        size_t n;
+        int transfers = 0;
+        set<filesystem::path> pending;  // Preallocated, data not received yet
+        map<filesystem::path, uint32_t> directories;  // Modes applied once every file is in
+        reader.onManifest = [&pending, &directories](const vector<TransferInfo>& files) {
+            uint64_t total = 0;
+            size_t count = 0;
+            for (const TransferInfo& file : files) {
+                filesystem::path relative = safeTransferPath(file.name);
+                if (relative.empty()) {
+                    continue;
+                }
+                if (file.directory) {
+                    error_code error;
+                    filesystem::create_directories("./test" / relative, error);
+                    directories[relative] = file.mode;
+                    continue;
+                }
+                if (preallocateFile("./test" / relative, file.size, file.mode)) {
+                    pending.insert(relative);
+                }
+                total += file.size;
+                count++;
+            }
+            cout << Color::YELLOW << "[i]" << Color::RESET << " Manifest: " << count << " files, "
+                 << files.size() - count << " directories, " << total << " bytes" << endl;
+        };
+
+        while (reader.next(info)) {
+            if (info.name.empty()) {
+                string message;
+                while ((n = reader.read(buffer.data(), buffer.size())) > 0) {
+                    message.append((const char*)buffer.data(), n);
+                }
+                cout << Color::YELLOW << "[i]" << Color::RESET << " Received message: " << message << endl;
+            } else {
+                // A session cannot write outside ./test/
+                filesystem::path relative = safeTransferPath(info.name);
+                if (relative.empty()) {
+                    cerr << Color::RED << "[!]" << Color::RESET << " Skipping transfer " << info.id
+                         << " with unsafe name: " << info.name << endl;
+                    continue;
+                }
+                pending.erase(relative);
+                bool saved = saveTransfer(reader, "./test" / relative, info.mode, buffer);
+                if (!reader.isFailed() && saved) {
+                    cout << Color::GREEN << "[+]" << Color::RESET << " Transfer " << info.id << " saved as: "
+                         << relative.generic_string() << " (" << info.size << " bytes)" << endl;
+                } else if (!reader.isFailed()) {
+                    cerr << Color::RED << "[!]" << Color::RESET << " Failed to save " << relative.generic_string() << endl;
+                }
+            }
+            transfers++;
+        }
+        if (reader.isFailed()) {
+            cerr << Color::RED << "[!]" << Color::RESET << " Session stream ended inside a transfer" << endl;
+        }
+        for (const filesystem::path& relative : pending) {
+            error_code error;
+            filesystem::remove("./test" / relative, error);
+            cerr << Color::RED << "[!]" << Color::RESET << " Not received: " << relative.generic_string() << endl;
+        }
+        // Deepest first, a directory that loses its write bit has nothing left to create
+        for (auto it = directories.rbegin(); it != directories.rend(); ++it) {
+            error_code error;
+            filesystem::permissions("./test" / it->first, filesystem::perms(it->second & 07777), error);
+            if (error) {
+                cerr << Color::RED << "[!]" << Color::RESET << " Cannot set the mode of " << it->first.generic_string() << endl;
+            }
+        }
+        reader.drain();
+        cout << Color::YELLOW << "[i]" << Color::RESET << " Session ended after " << transfers << " transfers" << endl;
+    });
+
+    socket.recvStream(channel);
+    consumer.join();
+    socket.close();
+    dumpStats(socket, options);
+}
+
+/**
+ * The sockets of stripes 1 and up get the flags of the main one
+ */
+static void configureStripe(TCPSocket& socket, const NodeOptions& options) {
+    socket.setGso(options.gso);
+    socket.setGro(options.gro);
+    socket.setZeroCopy(options.zeroCopy);
+    socket.setSelectiveRepeat(options.selectiveRepeat);
+    socket.setSharedMemory(options.sharedMemory);
+    socket.setTrace(options.trace);
+    if (options.window > 0) {
+        socket.setWindowSize(options.window);
+    }
+}
+
+/**
+ * Run stripe(socket, index) for every stripe at once: stripe 0 on socket and
+ * this thread, stripe i on its own thread with a socket on port + i
+ */
+static void runStripes(TCPSocket& socket, int port, const NodeOptions& options,
+                       const std::function<void(TCPSocket&, uint16_t)>& stripe) {
+    vector<thread> threads;
+    for (int i = 1; i < options.streams; i++) {
+        threads.emplace_back([&, i]() {
+            try {
+                TCPSocket stripeSocket("0.0.0.0", port + i, options.transport);
+                configureStripe(stripeSocket, options);
+                stripe(stripeSocket, i);
+            } catch (const std::exception& e) {
+                cerr << Color::RED << "[!]" << Color::RESET << " Stripe " << i << ": " << e.what() << endl;
+            }
+        });
+    }
+    stripe(socket, 0);
+    for (thread& t : threads) {
+        t.join();
+    }
+}
+
+/**
+ * Send one file as byte ranges over --streams connections, each connection
+ * from port + i to the receiver's port + i
+ */
+void sendStriped(TCPSocket& socket, int port, const string& receiverIP, int receiverPort,
+                 const string& filePath, const NodeOptions& options) {
+    error_code error;
+    if (!filesystem::is_regular_file(filePath, error)) {
+        cerr << Color::RED << "[!]" << Color::RESET << " Failed to open file: " << filePath << endl;
+        return;
+    }
+    string name = filesystem::path(filePath).filename().string();
+    uint64_t size = filesystem::file_size(filePath, error);
+    cout << Color::YELLOW << "[i]" << Color::RESET << " Sending " << name << " (" << size << " bytes) over "
+         << options.streams << " streams" << endl;
+
+    atomic<int> sent(0);
+    runStripes(socket, port, options, [&](TCPSocket& stripeSocket, uint16_t index) {
+        struct sockaddr_in destAddr = stripeSocket.createAddr(receiverIP, receiverPort + index);
+        stripeSocket.listen();
+        bool connected = stripeSocket.doHandshake(destAddr);
+        Logger::flush();
+        if (!connected) {
+            cerr << Color::RED << "[!]" << Color::RESET << " Stripe " << index << " handshake failed" << endl;
+            return;
+        }
+
+        StreamChannel channel;
+        bool framed = true;
+        thread producer([&]() {
+            try {
+                writeStripe(channel, filePath, name, index, options.streams);
+            } catch (const std::exception& e) {
+                cerr << Color::RED << "[!]" << Color::RESET << " Stripe " << index << ": " << e.what() << endl;
+                framed = false;
+            }
+            channel.close();
+        });
+        stripeSocket.sendStream(channel);
+        producer.join();
+        stripeSocket.close();
+        if (framed) {
+            sent++;
+        }
+        dumpStats(stripeSocket, options);
+    });
+
+    if (sent == options.streams) {
+        cout << Color::GREEN << "[+]" << Color::RESET << " All " << options.streams << " stripes of " << name << " sent" << endl;
+    } else {
+        cerr << Color::RED << "[!]" << Color::RESET << " " << options.streams - sent << " stripes of " << name << " failed" << endl;
+    }
+}
+
+/**
+ * Receive a file striped over --streams connections into ./test/, every
+ * stripe written at its offset as it arrives
+ */
+void receiveStriped(TCPSocket& socket, int port, const string& senderIP, int senderPort, const NodeOptions& options) {
+    vector<StripeHeader> headers(options.streams);
+    vector<string> names(options.streams);
+    vector<char> received(options.streams, false);
+
+    runStripes(socket, port, options, [&](TCPSocket& stripeSocket, uint16_t index) {
+        struct sockaddr_in serverAddr = stripeSocket.createAddr(senderIP, senderPort + index);
+        bool connected = stripeSocket.doHandshake(serverAddr);
+        Logger::flush();
+        if (!connected) {
+            cerr << Color::RED << "[!]" << Color::RESET << " Stripe " << index << " handshake failed" << endl;
+            return;
+        }
+
+        StreamChannel channel;
+        thread consumer([&]() {
+            try {
+                headers[index] = readStripe(channel, "./test", names[index]);
+                received[index] = headers[index].index == index && headers[index].count == options.streams;
+            } catch (const std::exception& e) {
+                cerr << Color::RED << "[!]" << Color::RESET << " Stripe " << index << ": " << e.what() << endl;
+            }
+            // Whatever is left, so the connection can finish
+            uint8_t rest[4096];
+            while (channel.read(rest, sizeof(rest)) > 0) {
+            }
+        });
+        stripeSocket.recvStream(channel);
+        consumer.join();
+        stripeSocket.close();
+        dumpStats(stripeSocket, options);
+    });
+
+    bool complete = true;
+    for (int i = 0; i < options.streams; i++) {
+        complete = complete && received[i] && names[i] == names[0] && headers[i].fileSize == headers[0].fileSize;
+    }
+    if (complete) {
+        filesystem::path relative = safeTransferPath(names[0]);
+        error_code error;
+        filesystem::permissions("./test" / relative, filesystem::perms(headers[0].mode & 07777), error);
+        cout << Color::GREEN << "[+]" << Color::RESET << " File saved as: " << relative.generic_string()
+             << " (" << headers[0].fileSize << " bytes, " << options.streams << " streams)" << endl;
+    } else {
+        cerr << Color::RED << "[!]" << Color::RESET << " Striped transfer incomplete" << endl;
+    }
+}
+
+/**
+ * Print the connection's counters as one JSON line on stderr (--stats)
+ */
+void dumpStats(const TCPSocket& socket, const NodeOptions& options) {
+    if (options.stats) {
+        cerr << socket.getStats().toJson() << endl;
+    }
 }
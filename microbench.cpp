@@ -0,0 +1,328 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <functional>
+#include <memory>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#include "header/segment.hpp"
+#include "header/segment_handler.hpp"
+#include "header/logger.hpp"
+
+/**
+ * Microbenchmarks of the per-segment primitives in segment.cpp and
+ * segment_handler.cpp, to measure each change to them on its own.
+ *
+ * Every benchmark is calibrated to run for at least --min-ms, repeated
+ * --repeats times, and the fastest repeat is reported as ns/op and
+ * bytes/cycle. Cycles come from the CPU cycle counter (perf_event_open);
+ * where that is not allowed the TSC is used, which counts at a fixed
+ * reference rate instead of the core clock.
+ */
+
+using namespace std;
+
+struct MicroResult {
+    string name;
+    uint64_t bytesPerOp = 0;
+    double nsPerOp = 0;
+    double cyclesPerOp = 0;
+    double bytesPerCycle = 0;
+};
+
+struct MicroOptions {
+    string filter;
+    string output;
+    double minMs = 100;
+    int repeats = 5;
+};
+
+/**
+ * Keeps the compiler from dropping a computation whose result is unused
+ */
+template <typename T>
+static inline void keep(const T& value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+/**
+ * Core cycles of this thread, or TSC ticks when the PMU is not available
+ */
+class CycleCounter
+{
+private:
+    int fd;
+
+public:
+    CycleCounter() : fd(-1) {
+        struct perf_event_attr attr = {};
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.size = sizeof(attr);
+        attr.config = PERF_COUNT_HW_CPU_CYCLES;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+
+    ~CycleCounter() {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+
+    CycleCounter(const CycleCounter&) = delete;
+    CycleCounter& operator=(const CycleCounter&) = delete;
+
+    const char* source() const {
+        if (fd >= 0) {
+            return "core cycles";
+        }
+#if defined(__x86_64__) || defined(__i386__)
+        return "TSC ticks";
+#else
+        return "none";
+#endif
+    }
+
+    uint64_t read() const {
+        if (fd >= 0) {
+            uint64_t cycles = 0;
+            if (::read(fd, &cycles, sizeof(cycles)) == sizeof(cycles)) {
+                return cycles;
+            }
+        }
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return 0;
+#endif
+    }
+};
+
+/**
+ * Runs body(iterations) until it is long enough to time, then keeps the fastest repeat
+ */
+static MicroResult measure(const string& name, uint64_t bytesPerOp, const function<void(uint64_t)>& body,
+                           const MicroOptions& options, const CycleCounter& counter) {
+    using Clock = chrono::steady_clock;
+
+    uint64_t iterations = 1;
+    while (true) {
+        Clock::time_point start = Clock::now();
+        body(iterations);
+        double ms = chrono::duration<double, milli>(Clock::now() - start).count();
+        if (ms >= options.minMs || iterations >= (uint64_t(1) << 40)) {
+            break;
+        }
+        // Aim a bit past the target so the next round usually is the last
+        iterations = ms < 1 ? iterations * 10 : uint64_t(iterations * options.minMs * 1.2 / ms) + 1;
+    }
+
+    MicroResult result;
+    result.name = name;
+    result.bytesPerOp = bytesPerOp;
+    result.nsPerOp = -1;
+    for (int repeat = 0; repeat < options.repeats; repeat++) {
+        uint64_t cyclesStart = counter.read();
+        Clock::time_point start = Clock::now();
+        body(iterations);
+        double ns = chrono::duration<double, nano>(Clock::now() - start).count();
+        uint64_t cycles = counter.read() - cyclesStart;
+
+        if (result.nsPerOp < 0 || ns / iterations < result.nsPerOp) {
+            result.nsPerOp = ns / iterations;
+            result.cyclesPerOp = double(cycles) / iterations;
+        }
+    }
+    result.bytesPerCycle = result.cyclesPerOp > 0 ? bytesPerOp / result.cyclesPerOp : 0;
+    return result;
+}
+
+static Segment dataSegment(vector<uint8_t>& payload) {
+    Segment segment = {};
+    segment.seqNum = 123456;
+    segment.data_offset = 5;
+    segment.payloadSize = payload.size();
+    segment.payload = payload.empty() ? nullptr : payload.data();
+    return updateChecksum(segment);
+}
+
+static vector<uint8_t> randomBytes(size_t size) {
+    vector<uint8_t> bytes(size);
+    uint32_t state = 2463534242u;
+    for (uint8_t& byte : bytes) {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        byte = state;
+    }
+    return bytes;
+}
+
+/**
+ * Every benchmark, by name. Each one takes the iteration count it has to run.
+ */
+static vector<pair<string, pair<uint64_t, function<void(uint64_t)>>>> buildBenchmarks() {
+    vector<pair<string, pair<uint64_t, function<void(uint64_t)>>>> benchmarks;
+    const uint32_t MSS = SegmentHandler::MAX_SEGMENT_SIZE;
+
+    for (uint32_t size : {0u, 64u, 512u, MSS}) {
+        auto payload = make_shared<vector<uint8_t>>(randomBytes(size));
+        uint64_t bytes = SEGMENT_HEADER_SIZE + size;
+
+        benchmarks.push_back({"checksum/calculate/" + to_string(size), {bytes, [payload](uint64_t n) {
+            Segment segment = dataSegment(*payload);
+            for (uint64_t i = 0; i < n; i++) {
+                keep(segment);
+                keep(calculateChecksum(segment));
+            }
+        }}});
+
+        benchmarks.push_back({"checksum/validate/" + to_string(size), {bytes, [payload](uint64_t n) {
+            Segment segment = dataSegment(*payload);
+            for (uint64_t i = 0; i < n; i++) {
+                keep(segment);
+                keep(isValidChecksum(segment));
+            }
+        }}});
+
+        benchmarks.push_back({"encode/" + to_string(size), {bytes, [payload](uint64_t n) {
+            Segment segment = dataSegment(*payload);
+            vector<uint8_t> buffer(SEGMENT_HEADER_SIZE + MSS);
+            for (uint64_t i = 0; i < n; i++) {
+                keep(segment);
+                keep(encodeSegment(segment, buffer.data()));
+            }
+        }}});
+
+        // Decoding is what the receiver does with every datagram: parse, then verify
+        benchmarks.push_back({"decode/" + to_string(size), {bytes, [payload](uint64_t n) {
+            vector<uint8_t> buffer(SEGMENT_HEADER_SIZE + MSS);
+            uint32_t length = encodeSegment(dataSegment(*payload), buffer.data());
+            Segment segment;
+            for (uint64_t i = 0; i < n; i++) {
+                keep(buffer.data());
+                bool valid = decodeSegment(buffer.data(), length, segment) && isValidChecksum(segment);
+                keep(valid);
+            }
+        }}});
+    }
+
+    // Stream data is handed out in batches so a handler never runs out of it
+    const uint64_t BATCH = 4096;
+    auto stream = make_shared<vector<uint8_t>>(randomBytes((BATCH + 256) * MSS));
+
+    // generateSegments filling a whole empty window: allocation, copy and checksum per segment
+    for (int window : {3, 32, 255}) {
+        benchmarks.push_back({"generate/w" + to_string(window), {MSS, [stream, window](uint64_t n) {
+            for (uint64_t done = 0; done < n; done += window) {
+                SegmentHandler handler(window);
+                handler.setDataStream(stream->data(), window * SegmentHandler::MAX_SEGMENT_SIZE);
+                keep(handler.segmentBuffer.data());
+            }
+        }}});
+    }
+
+    // One segment through a full window: transmit, cumulative ACK, slide and refill
+    for (int window : {1, 3, 16, 64, 255}) {
+        benchmarks.push_back({"handleAck/w" + to_string(window), {MSS, [stream, window, BATCH](uint64_t n) {
+            for (uint64_t done = 0; done < n; done += BATCH) {
+                uint64_t batch = min(BATCH, n - done);
+                SegmentHandler handler(window);
+                handler.setDataStream(stream->data(), (batch + window) * SegmentHandler::MAX_SEGMENT_SIZE);
+                int count;
+                for (uint64_t i = 0; i < batch; i++) {
+                    handler.nextSegments(count, i, 1000000);
+                    keep(handler.handleAck(handler.getSendBase() + SegmentHandler::MAX_SEGMENT_SIZE, i));
+                }
+            }
+        }}});
+    }
+
+    // Selective Repeat, the window acknowledged newest first: every ACK searches the window
+    // and the last one of a round slides it all and refills it
+    for (int window : {3, 16, 64, 255}) {
+        benchmarks.push_back({"markAcknowledged/w" + to_string(window), {MSS, [stream, window, BATCH](uint64_t n) {
+            for (uint64_t done = 0; done < n; done += BATCH) {
+                uint64_t batch = min(BATCH, n - done);
+                SegmentHandler handler(window);
+                handler.setMode(SELECTIVE_REPEAT);
+                handler.setDataStream(stream->data(), (batch + window) * SegmentHandler::MAX_SEGMENT_SIZE);
+                int count;
+                for (uint64_t i = 0; i < batch;) {
+                    handler.nextSegments(count, i, 1000000);
+                    for (size_t j = handler.segmentBuffer.size(); j-- > 0 && i < batch; i++) {
+                        uint32_t seqNum = handler.segmentBuffer[j].seqNum;
+                        keep(handler.markAcknowledged(seqNum, i));
+                    }
+                }
+            }
+        }}});
+    }
+
+    return benchmarks;
+}
+
+static string toJson(const MicroResult& r) {
+    ostringstream json;
+    json << "{\"name\":\"" << r.name << "\",\"bytesPerOp\":" << r.bytesPerOp << ",\"nsPerOp\":" << r.nsPerOp
+         << ",\"cyclesPerOp\":" << r.cyclesPerOp << ",\"bytesPerCycle\":" << r.bytesPerCycle << "}";
+    return json.str();
+}
+
+int main(int argc, char* argv[]) {
+    MicroOptions options;
+    for (int i = 1; i < argc; i++) {
+        string flag = argv[i];
+        if (flag == "--filter" && i + 1 < argc) {
+            options.filter = argv[++i];
+        } else if (flag == "--output" && i + 1 < argc) {
+            options.output = argv[++i];
+        } else if (flag == "--min-ms" && i + 1 < argc) {
+            options.minMs = stod(argv[++i]);
+        } else if (flag == "--repeats" && i + 1 < argc) {
+            options.repeats = max(1, stoi(argv[++i]));
+        } else {
+            cerr << "Usage: node_microbench [--filter TEXT] [--output FILE] [--min-ms MS] [--repeats N]" << endl;
+            return 1;
+        }
+    }
+
+    Logger::setLevel(LOG_LEVEL_ERROR);
+
+    CycleCounter counter;
+    cerr << "Cycles: " << counter.source() << endl;
+
+    vector<MicroResult> results;
+    for (auto& [name, benchmark] : buildBenchmarks()) {
+        if (!options.filter.empty() && name.find(options.filter) == string::npos) {
+            continue;
+        }
+        MicroResult result = measure(name, benchmark.first, benchmark.second, options, counter);
+        results.push_back(result);
+        cerr << result.name << ": " << result.nsPerOp << " ns/op, " << result.cyclesPerOp << " cycles/op, "
+             << result.bytesPerCycle << " bytes/cycle" << endl;
+    }
+
+    ofstream file;
+    if (!options.output.empty()) {
+        file.open(options.output);
+    }
+    ostream& out = options.output.empty() ? cout : file;
+    out << "{\"cycles\":\"" << counter.source() << "\",\"benchmarks\":[\n";
+    for (size_t i = 0; i < results.size(); i++) {
+        out << toJson(results[i]) << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    out << "]}" << endl;
+    return 0;
+}
@@ -1,6 +1,5 @@
 #include "header/node.hpp"
-#include <iostream>
-#include "header/color.hpp"
+#include "header/logger.hpp"
 
 void Node::run() {
     if (!connection) {
@@ -14,20 +13,20 @@ void Node::run() {
             int32_t received = connection->recv(buffer, BUFFER_SIZE);
             
             if (received < 0) {
-                std::cout << Color::RED << "[!]" << Color::RESET << " Receive error" << std::endl;
+                LOG_ERROR(Color::RED << "[!]" << Color::RESET << " Receive error");
                 break;
             } else if (received > 0) {
                 handleMessage(buffer);
             }
             // Zero receive means connection closed
             else {
-                std::cout << Color::YELLOW << "[i]" << Color::RESET << " Connection closed by peer" << std::endl;
+                LOG_INFO(Color::YELLOW << "[i]" << Color::RESET << " Connection closed by peer");
                 break;
             }
         }
     }
     catch (const std::exception& e) {
-        std::cout << Color::RED << "[!]" << Color::RESET << " Node error: " << e.what() << std::endl;
+        LOG_ERROR(Color::RED << "[!]" << Color::RESET << " Node error: " << e.what());
     }
     
     connection->close();
@@ -0,0 +1,131 @@
+#include "header/packet_trace.hpp"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+
+static const char TRACE_MAGIC[8] = {'T', 'C', 'P', 'T', 'R', 'A', 'C', 'E'};
+
+PacketTrace::PacketTrace(const std::string& path, size_t maxRecords) :
+    fd(-1),
+    header(nullptr),
+    records(nullptr),
+    capacity(maxRecords),
+    next(0),
+    overflow(0) {
+
+    fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        throw std::runtime_error("Cannot create trace file " + path + ": " + strerror(errno));
+    }
+
+    size_t size = sizeof(TraceHeader) + capacity * sizeof(TraceRecord);
+    if (ftruncate(fd, size) < 0) {
+        ::close(fd);
+        throw std::runtime_error("Cannot size trace file " + path + ": " + strerror(errno));
+    }
+
+    void* mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mapping == MAP_FAILED) {
+        ::close(fd);
+        throw std::runtime_error("Cannot map trace file " + path + ": " + strerror(errno));
+    }
+
+    header = static_cast<TraceHeader*>(mapping);
+    records = reinterpret_cast<TraceRecord*>(header + 1);
+    memcpy(header->magic, TRACE_MAGIC, sizeof(TRACE_MAGIC));
+    header->version = VERSION;
+    header->recordSize = sizeof(TraceRecord);
+    header->records = 0;
+    header->capacity = capacity;
+}
+
+PacketTrace::~PacketTrace() {
+    uint64_t written = getRecords();
+    header->records = written;
+    munmap(header, sizeof(TraceHeader) + capacity * sizeof(TraceRecord));
+    if (ftruncate(fd, sizeof(TraceHeader) + written * sizeof(TraceRecord)) < 0) {
+        // The unused tail is sparse, readers stop at header->records anyway
+    }
+    ::close(fd);
+}
+
+void PacketTrace::record(TraceEvent event, uint16_t connection, int8_t state, uint32_t seqNum, uint32_t ackNum,
+                         uint16_t length, uint32_t window, uint32_t cwnd) {
+    uint64_t slot = next.fetch_add(1, std::memory_order_relaxed);
+    if (slot >= capacity) {
+        overflow.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    TraceRecord& entry = records[slot];
+    entry.timestampNs = uint64_t(now.tv_sec) * 1000000000ull + now.tv_nsec;
+    entry.seqNum = seqNum;
+    entry.ackNum = ackNum;
+    entry.window = window;
+    entry.cwnd = cwnd;
+    entry.connection = connection;
+    entry.length = length;
+    entry.event = event;
+    entry.state = state;
+    entry.reserved[0] = 0;
+    entry.reserved[1] = 0;
+}
+
+uint64_t PacketTrace::getRecords() const {
+    uint64_t claimed = next.load(std::memory_order_relaxed);
+    return claimed < capacity ? claimed : capacity;
+}
+
+uint64_t PacketTrace::getOverflow() const {
+    return overflow.load(std::memory_order_relaxed);
+}
+
+std::vector<TraceRecord> PacketTrace::load(const std::string& path) {
+    int file = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (file < 0) {
+        throw std::runtime_error("Cannot open trace file " + path + ": " + strerror(errno));
+    }
+
+    struct stat info;
+    if (fstat(file, &info) < 0 || size_t(info.st_size) < sizeof(TraceHeader)) {
+        ::close(file);
+        throw std::runtime_error(path + " is not a trace file");
+    }
+
+    void* mapping = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+    ::close(file);
+    if (mapping == MAP_FAILED) {
+        throw std::runtime_error("Cannot map trace file " + path + ": " + strerror(errno));
+    }
+
+    const TraceHeader* fileHeader = static_cast<const TraceHeader*>(mapping);
+    if (memcmp(fileHeader->magic, TRACE_MAGIC, sizeof(TRACE_MAGIC)) != 0 ||
+        fileHeader->version != VERSION || fileHeader->recordSize != sizeof(TraceRecord)) {
+        munmap(mapping, info.st_size);
+        throw std::runtime_error(path + " is not a trace file of this version");
+    }
+
+    const TraceRecord* fileRecords = reinterpret_cast<const TraceRecord*>(fileHeader + 1);
+    size_t available = (info.st_size - sizeof(TraceHeader)) / sizeof(TraceRecord);
+    size_t count = fileHeader->records > 0 ? std::min<size_t>(fileHeader->records, available) : available;
+
+    std::vector<TraceRecord> result;
+    result.reserve(fileHeader->records);
+    for (size_t i = 0; i < count; i++) {
+        // Unclosed trace: slots never written are still zero
+        if (fileRecords[i].timestampNs == 0) {
+            continue;
+        }
+        result.push_back(fileRecords[i]);
+    }
+    munmap(mapping, info.st_size);
+    return result;
+}
@@ -77,13 +77,14 @@ Segment finAck() {
 uint16_t calculateChecksum(Segment segment) {
     uint32_t sum = 0;
     
-    // Calculate header checksum
+    // Calculate header checksum (wire fields only, the payload pointer is host-local)
     const uint8_t* bytePtr = reinterpret_cast<const uint8_t*>(&segment);
     const uint16_t* ptr = reinterpret_cast<const uint16_t*>(bytePtr);
+    const size_t checksumIndex = offsetof(Segment, checksum) / 2;
     
     // Skip checksum field in calculation
-    for (size_t i = 0; i < sizeof(Segment) / 2; i++) {
-        if (i != 8) { // Skip checksum field
+    for (size_t i = 0; i < SEGMENT_HEADER_SIZE / 2; i++) {
+        if (i != checksumIndex) {
             sum += ptr[i];
         }
     }
@@ -115,6 +116,29 @@ bool isValidChecksum(Segment segment) {
     return originalChecksum == calculatedChecksum;
 }
 
+uint32_t encodeSegment(const Segment& segment, uint8_t* buffer) {
+    std::memcpy(buffer, &segment, SEGMENT_HEADER_SIZE);
+    if (segment.payload && segment.payloadSize > 0) {
+        std::memcpy(buffer + SEGMENT_HEADER_SIZE, segment.payload, segment.payloadSize);
+        return SEGMENT_HEADER_SIZE + segment.payloadSize;
+    }
+    return SEGMENT_HEADER_SIZE;
+}
+
+bool decodeSegment(uint8_t* buffer, uint32_t length, Segment& segment) {
+    if (length < SEGMENT_HEADER_SIZE) {
+        return false;
+    }
+
+    std::memcpy(&segment, buffer, SEGMENT_HEADER_SIZE);
+    if (segment.payloadSize != length - SEGMENT_HEADER_SIZE) {
+        return false;
+    }
+
+    segment.payload = segment.payloadSize > 0 ? buffer + SEGMENT_HEADER_SIZE : nullptr;
+    return true;
+}
+
 uint32_t generateSecureSequenceNumber() {
     FILE* urandom = fopen("/dev/urandom", "r");
     if (!urandom) {
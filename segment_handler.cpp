@@ -1,112 +1,113 @@
 #include "header/segment_handler.hpp"
 #include "header/segment.hpp"
-#include <iostream>
 #include <cstring>
-#include "header/color.hpp"
+#include "header/logger.hpp"
 #include <vector>
 
 const uint32_t SegmentHandler::MAX_SEGMENT_SIZE;
 const uint32_t SegmentHandler::MAX_SEQ_NUM;
-const time_t SegmentHandler::TIMEOUT_SECONDS;
 
 SegmentHandler::SegmentHandler(uint8_t wSize) : 
     windowSize(wSize),
+    mode(GO_BACK_N),
     currentSeqNum(0),
-    currentAckNum(0),
     dataStream(nullptr),
     dataSize(0),
     dataIndex(0),
-    LAR(0),
-    LFS(0) {}
+    source(nullptr),
+    sendBase(0),
+    nextSeqNum(0),
+    retransmits(0),
+    rttSample(-1) {}
 
 SegmentHandler::~SegmentHandler() {
     for (auto& segment : segmentBuffer) {
-        if (segment.payload) {
-            delete[] segment.payload;
-            segment.payload = nullptr;
-        }
+        releasePayload(segment.payload);
+        segment.payload = nullptr;
     }
     segmentBuffer.clear();
+
+    // Still pinned payloads are left alone, the kernel may not be done with them
+    for (uint8_t* payload : retiredPayloads) {
+        if (pinnedPayloads.find(payload) == pinnedPayloads.end()) {
+            delete[] payload;
+        }
+    }
+    retiredPayloads.clear();
 }
 
 void SegmentHandler::generateSegments() {
     const uint32_t MAX_PAYLOAD_SIZE = 1460; 
 
-    if (!dataStream) {
-        std::cerr << Color::RED << "[!]" << Color::RESET << " FATAL: dataStream is NULL" << std::endl;
+    if (!dataStream && !source) {
+        LOG_ERROR(Color::RED << "[!]" << Color::RESET << " FATAL: dataStream is NULL");
         return;
     }
 
-    int windowSizeInt = windowSize % 0xff;
-    while (dataIndex < dataSize && segmentBuffer.size() < windowSizeInt) {
-
-        uint8_t* byteStream = reinterpret_cast<uint8_t*>(dataStream);
-
-        uint32_t remainingData = dataSize - dataIndex;
-        uint32_t numSegments = (remainingData + MAX_PAYLOAD_SIZE - 1) / MAX_PAYLOAD_SIZE; // Pembulatan ke atas
-
-        Segment* segments = new Segment[numSegments]; // Array untuk menyimpan segmen
-
-        for (uint32_t i = 0; i < numSegments; ++i) {
-            uint32_t currentChunkSize = std::min(MAX_PAYLOAD_SIZE, remainingData);
-            segments[i].payload = new (std::nothrow) uint8_t[currentChunkSize];
-
-            if (!segments[i].payload) {
-                std::cerr << Color::RED << "[!]" << Color::RESET << " Failed to allocate memory for segment payload " << i << std::endl;
-                for (uint32_t j = 0; j < i; ++j) delete[] segments[j].payload;
-                delete[] segments;
-                return;
-            }
-
-            segments[i].payloadSize = currentChunkSize;
-            uint32_t startIdx = dataIndex;
-
-            if (startIdx + currentChunkSize > dataSize) {
-                std::cerr << Color::RED << "[!]" << Color::RESET << " FATAL: Attempt to access out of bounds memory" << std::endl;
-                for (uint32_t j = 0; j <= i; ++j) delete[] segments[j].payload;
-                delete[] segments;
-                return;
-            }
-
-            try {
-                std::memcpy(segments[i].payload, byteStream + startIdx, currentChunkSize);
-            } catch (const std::exception& e) {
-                std::cerr << Color::RED << "[!]" << Color::RESET << " Memory copy error for segment " << i << ": " << e.what() << std::endl;
-                for (uint32_t j = 0; j <= i; ++j) delete[] segments[j].payload;
-                delete[] segments;
-                return;
-            }
-
-            segments[i].seqNum = currentSeqNum;
-
-            try {
-                segments[i] = updateChecksum(segments[i]);
-            } catch (const std::exception& e) {
-                std::cerr << Color::RED << "[!]" << Color::RESET << " Checksum calculation error for segment " << i << ": " << e.what() << std::endl;
-                for (uint32_t j = 0; j <= i; ++j) delete[] segments[j].payload;
-                delete[] segments;
-                return;
+    // One segment per free slot, the rest of the stream waits for ACKs
+    while (segmentBuffer.size() < windowSize) {
+        uint32_t currentChunkSize;
+        if (source) {
+            // Only full segments until the stream ends, a short one tells the receiver it is the last.
+            // Closed is read first so that readable() includes every byte written before close.
+            bool closed = source->isClosed();
+            currentChunkSize = std::min<size_t>(MAX_PAYLOAD_SIZE, source->readable());
+            if (currentChunkSize == 0 || (currentChunkSize < MAX_PAYLOAD_SIZE && !closed)) {
+                break;
             }
+        } else if (dataIndex < dataSize) {
+            currentChunkSize = std::min(MAX_PAYLOAD_SIZE, dataSize - dataIndex);
+        } else {
+            break;
+        }
 
-            segmentBuffer.push_back(segments[i]);
+        Segment segment = {};
+        segment.payload = new (std::nothrow) uint8_t[currentChunkSize];
+        if (!segment.payload) {
+            LOG_ERROR(Color::RED << "[!]" << Color::RESET << " Failed to allocate memory for segment payload");
+            return;
+        }
 
-            currentSeqNum += currentChunkSize;
+        if (source) {
+            source->read(segment.payload, currentChunkSize);
+        } else {
+            std::memcpy(segment.payload, dataStream + dataIndex, currentChunkSize);
             dataIndex += currentChunkSize;
-            remainingData -= currentChunkSize;
         }
+        segment.payloadSize = currentChunkSize;
+        segment.seqNum = currentSeqNum;
+        segment.data_offset = 5;
+        segmentBuffer.push_back(updateChecksum(segment));
+        segmentTimers.push_back({0, 0, false, false, false});
 
-        delete[] segments; // Hapus array segmen setelah selesai
+        currentSeqNum += currentChunkSize;
     }
 }
 
 void SegmentHandler::setDataStream(uint8_t *dataStream, uint32_t dataSize) {
     if (dataStream == nullptr || dataSize == 0) {
-        std::cerr << Color::RED << "[!]" << Color::RESET << " Invalid data stream or data size" << std::endl;
+        LOG_ERROR(Color::RED << "[!]" << Color::RESET << " Invalid data stream or data size");
         return;
     }
 
     this->dataStream = dataStream;
     this->dataSize = dataSize;
+    this->dataIndex = 0;
+    this->source = nullptr;
+    generateSegments();
+}
+
+void SegmentHandler::setDataSource(ByteRing* source) {
+    this->dataStream = nullptr;
+    this->dataSize = 0;
+    this->dataIndex = 0;
+    this->source = source;
+    if (source) {
+        generateSegments();
+    }
+}
+
+void SegmentHandler::pullSegments() {
     generateSegments();
 }
 
@@ -115,83 +116,168 @@ uint8_t SegmentHandler::getWindowSize() {
     return windowSize;
 }
 
-Segment* SegmentHandler::advanceWindow(uint8_t sizeParam, int helper) {
-    // int size = std::min(static_cast<int>(sizeParam), static_cast<int>(segmentBuffer.size()));
-    int size = static_cast<int>(sizeParam);
-    // if (size == static_cast<int>(segmentBuffer.size()-1)) {
-    //     segmentBuffer.pop_back();
-    // }
-    // int size = static_cast<int>(sizeParam);
-    // std::cout << "ukuran parameternya tuh " << size << std::endl;
-    
+void SegmentHandler::setWindowSize(uint8_t windowSize) {
+    this->windowSize = windowSize;
+}
+
+void SegmentHandler::setMode(ArqMode mode) {
+    this->mode = mode;
+}
+
+ArqMode SegmentHandler::getMode() const {
+    return mode;
+}
+
+uint32_t SegmentHandler::getSendBase() const {
+    return sendBase;
+}
+
+uint32_t SegmentHandler::getNextSeqNum() const {
+    return nextSeqNum;
+}
+
+uint32_t SegmentHandler::getWindowEdge() const {
     if (segmentBuffer.empty()) {
-        std::cerr << Color::RED << "[!]" << Color::RESET << " Segment buffer is empty, cannot advance window" << std::endl;
+        return sendBase;
+    }
+    return segmentBuffer.back().seqNum + segmentBuffer.back().payloadSize;
+}
+
+Segment* SegmentHandler::nextSegments(int& count, int64_t now, int64_t timeout) {
+    count = 0;
+    size_t first = 0;
+    while (first < segmentBuffer.size() && seqLess(segmentBuffer[first].seqNum, nextSeqNum)) {
+        first++;
+    }
+    if (first == segmentBuffer.size()) {
         return nullptr;
     }
 
-    // Create new window of segments
-    Segment* segments = new Segment[size];
-    uint32_t baseSeqNum = currentSeqNum;
-    // Copy segments and update sequence numbers
-    for (int i = 0; i < size; i++) {
-        // if (advanceWindowProgress != 0){
-        if (helper != 0) {
-            segments[i] = segmentBuffer[1 + i];
+    count = segmentBuffer.size() - first;
+    nextSeqNum = getWindowEdge();
+    for (size_t i = first; i < segmentTimers.size(); i++) {
+        SegmentTimer& timer = segmentTimers[i];
+        if (timer.sent) {
+            // Go-Back-N rewound over it
+            timer.retransmitted = true;
+            retransmits++;
+        } else {
+            timer.sent = true;
+            timer.sentAt = now;
         }
-        else {
-            segments[i] = segmentBuffer[i];
-        }
-
-        // }
-        // std::cout << "isi payload: \n" << segments[i].payload << std::endl;
-        // std::cout << "payload: " << segments[i].payload << std::endl;
-        // segments[i].seqNum = currentSeqNum + (i * segmentBuffer[advanceWindowProgress +i].payloadSize);
+        timer.deadline = now + timeout;
     }
-    // advanceWindowProgress++;
-    // Update sequence number for next window
-    // currentSeqNum = segments[size - 1].seqNum + segmentBuffer[size - 1].payloadSize;
-    // std::cout << "current seqnum di advance: " << currentSeqNum << std::endl;
- 
-    return segments;
+    return &segmentBuffer[first];
+}
+
+void SegmentHandler::rewind() {
+    nextSeqNum = sendBase;
 }
 
 bool SegmentHandler::validateWindowSize() {
     return windowSize < (MAX_SEQ_NUM + 1)/2;
 }
 
-void SegmentHandler::handleAck(uint32_t ackNum) { 
-    if (ackNum > LAR) {
-        LAR = ackNum;
-        while (!segmentBuffer.empty() && 
-               segmentBuffer.front().seqNum < LAR) {
-            segmentBuffer.erase(segmentBuffer.begin());
+uint32_t SegmentHandler::handleAck(uint32_t ackNum, int64_t now) { 
+    // Only ACKs for transmitted data move the window
+    if (!seqLess(sendBase, ackNum) || seqLess(nextSeqNum, ackNum)) {
+        return 0;
+    }
+
+    // Inside a segment counts for nothing, the receiver only acknowledges whole segments
+    for (size_t i = 0; i < segmentBuffer.size(); i++) {
+        if (seqLess(ackNum, segmentBuffer[i].seqNum + segmentBuffer[i].payloadSize)) {
+            break;
         }
-        generateSegments();
+        acknowledge(i, now);
     }
+    return slideWindow();
 }
 
-void SegmentHandler::checkTimeouts() { 
-    time_t now = time(NULL);
-    for (size_t i = 0; i < segmentTimers.size(); i++) {
-        if (!segmentTimers[i].acknowledged && 
-            (now - segmentTimers[i].sentTime) > TIMEOUT_SECONDS) {
-            dataIndex = i * MAX_SEGMENT_SIZE;
-            generateSegments();
+uint32_t SegmentHandler::markAcknowledged(uint32_t seqNum, int64_t now) {
+    for (size_t i = 0; i < segmentBuffer.size(); i++) {
+        if (segmentBuffer[i].seqNum == seqNum) {
+            // Never transmitted means a stale ACK from an earlier round
+            if (seqLess(seqNum, nextSeqNum)) {
+                acknowledge(i, now);
+            }
             break;
         }
     }
+    return slideWindow();
 }
 
-bool SegmentHandler::isInWindow(uint32_t seqNum) {
-    return (seqNum >= LAR && 
-            seqNum < LAR + (windowSize * MAX_SEGMENT_SIZE));
+void SegmentHandler::acknowledge(size_t index, int64_t now) {
+    SegmentTimer& timer = segmentTimers[index];
+    if (timer.acknowledged) {
+        return;
+    }
+    timer.acknowledged = true;
+    if (timer.sent && !timer.retransmitted) {
+        rttSample = now - timer.sentAt;
+    }
+}
+
+uint64_t SegmentHandler::getRetransmits() const {
+    return retransmits;
+}
+
+int64_t SegmentHandler::takeRttSample() {
+    int64_t sample = rttSample;
+    rttSample = -1;
+    return sample;
+}
+
+uint32_t SegmentHandler::slideWindow() {
+    uint32_t acked = 0;
+    while (acked < segmentBuffer.size() && segmentTimers[acked].acknowledged) {
+        releasePayload(segmentBuffer[acked].payload);
+        acked++;
+    }
+    if (acked == 0) {
+        return 0;
+    }
+
+    uint32_t edge = getWindowEdge();
+    segmentBuffer.erase(segmentBuffer.begin(), segmentBuffer.begin() + acked);
+    segmentTimers.erase(segmentTimers.begin(), segmentTimers.begin() + acked);
+    sendBase = segmentBuffer.empty() ? edge : segmentBuffer.front().seqNum;
+    generateSegments();
+    return acked;
+}
+
+std::vector<Segment*> SegmentHandler::expiredSegments(int64_t now, int64_t newDeadline) {
+    std::vector<Segment*> expired;
+    for (size_t i = 0; i < segmentBuffer.size() && seqLess(segmentBuffer[i].seqNum, nextSeqNum); i++) {
+        if (!segmentTimers[i].acknowledged && segmentTimers[i].deadline <= now) {
+            segmentTimers[i].deadline = newDeadline;
+            segmentTimers[i].retransmitted = true;
+            retransmits++;
+            expired.push_back(&segmentBuffer[i]);
+        }
+    }
+    return expired;
 }
 
-void SegmentHandler::markAcknowledged(uint32_t seqNum) {
-    size_t index = (seqNum - LAR) / MAX_SEGMENT_SIZE;
-    if (index < segmentTimers.size()) {
-        segmentTimers[index].acknowledged = true;
+int64_t SegmentHandler::nextDeadline() const {
+    int64_t earliest = -1;
+    for (size_t i = 0; i < segmentBuffer.size() && seqLess(segmentBuffer[i].seqNum, nextSeqNum); i++) {
+        if (!segmentTimers[i].acknowledged && (earliest < 0 || segmentTimers[i].deadline < earliest)) {
+            earliest = segmentTimers[i].deadline;
+        }
     }
+    return earliest;
+}
+
+bool SegmentHandler::isComplete() const {
+    if (source) {
+        return segmentBuffer.empty() && source->isDrained();
+    }
+    return segmentBuffer.empty() && dataIndex >= dataSize;
+}
+
+bool SegmentHandler::isInWindow(uint32_t seqNum) {
+    return !seqLess(seqNum, sendBase) && seqLess(seqNum, getWindowEdge());
 }
 
 void SegmentHandler::cleanupSegment(Segment& segment) {
@@ -199,4 +285,38 @@ void SegmentHandler::cleanupSegment(Segment& segment) {
         delete[] segment.payload;
         segment.payload = nullptr;
     }
+}
+
+void SegmentHandler::releasePayload(uint8_t* payload) {
+    if (!payload) {
+        return;
+    }
+
+    if (pinnedPayloads.find(payload) != pinnedPayloads.end()) {
+        retiredPayloads.insert(payload);
+        return;
+    }
+    delete[] payload;
+}
+
+void SegmentHandler::pinPayload(uint8_t* payload) {
+    if (payload) {
+        pinnedPayloads[payload]++;
+    }
+}
+
+void SegmentHandler::unpinPayload(uint8_t* payload) {
+    auto it = pinnedPayloads.find(payload);
+    if (it == pinnedPayloads.end()) {
+        return;
+    }
+
+    if (--it->second > 0) {
+        return;
+    }
+    pinnedPayloads.erase(it);
+
+    if (retiredPayloads.erase(payload) > 0) {
+        delete[] payload;
+    }
 }
\ No newline at end of file
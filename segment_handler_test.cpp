@@ -0,0 +1,246 @@
+#include <iostream>
+#include <vector>
+#include <string>
+#include <cstring>
+#include "header/segment_handler.hpp"
+#include "header/logger.hpp"
+
+/**
+ * Unit tests of the sender's sliding window (SegmentHandler) driven with
+ * dropped, duplicated, stale and reordered ACKs, run by ctest.
+ */
+
+using namespace std;
+
+static const uint32_t SEGMENT = SegmentHandler::MAX_SEGMENT_SIZE;
+static int failures = 0;
+
+#define CHECK_EQ(actual, expected)                                                             \
+    do {                                                                                       \
+        auto a = (actual);                                                                     \
+        auto e = (expected);                                                                   \
+        if (a != e) {                                                                          \
+            cerr << __FILE__ << ":" << __LINE__ << ": " << #actual << " is " << a              \
+                 << ", expected " << e << endl;                                                \
+            failures++;                                                                        \
+        }                                                                                      \
+    } while (0)
+
+/**
+ * A handler over a number of full segments plus a short last one of tail bytes,
+ * with its first window transmitted
+ */
+struct Sender {
+    vector<uint8_t> data;
+    SegmentHandler handler;
+    int64_t now = 0;
+
+    Sender(uint8_t window, uint32_t segments, uint32_t tail = 0) : handler(window) {
+        data.resize(segments * SEGMENT + tail);
+        for (size_t i = 0; i < data.size(); i++) {
+            data[i] = uint8_t(i * 7);
+        }
+        handler.setDataStream(data.data(), data.size());
+    }
+
+    /**
+     * Transmit whatever the window released
+     * @return Sequence number of the first segment, count set to their number
+     */
+    uint32_t transmit(int& count) {
+        Segment* first = handler.nextSegments(count, ++now, 1000);
+        return first ? first->seqNum : 0;
+    }
+
+    uint32_t ack(uint32_t ackNum) {
+        return handler.handleAck(ackNum, ++now);
+    }
+};
+
+static void testInOrder() {
+    Sender sender(4, 10);
+    int count;
+    CHECK_EQ(sender.transmit(count), 0u);
+    CHECK_EQ(count, 4);
+    CHECK_EQ(sender.handler.getNextSeqNum(), 4 * SEGMENT);
+
+    // Every ACK frees one slot and releases exactly one new segment
+    for (uint32_t i = 1; i <= 6; i++) {
+        CHECK_EQ(sender.ack(i * SEGMENT), 1u);
+        CHECK_EQ(sender.handler.getSendBase(), i * SEGMENT);
+        uint32_t seqNum = sender.transmit(count);
+        CHECK_EQ(count, 1);
+        CHECK_EQ(seqNum, (i + 3) * SEGMENT);
+        CHECK_EQ(sender.handler.getNextSeqNum(), (i + 4) * SEGMENT);
+    }
+
+    // The end of the data: slots free up, nothing new to send
+    for (uint32_t i = 7; i <= 10; i++) {
+        CHECK_EQ(sender.ack(i * SEGMENT), 1u);
+        sender.transmit(count);
+        CHECK_EQ(count, 0);
+    }
+    CHECK_EQ(sender.handler.isComplete(), true);
+}
+
+static void testDroppedAcks() {
+    Sender sender(4, 10);
+    int count;
+    sender.transmit(count);
+
+    // The ACKs for the first two segments were lost, the third covers them
+    CHECK_EQ(sender.ack(3 * SEGMENT), 3u);
+    CHECK_EQ(sender.handler.getSendBase(), 3 * SEGMENT);
+    CHECK_EQ(sender.handler.getNextSeqNum(), 4 * SEGMENT);
+    uint32_t seqNum = sender.transmit(count);
+    CHECK_EQ(count, 3);
+    CHECK_EQ(seqNum, 4 * SEGMENT);
+    CHECK_EQ(sender.handler.getNextSeqNum(), 7 * SEGMENT);
+}
+
+static void testDuplicateAcks() {
+    Sender sender(4, 10);
+    int count;
+    sender.transmit(count);
+    CHECK_EQ(sender.ack(SEGMENT), 1u);
+    sender.transmit(count);
+    CHECK_EQ(count, 1);
+
+    // Duplicates move nothing and release nothing
+    for (int i = 0; i < 3; i++) {
+        CHECK_EQ(sender.ack(SEGMENT), 0u);
+        CHECK_EQ(sender.handler.getSendBase(), SEGMENT);
+        CHECK_EQ(sender.handler.getNextSeqNum(), 5 * SEGMENT);
+        sender.transmit(count);
+        CHECK_EQ(count, 0);
+    }
+}
+
+static void testStaleAndOutOfRangeAcks() {
+    Sender sender(4, 10);
+    int count;
+    sender.transmit(count);
+    CHECK_EQ(sender.ack(2 * SEGMENT), 2u);
+    sender.transmit(count);
+    CHECK_EQ(count, 2);
+
+    // Behind the send base
+    CHECK_EQ(sender.ack(SEGMENT), 0u);
+    CHECK_EQ(sender.ack(0), 0u);
+    // Beyond anything transmitted
+    CHECK_EQ(sender.ack(7 * SEGMENT), 0u);
+    CHECK_EQ(sender.ack(100 * SEGMENT), 0u);
+    // Inside a segment only counts the whole ones before it
+    CHECK_EQ(sender.ack(3 * SEGMENT + 10), 1u);
+    CHECK_EQ(sender.handler.getSendBase(), 3 * SEGMENT);
+    CHECK_EQ(sender.handler.getNextSeqNum(), 6 * SEGMENT);
+    sender.transmit(count);
+    CHECK_EQ(count, 1);
+}
+
+static void testReorderedAcks() {
+    Sender sender(4, 10);
+    int count;
+    sender.transmit(count);
+
+    // ACK 3 overtakes ACK 1 and ACK 2
+    CHECK_EQ(sender.ack(3 * SEGMENT), 3u);
+    CHECK_EQ(sender.ack(SEGMENT), 0u);
+    CHECK_EQ(sender.ack(2 * SEGMENT), 0u);
+    CHECK_EQ(sender.handler.getSendBase(), 3 * SEGMENT);
+    sender.transmit(count);
+    CHECK_EQ(count, 3);
+    CHECK_EQ(sender.handler.getNextSeqNum(), 7 * SEGMENT);
+
+    // The late ones after that still release nothing
+    CHECK_EQ(sender.ack(3 * SEGMENT), 0u);
+    sender.transmit(count);
+    CHECK_EQ(count, 0);
+}
+
+static void testLossAndRewind() {
+    Sender sender(4, 10);
+    int count;
+    sender.transmit(count);
+    CHECK_EQ(sender.ack(SEGMENT), 1u);
+    sender.transmit(count);
+
+    // The segment at SEGMENT was lost: the timeout goes back to the send base
+    sender.handler.rewind();
+    CHECK_EQ(sender.handler.getNextSeqNum(), SEGMENT);
+    uint32_t seqNum = sender.transmit(count);
+    CHECK_EQ(seqNum, SEGMENT);
+    CHECK_EQ(count, 4);
+    CHECK_EQ(sender.handler.getRetransmits(), 4u);
+    CHECK_EQ(sender.handler.getNextSeqNum(), 5 * SEGMENT);
+
+    // Retransmitted segments give no RTT sample (Karn), new ones do
+    sender.handler.takeRttSample();
+    CHECK_EQ(sender.ack(2 * SEGMENT), 1u);
+    CHECK_EQ(sender.handler.takeRttSample(), -1);
+    seqNum = sender.transmit(count);
+    CHECK_EQ(count, 1);
+    CHECK_EQ(seqNum, 5 * SEGMENT);
+    CHECK_EQ(sender.ack(6 * SEGMENT), 4u);
+    CHECK_EQ(sender.handler.takeRttSample() > 0, true);
+    sender.transmit(count);
+    CHECK_EQ(count, 4);
+    CHECK_EQ(sender.handler.getNextSeqNum(), 10 * SEGMENT);
+}
+
+static void testShortLastSegment() {
+    Sender sender(3, 2, 100);
+    int count;
+    sender.transmit(count);
+    CHECK_EQ(count, 3);
+    CHECK_EQ(sender.handler.getWindowEdge(), 2 * SEGMENT + 100);
+    CHECK_EQ(sender.ack(2 * SEGMENT + 50), 2u);
+    CHECK_EQ(sender.handler.isComplete(), false);
+    CHECK_EQ(sender.ack(2 * SEGMENT + 100), 1u);
+    CHECK_EQ(sender.handler.getSendBase(), 2 * SEGMENT + 100);
+    CHECK_EQ(sender.handler.isComplete(), true);
+}
+
+static void testSelectiveReordered() {
+    Sender sender(4, 10);
+    sender.handler.setMode(SELECTIVE_REPEAT);
+    int count;
+    sender.transmit(count);
+
+    // A hole at the front holds the window, any order behind it
+    CHECK_EQ(sender.handler.markAcknowledged(2 * SEGMENT, ++sender.now), 0u);
+    CHECK_EQ(sender.handler.markAcknowledged(SEGMENT, ++sender.now), 0u);
+    CHECK_EQ(sender.handler.markAcknowledged(SEGMENT, ++sender.now), 0u);
+    CHECK_EQ(sender.handler.getSendBase(), 0u);
+    sender.transmit(count);
+    CHECK_EQ(count, 0);
+
+    CHECK_EQ(sender.handler.markAcknowledged(0, ++sender.now), 3u);
+    CHECK_EQ(sender.handler.getSendBase(), 3 * SEGMENT);
+    sender.transmit(count);
+    CHECK_EQ(count, 3);
+
+    // Not transmitted yet: a stale ACK from an earlier round
+    CHECK_EQ(sender.handler.markAcknowledged(7 * SEGMENT, ++sender.now), 0u);
+    CHECK_EQ(sender.handler.getSendBase(), 3 * SEGMENT);
+}
+
+int main() {
+    Logger::setLevel(LOG_LEVEL_OFF);
+
+    testInOrder();
+    testDroppedAcks();
+    testDuplicateAcks();
+    testStaleAndOutOfRangeAcks();
+    testReorderedAcks();
+    testLossAndRewind();
+    testShortLastSegment();
+    testSelectiveReordered();
+
+    if (failures > 0) {
+        cerr << failures << " checks failed" << endl;
+        return 1;
+    }
+    cout << "All SegmentHandler tests passed" << endl;
+    return 0;
+}
@@ -0,0 +1,437 @@
+#include "header/session.hpp"
+#include <fstream>
+#include <filesystem>
+#include <cstring>
+#include <stdexcept>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+
+static const uint32_t SESSION_MAGIC = 0x53455331;  // "SES1"
+
+const uint16_t SessionWriter::MAX_NAME_LENGTH;
+const uint32_t SessionWriter::SMALL_FILE_SIZE;
+const uint32_t SessionWriter::PACK_SIZE;
+const uint32_t SessionWriter::PACK_FILES;
+
+SessionWriter::SessionWriter(StreamChannel& channel) :
+    channel(channel),
+    written(0),
+    nextId(0),
+    chunk(1 << 16) {}
+
+void SessionWriter::writeHeader(const TransferInfo& info) {
+    TransferHeader header = {};
+    header.magic = SESSION_MAGIC;
+    header.id = info.id;
+    header.size = info.size;
+    header.mode = info.mode;
+    header.nameLength = info.name.size();
+    writeData((const uint8_t*)&header, sizeof(header));
+    writeData((const uint8_t*)info.name.data(), info.name.size());
+}
+
+void SessionWriter::writeData(const uint8_t* data, size_t length) {
+    channel.write(data, length);
+    written += length;
+}
+
+// Start reading a file into the page cache while the one before it is framed
+static void prefetch(const std::string& path) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd >= 0) {
+        posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+        ::close(fd);
+    }
+}
+
+std::vector<uint8_t> SessionWriter::buildIndex(TransferKind kind, const std::vector<TransferInfo>& files, uint64_t dataSize) {
+    // Header, count, entries and names, for a single write
+    std::vector<uint8_t> index(sizeof(TransferHeader) + sizeof(uint32_t) + files.size() * sizeof(PackEntry));
+    uint8_t* position = index.data() + sizeof(TransferHeader) + sizeof(uint32_t);
+    for (const TransferInfo& file : files) {
+        PackEntry entry = {};
+        entry.size = file.size;
+        entry.mode = file.mode;
+        entry.nameLength = file.name.size();
+        entry.flags = file.directory ? PACK_ENTRY_DIRECTORY : 0;
+        std::memcpy(position, &entry, sizeof(entry));
+        position += sizeof(entry);
+    }
+    for (const TransferInfo& file : files) {
+        index.insert(index.end(), file.name.begin(), file.name.end());
+    }
+
+    TransferHeader header = {};
+    header.magic = SESSION_MAGIC;
+    header.id = files.front().id;
+    header.size = index.size() - sizeof(TransferHeader) + dataSize;
+    header.kind = kind;
+    uint32_t count = files.size();
+    std::memcpy(index.data(), &header, sizeof(header));
+    std::memcpy(index.data() + sizeof(header), &count, sizeof(count));
+    return index;
+}
+
+void SessionWriter::flushPack() {
+    if (packFiles.empty()) {
+        return;
+    }
+
+    std::vector<uint8_t> index = buildIndex(TRANSFER_PACK, packFiles, packData.size());
+    writeData(index.data(), index.size());
+    writeData(packData.data(), packData.size());
+    for (TransferInfo& file : packFiles) {
+        unacknowledged.emplace_back(written, std::move(file));
+    }
+    packFiles.clear();
+    packData.clear();
+}
+
+uint32_t SessionWriter::write(const std::string& name, const uint8_t* data, uint64_t size, uint32_t mode) {
+    if (name.size() > MAX_NAME_LENGTH) {
+        throw std::runtime_error("transfer name too long: " + name);
+    }
+
+    flushPack();
+    TransferInfo info = {nextId++, name, size, mode};
+    writeHeader(info);
+    writeData(data, size);
+    unacknowledged.emplace_back(written, info);
+    pollCompleted();
+    return info.id;
+}
+
+uint32_t SessionWriter::writeFile(const std::string& path, const std::string& name) {
+    if (name.size() > MAX_NAME_LENGTH) {
+        throw std::runtime_error("transfer name too long: " + name);
+    }
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file.is_open()) {
+        throw std::runtime_error("cannot open " + path);
+    }
+    uint64_t size = file.tellg();
+    file.seekg(0);
+    uint32_t mode = uint32_t(std::filesystem::status(path).permissions()) & 07777;
+
+    if (size <= SMALL_FILE_SIZE) {
+        if (packData.size() + size > PACK_SIZE || packFiles.size() == PACK_FILES) {
+            flushPack();
+        }
+        size_t offset = packData.size();
+        packData.resize(offset + size);
+        if (!file.read((char*)packData.data() + offset, size)) {
+            packData.resize(offset);
+            throw std::runtime_error("short read from " + path);
+        }
+        packFiles.push_back({nextId++, name, size, mode});
+        pollCompleted();
+        return packFiles.back().id;
+    }
+
+    flushPack();
+    TransferInfo info = {nextId++, name, size, mode};
+    writeHeader(info);
+    for (uint64_t left = size; left > 0; ) {
+        size_t length = std::min<uint64_t>(chunk.size(), left);
+        if (!file.read((char*)chunk.data(), length)) {
+            // The header promised size bytes: keep the stream framed for the
+            // transfers after this one, the receiver gets zeros
+            std::fill(chunk.begin(), chunk.end(), 0);
+            for (; left > 0; left -= length) {
+                length = std::min<uint64_t>(chunk.size(), left);
+                writeData(chunk.data(), length);
+            }
+            unacknowledged.emplace_back(written, info);
+            throw std::runtime_error(path + " shrank while being sent");
+        }
+        writeData(chunk.data(), length);
+        left -= length;
+    }
+    unacknowledged.emplace_back(written, info);
+    pollCompleted();
+    return info.id;
+}
+
+uint32_t SessionWriter::writeDirectory(const std::string& path) {
+    std::filesystem::path root = std::filesystem::absolute(path).lexically_normal();
+    if (root.filename().empty()) {
+        root = root.parent_path();
+    }
+    if (!std::filesystem::is_directory(root)) {
+        throw std::runtime_error(path + " is not a directory");
+    }
+
+    // Everything is listed before anything is framed, so a bad name throws
+    // with the stream untouched. Directories go in too, so empty ones and
+    // their modes reach the receiver.
+    std::vector<std::pair<std::string, TransferInfo>> entries;
+    auto add = [&](const std::filesystem::directory_entry& entry, bool directory) {
+        std::error_code error;
+        std::string name = (root.filename() / entry.path().lexically_relative(root)).lexically_normal().generic_string();
+        if (!name.empty() && name.back() == '/') {
+            name.pop_back();
+        }
+        if (name.size() > MAX_NAME_LENGTH) {
+            throw std::runtime_error("transfer name too long: " + name);
+        }
+        uint64_t size = directory ? 0 : entry.file_size(error);
+        uint32_t mode = uint32_t(entry.status(error).permissions()) & 07777;
+        entries.push_back({entry.path().string(), {0, name, size, mode, directory}});
+    };
+    add(std::filesystem::directory_entry(root), true);
+    for (const auto& entry : std::filesystem::recursive_directory_iterator(
+             root, std::filesystem::directory_options::skip_permission_denied)) {
+        std::error_code error;
+        // The walk does not follow links to directories, neither does the manifest
+        if (entry.is_directory(error) && !entry.is_symlink(error)) {
+            add(entry, true);
+        } else if (entry.is_regular_file(error)) {
+            add(entry, false);
+        }
+    }
+    // A directory sorts before everything under it
+    std::sort(entries.begin(), entries.end(), [](const auto& a, const auto& b) {
+        return a.second.name < b.second.name;
+    });
+
+    flushPack();
+    std::vector<TransferInfo> manifest;
+    for (size_t i = 0; i < entries.size(); i++) {
+        entries[i].second.id = nextId + i;
+        manifest.push_back(entries[i].second);
+        if (manifest.size() == PACK_FILES || i + 1 == entries.size()) {
+            std::vector<uint8_t> index = buildIndex(TRANSFER_MANIFEST, manifest, 0);
+            writeData(index.data(), index.size());
+            manifest.clear();
+        }
+    }
+
+    std::string failure;
+    size_t failures = 0;
+    for (size_t i = 0; i < entries.size(); i++) {
+        uint32_t id = nextId;
+        if (entries[i].second.directory) {
+            // Nothing to send, the manifest created it
+            nextId = id + 1;
+            continue;
+        }
+        for (size_t next = i + 1; next < entries.size(); next++) {
+            if (!entries[next].second.directory) {
+                prefetch(entries[next].first);
+                break;
+            }
+        }
+        try {
+            writeFile(entries[i].first, entries[i].second.name);
+        } catch (const std::exception& e) {
+            if (failure.empty()) {
+                failure = e.what();
+            }
+            failures++;
+            // Ids stay those of the manifest, the receiver sees the gap
+            nextId = id + 1;
+        }
+    }
+    flushPack();
+    if (failures > 1) {
+        throw std::runtime_error(failure + " (and " + std::to_string(failures - 1) + " more)");
+    } else if (failures == 1) {
+        throw std::runtime_error(failure);
+    }
+    return entries.size();
+}
+
+void SessionWriter::pollCompleted() {
+    uint64_t delivered = channel.getDelivered();
+    while (!unacknowledged.empty() && unacknowledged.front().first <= delivered) {
+        TransferInfo info = std::move(unacknowledged.front().second);
+        unacknowledged.pop_front();
+        if (onCompleted) {
+            onCompleted(info);
+        }
+    }
+}
+
+void SessionWriter::close() {
+    flushPack();
+    channel.close();
+}
+
+SessionReader::SessionReader(StreamChannel& channel) :
+    channel(channel),
+    remaining(0),
+    failed(false),
+    buffer(1 << 16),
+    bufferPos(0),
+    bufferEnd(0) {}
+
+size_t SessionReader::take(uint8_t* data, size_t length) {
+    if (bufferPos == bufferEnd) {
+        if (length >= buffer.size()) {
+            // Large reads go straight to the caller
+            return channel.read(data, length);
+        }
+        bufferPos = 0;
+        bufferEnd = channel.read(buffer.data(), buffer.size());
+    }
+
+    size_t n = std::min(length, bufferEnd - bufferPos);
+    std::memcpy(data, buffer.data() + bufferPos, n);
+    bufferPos += n;
+    return n;
+}
+
+bool SessionReader::readExactly(uint8_t* data, size_t length) {
+    size_t done = 0;
+    while (done < length) {
+        size_t n = take(data + done, length - done);
+        if (n == 0) {
+            return false;
+        }
+        done += n;
+    }
+    return true;
+}
+
+bool SessionReader::next(TransferInfo& info) {
+    if (failed) {
+        return false;
+    }
+    if (remaining > 0) {
+        skipBuffer.resize(1 << 16);
+        while (read(skipBuffer.data(), skipBuffer.size()) > 0) {
+        }
+        if (failed) {
+            return false;
+        }
+    }
+
+    // The files of a pack follow each other in the stream, a manifest only
+    // announces files
+    while (packFiles.empty()) {
+        TransferHeader header;
+        size_t first = take((uint8_t*)&header, sizeof(header));
+        if (first == 0) {
+            // End of the session
+            return false;
+        }
+        if (!readExactly((uint8_t*)&header + first, sizeof(header) - first) || header.magic != SESSION_MAGIC) {
+            failed = true;
+            return false;
+        }
+        if (header.kind == TRANSFER_SINGLE) {
+            return readSingle(header, info);
+        }
+
+        std::vector<TransferInfo> files;
+        if ((header.kind != TRANSFER_PACK && header.kind != TRANSFER_MANIFEST) ||
+            !readIndex(header, header.kind == TRANSFER_PACK, files)) {
+            failed = true;
+            return false;
+        }
+        if (header.kind == TRANSFER_PACK) {
+            packFiles.assign(std::make_move_iterator(files.begin()), std::make_move_iterator(files.end()));
+        } else if (onManifest) {
+            onManifest(files);
+        }
+    }
+
+    info = std::move(packFiles.front());
+    packFiles.pop_front();
+    remaining = info.size;
+    return true;
+}
+
+bool SessionReader::readSingle(const TransferHeader& header, TransferInfo& info) {
+    info.id = header.id;
+    info.size = header.size;
+    info.mode = header.mode;
+    info.name.resize(header.nameLength);
+    if (!readExactly((uint8_t*)info.name.data(), header.nameLength)) {
+        failed = true;
+        return false;
+    }
+    remaining = header.size;
+    return true;
+}
+
+bool SessionReader::readIndex(const TransferHeader& header, bool contents, std::vector<TransferInfo>& files) {
+    uint32_t count;
+    if (!readExactly((uint8_t*)&count, sizeof(count)) || count == 0 || count > SessionWriter::PACK_FILES ||
+        sizeof(count) + uint64_t(count) * sizeof(PackEntry) > header.size) {
+        return false;
+    }
+    std::vector<PackEntry> entries(count);
+    if (!readExactly((uint8_t*)entries.data(), count * sizeof(PackEntry))) {
+        return false;
+    }
+
+    // Whatever the index says must add up to the size of the transfer
+    uint64_t total = sizeof(count) + uint64_t(count) * sizeof(PackEntry);
+    for (uint32_t i = 0; i < count; i++) {
+        // Only a manifest lists directories, and they have no data
+        if ((entries[i].flags & PACK_ENTRY_DIRECTORY) && (contents || entries[i].size != 0)) {
+            return false;
+        }
+        total += entries[i].nameLength + (contents ? entries[i].size : 0);
+    }
+    if (total != header.size) {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        TransferInfo file;
+        file.id = header.id + i;
+        file.size = entries[i].size;
+        file.mode = entries[i].mode;
+        file.directory = entries[i].flags & PACK_ENTRY_DIRECTORY;
+        file.name.resize(entries[i].nameLength);
+        if (!readExactly((uint8_t*)file.name.data(), file.name.size())) {
+            return false;
+        }
+        files.push_back(std::move(file));
+    }
+    return true;
+}
+
+size_t SessionReader::read(uint8_t* data, size_t length) {
+    if (remaining == 0 || failed) {
+        return 0;
+    }
+    size_t n = take(data, std::min<uint64_t>(length, remaining));
+    if (n == 0) {
+        failed = true;
+        return 0;
+    }
+    remaining -= n;
+    return n;
+}
+
+bool SessionReader::isFailed() const {
+    return failed;
+}
+
+void SessionReader::drain() {
+    bufferPos = bufferEnd;
+    skipBuffer.resize(1 << 16);
+    while (channel.read(skipBuffer.data(), skipBuffer.size()) > 0) {
+    }
+}
+
+std::filesystem::path safeTransferPath(const std::string& name) {
+    std::filesystem::path path(name);
+    if (path.has_root_path()) {
+        return {};
+    }
+    std::filesystem::path safe;
+    for (const std::filesystem::path& component : path) {
+        if (component == "..") {
+            return {};
+        }
+        if (!component.empty() && component != ".") {
+            safe /= component;
+        }
+    }
+    return safe;
+}
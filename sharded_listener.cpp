@@ -0,0 +1,122 @@
+#include "header/sharded_listener.hpp"
+#include "header/logger.hpp"
+#include <sys/eventfd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <stdexcept>
+
+ShardedListener::ShardedListener(string ip, int32_t port, int shardCount, TransportType transportType, bool pinCpus) :
+    ip(ip),
+    port(port),
+    transportType(transportType),
+    pinCpus(pinCpus) {
+
+    if (shardCount <= 0) {
+        shardCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    for (int i = 0; i < shardCount; i++) {
+        std::unique_ptr<Shard> shard(new Shard());
+        shard->accepted = 0;
+        shard->wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (shard->wakeFd < 0) {
+            for (auto& created : shards) {
+                ::close(created->wakeFd);
+            }
+            throw runtime_error("eventfd creation failed");
+        }
+        shards.push_back(std::move(shard));
+    }
+}
+
+ShardedListener::~ShardedListener() {
+    stop();
+    join();
+    for (auto& shard : shards) {
+        ::close(shard->wakeFd);
+    }
+}
+
+void ShardedListener::start(Handler handler, Setup setup) {
+    for (size_t i = 0; i < shards.size(); i++) {
+        shards[i]->thread = std::thread(&ShardedListener::runShard, this, i, handler, setup);
+    }
+}
+
+/**
+ * Run one accepted connection's handler, live counts the handlers not finished
+ */
+static Task<void> serveConnection(Task<void> handler, int& live) {
+    co_await handler;
+    live--;
+}
+
+void ShardedListener::runShard(int index, Handler handler, Setup setup) {
+    Shard& shard = *shards[index];
+
+    if (pinCpus) {
+        unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(index % cores, &cpus);
+        if (pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) != 0) {
+            LOG_ERROR(Color::RED << "[!]" << Color::RESET << " [Shard " << index << "] CPU pinning failed");
+        }
+    }
+
+    // Everything below lives on this thread: listener, EventLoop::threadLoop(), IoUring::threadRing()
+    try {
+        TCPListener listener(ip, port, transportType, true);
+        if (setup) {
+            setup(listener);
+        }
+
+        EventLoop& loop = EventLoop::threadLoop();
+        int wakeWatch = loop.watch(shard.wakeFd, [&]() { listener.stopAccepting(); });
+
+        LOG_INFO(Color::YELLOW << "[i]" << Color::RESET << " [Shard " << index << "] Listening on port " << port);
+        int live = 0;
+        while (TCPSocket* socket = listener.accept()) {
+            shard.accepted++;
+            live++;
+            spawn(serveConnection(handler(socket), live));
+        }
+        loop.unwatch(wakeWatch);
+
+        // The listener still demultiplexes for the accepted connections, it
+        // may only close once their handlers are done with them
+        if (live > 0) {
+            LOG_INFO(Color::YELLOW << "[i]" << Color::RESET << " [Shard " << index << "] Stopped accepting, waiting for "
+                     << live << " connections");
+            loop.runUntil([&]() { return live == 0; });
+        }
+    } catch (const std::exception& e) {
+        LOG_ERROR(Color::RED << "[!]" << Color::RESET << " [Shard " << index << "] " << e.what());
+    }
+}
+
+void ShardedListener::stop() {
+    uint64_t one = 1;
+    for (auto& shard : shards) {
+        if (write(shard->wakeFd, &one, sizeof(one)) < 0) {
+            // Counter saturated, the shard is being woken anyway
+        }
+    }
+}
+
+void ShardedListener::join() {
+    for (auto& shard : shards) {
+        if (shard->thread.joinable()) {
+            shard->thread.join();
+        }
+    }
+}
+
+int ShardedListener::getShardCount() const {
+    return shards.size();
+}
+
+uint64_t ShardedListener::getAcceptedCount(int shard) const {
+    return shards[shard]->accepted;
+}
@@ -0,0 +1,238 @@
+#include "header/shared_memory.hpp"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <ifaddrs.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstring>
+#include <string>
+#include <new>
+#include <stdexcept>
+#include <algorithm>
+
+static const uint32_t SHARED_MEMORY_MAGIC = 0x53484d31;  // "SHM1"
+
+// Followed by the two data areas, each starting on its own page
+struct SharedMemoryLayout
+{
+    uint32_t magic;
+    uint32_t ringSize;
+    uint64_t token;
+    SharedRingHeader rings[2];  // [0] written by the side that created the memfd
+};
+
+static size_t dataOffset() {
+    return (sizeof(SharedMemoryLayout) + 4095) & ~size_t(4095);
+}
+
+bool isSharedMemoryOffer(const Segment& segment) {
+    if (!segment.payload || segment.payloadSize != sizeof(SharedMemoryOffer)) {
+        return false;
+    }
+    SharedMemoryOffer offer;
+    std::memcpy(&offer, segment.payload, sizeof(offer));
+    return offer.magic == SHARED_MEMORY_MAGIC;
+}
+
+bool isSameHost(const struct sockaddr_in& addr) {
+    if ((ntohl(addr.sin_addr.s_addr) >> 24) == 127) {
+        return true;
+    }
+
+    struct ifaddrs* interfaces;
+    if (getifaddrs(&interfaces) < 0) {
+        return false;
+    }
+    bool local = false;
+    for (struct ifaddrs* entry = interfaces; entry && !local; entry = entry->ifa_next) {
+        if (entry->ifa_addr && entry->ifa_addr->sa_family == AF_INET) {
+            local = ((struct sockaddr_in*)entry->ifa_addr)->sin_addr.s_addr == addr.sin_addr.s_addr;
+        }
+    }
+    freeifaddrs(interfaces);
+    return local;
+}
+
+SharedMemoryChannel::SharedMemoryChannel(uint32_t ringSize) :
+    layout(nullptr),
+    mappedSize(0),
+    fd(-1),
+    offer{},
+    doorbell(false) {
+
+    uint32_t size = 4096;
+    while (size < ringSize) {
+        size <<= 1;
+    }
+
+    fd = memfd_create("tcp-over-udp", MFD_CLOEXEC);
+    if (fd < 0) {
+        throw std::runtime_error("memfd creation failed");
+    }
+    mappedSize = dataOffset() + 2 * size_t(size);
+    if (ftruncate(fd, mappedSize) < 0) {
+        ::close(fd);
+        throw std::runtime_error("memfd resize failed");
+    }
+
+    offer.magic = SHARED_MEMORY_MAGIC;
+    offer.pid = getpid();
+    offer.fd = fd;
+    offer.ringSize = size;
+    if (getentropy(&offer.token, sizeof(offer.token)) < 0) {
+        ::close(fd);
+        throw std::runtime_error("getentropy failed");
+    }
+
+    map(true);
+    layout->magic = offer.magic;
+    layout->ringSize = size;
+    layout->token = offer.token;
+    for (SharedRingHeader& ring : layout->rings) {
+        new (&ring) SharedRingHeader();
+    }
+}
+
+SharedMemoryChannel::SharedMemoryChannel(const SharedMemoryOffer& offer) :
+    layout(nullptr),
+    mappedSize(0),
+    fd(-1),
+    offer(offer),
+    doorbell(false) {
+
+    // Only works for a peer this process may inspect (same user, no ptrace restrictions)
+    std::string path = "/proc/" + std::to_string(offer.pid) + "/fd/" + std::to_string(offer.fd);
+    fd = open(path.c_str(), O_RDWR | O_CLOEXEC);
+    if (fd < 0) {
+        throw std::runtime_error("cannot open " + path);
+    }
+
+    struct stat info;
+    mappedSize = dataOffset() + 2 * size_t(offer.ringSize);
+    if (offer.ringSize < 4096 || (offer.ringSize & (offer.ringSize - 1)) ||
+        fstat(fd, &info) < 0 || size_t(info.st_size) != mappedSize) {
+        ::close(fd);
+        throw std::runtime_error("shared memory size mismatch");
+    }
+
+    map(false);
+    if (layout->magic != offer.magic || layout->token != offer.token) {
+        munmap(layout, mappedSize);
+        ::close(fd);
+        throw std::runtime_error("shared memory token mismatch");
+    }
+}
+
+void SharedMemoryChannel::map(bool initiator) {
+    void* memory = mmap(nullptr, mappedSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (memory == MAP_FAILED) {
+        ::close(fd);
+        throw std::runtime_error("shared memory mmap failed");
+    }
+
+    layout = static_cast<SharedMemoryLayout*>(memory);
+    uint8_t* data = static_cast<uint8_t*>(memory) + dataOffset();
+    int outIndex = initiator ? 0 : 1;
+    out = &layout->rings[outIndex];
+    outData = data + outIndex * size_t(offer.ringSize);
+    in = &layout->rings[1 - outIndex];
+    inData = data + (1 - outIndex) * size_t(offer.ringSize);
+    mask = offer.ringSize - 1;
+}
+
+SharedMemoryChannel::~SharedMemoryChannel() {
+    munmap(layout, mappedSize);
+    ::close(fd);
+}
+
+const SharedMemoryOffer& SharedMemoryChannel::getOffer() const {
+    return offer;
+}
+
+size_t SharedMemoryChannel::write(const uint8_t* data, size_t length) {
+    uint64_t tail = out->writePos.load(std::memory_order_relaxed);
+    uint64_t head = out->readPos.load(std::memory_order_acquire);
+    length = std::min<uint64_t>(length, offer.ringSize - (tail - head));
+    if (length == 0) {
+        return 0;
+    }
+
+    size_t offset = tail & mask;
+    size_t first = std::min<size_t>(length, offer.ringSize - offset);
+    std::memcpy(outData + offset, data, first);
+    std::memcpy(outData, data + first, length - first);
+    out->writePos.store(tail + length, std::memory_order_release);
+
+    // Pairs with the fence in requestDoorbell: either the reader sees the new
+    // position when it looks again, or this sees its flag
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (out->readerWaiting.exchange(0)) {
+        doorbell = true;
+    }
+    return length;
+}
+
+size_t SharedMemoryChannel::writable() const {
+    return offer.ringSize - (out->writePos.load(std::memory_order_relaxed) - out->readPos.load(std::memory_order_acquire));
+}
+
+void SharedMemoryChannel::endMessage() {
+    out->endPos.store(out->writePos.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    out->ends.fetch_add(1, std::memory_order_release);
+
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (out->readerWaiting.exchange(0)) {
+        doorbell = true;
+    }
+}
+
+bool SharedMemoryChannel::isMessageConsumed() const {
+    return out->endsConsumed.load(std::memory_order_acquire) == out->ends.load(std::memory_order_relaxed);
+}
+
+uint64_t SharedMemoryChannel::getConsumed() const {
+    return out->readPos.load(std::memory_order_acquire);
+}
+
+size_t SharedMemoryChannel::read(uint8_t* data, size_t length, bool& messageEnd) {
+    // ends first: a message that ended has all its bytes before writePos
+    uint64_t consumed = in->endsConsumed.load(std::memory_order_relaxed);
+    bool ending = in->ends.load(std::memory_order_acquire) != consumed;
+    uint64_t head = in->readPos.load(std::memory_order_relaxed);
+    uint64_t limit = ending ? in->endPos.load(std::memory_order_relaxed) : in->writePos.load(std::memory_order_acquire);
+
+    length = std::min<uint64_t>(length, limit - head);
+    if (length > 0) {
+        size_t offset = head & mask;
+        size_t first = std::min<size_t>(length, offer.ringSize - offset);
+        std::memcpy(data, inData + offset, first);
+        std::memcpy(data + first, inData, length - first);
+        in->readPos.store(head + length, std::memory_order_release);
+    }
+
+    messageEnd = ending && head + length == limit;
+    if (messageEnd) {
+        in->endsConsumed.store(consumed + 1, std::memory_order_release);
+    }
+
+    if (length > 0 || messageEnd) {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (in->writerWaiting.exchange(0)) {
+            doorbell = true;
+        }
+    }
+    return length;
+}
+
+void SharedMemoryChannel::requestDoorbell() {
+    in->readerWaiting.store(1);
+    out->writerWaiting.store(1);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+}
+
+bool SharedMemoryChannel::takeDoorbell() {
+    bool ring = doorbell;
+    doorbell = false;
+    return ring;
+}
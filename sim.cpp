@@ -0,0 +1,206 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <arpa/inet.h>
+#include "header/socket.hpp"
+#include "header/sim_network.hpp"
+#include "header/async.hpp"
+#include "header/logger.hpp"
+
+/**
+ * Seeded transfers over the in-memory SimNetwork, on virtual time.
+ *
+ * Every run sends SIZE bytes from a sender to a receiver through a network
+ * with the given impairments, run i using seed + i. Timeouts take no real
+ * time, so thousands of lossy transfers finish in seconds. The same options
+ * always print the same digest of every run's outcome.
+ */
+
+using namespace std;
+
+struct SimOptions {
+    ImpairmentProfile profile;
+    int runs = 1000;
+    uint32_t size = 64 * 1024;
+    bool selectiveRepeat = false;
+    int window = 0;  // 0: SegmentHandler's default
+    bool verbose = false;
+    // Retransmission warnings of every lossy run would drown the summary
+    LogLevel logLevel = LOG_LEVEL_ERROR;
+};
+
+struct SimRun {
+    bool ok = false;
+    int64_t transferUs = 0;   // Virtual time from the first SYN until the data is received
+    int64_t totalUs = 0;      // Until both sides are closed
+    uint64_t retransmits = 0;
+    ImpairmentDirection network;
+};
+
+static Task<void> sendSide(TCPSocket* socket, const vector<uint8_t>* data, bool* done) {
+    bool accepted = co_await socket->async_accept();
+    if (accepted) {
+        co_await socket->async_send((void*)data->data(), data->size());
+    }
+    co_await socket->async_close();
+    *done = true;
+}
+
+static Task<int32_t> receiveSide(TCPSocket* socket, struct sockaddr_in sender, vector<uint8_t>* buffer,
+                                 uint32_t length, SimNetwork* network, int64_t* transferUs) {
+    bool connected = co_await socket->async_connect(sender);
+    int32_t received = -1;
+    if (connected) {
+        received = co_await socket->async_recv(*buffer, length);
+    }
+    *transferUs = network->nowUs();
+    co_await socket->async_close();
+    co_return received;
+}
+
+static vector<uint8_t> runData(uint32_t size, uint64_t seed) {
+    vector<uint8_t> data(size);
+    uint64_t state = seed * 0x9E3779B97F4A7C15ull + 1;
+    for (uint8_t& byte : data) {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        byte = state;
+    }
+    return data;
+}
+
+static SimRun runOnce(const SimOptions& options, uint64_t seed) {
+    SimRun result;
+    ImpairmentProfile profile = options.profile;
+    profile.seed = seed;
+
+    SimNetwork network(profile);
+    {
+        TCPSocket sender("127.0.0.1", 5000, new SimTransport(network));
+        TCPSocket receiver("127.0.0.1", 5001, new SimTransport(network));
+        for (TCPSocket* socket : {&sender, &receiver}) {
+            socket->setSelectiveRepeat(options.selectiveRepeat);
+            if (options.window > 0) {
+                socket->setWindowSize(options.window);
+            }
+        }
+
+        vector<uint8_t> data = runData(options.size, seed);
+        vector<uint8_t> buffer;
+        bool senderDone = false;
+
+        spawn(sendSide(&sender, &data, &senderDone));
+        int32_t received = syncWait(receiveSide(&receiver, sender.createAddr("127.0.0.1", 5000), &buffer,
+                                                options.size, &network, &result.transferUs));
+        EventLoop::threadLoop().runUntil([&]() { return senderDone; });
+
+        result.ok = received == int32_t(options.size) && buffer == data;
+        result.totalUs = network.nowUs();
+        result.retransmits = sender.getStats().retransmits;
+    }
+    result.network = network.getTotals();
+    return result;
+}
+
+static double percentile(vector<int64_t> values, double fraction) {
+    if (values.empty()) {
+        return 0;
+    }
+    sort(values.begin(), values.end());
+    return values[min(values.size() - 1, size_t(fraction * values.size()))];
+}
+
+static void usage() {
+    cerr << "Usage: node_sim [--runs N] [--size BYTES] [--selective-repeat] [--window N] [--verbose] [--log-level LEVEL] [impairments]\n"
+         << ImpairmentProfile::OPTIONS_HELP
+         << "Run i uses seed + i, the digest only changes when an outcome does" << endl;
+}
+
+int main(int argc, char* argv[]) {
+    SimOptions options;
+    try {
+        for (int i = 1; i < argc; i++) {
+            string flag = argv[i];
+            if (flag == "--selective-repeat") {
+                options.selectiveRepeat = true;
+            } else if (flag == "--verbose") {
+                options.verbose = true;
+            } else if (i + 1 >= argc) {
+                throw invalid_argument(flag);
+            } else if (flag == "--runs") {
+                options.runs = stoi(argv[++i]);
+            } else if (flag == "--size") {
+                options.size = stoul(argv[++i]);
+            } else if (flag == "--log-level") {
+                if (!Logger::parseLevel(argv[++i], options.logLevel)) {
+                    throw invalid_argument(flag);
+                }
+            } else if (flag == "--window") {
+                options.window = stoi(argv[++i]);
+                if (options.window < 1 || options.window > 255) {
+                    throw invalid_argument(flag);
+                }
+            } else if (!options.profile.setOption(flag, argv[++i])) {
+                throw invalid_argument(flag);
+            }
+        }
+        if (options.runs < 1 || options.size < 1) {
+            throw invalid_argument("runs");
+        }
+    } catch (const exception&) {
+        usage();
+        return 1;
+    }
+
+    Logger::setLevel(options.logLevel);
+
+    auto start = chrono::steady_clock::now();
+    vector<int64_t> transferUs;
+    int failures = 0;
+    uint64_t retransmits = 0;
+    ImpairmentDirection network;
+    uint64_t digest = 0xcbf29ce484222325ull;  // FNV-1a over every run's outcome
+
+    for (int run = 0; run < options.runs; run++) {
+        uint64_t seed = options.profile.seed + run;
+        SimRun result = runOnce(options, seed);
+
+        transferUs.push_back(result.transferUs);
+        failures += !result.ok;
+        retransmits += result.retransmits;
+        network.received += result.network.received;
+        network.lost += result.network.lost;
+        network.duplicated += result.network.duplicated;
+        network.reordered += result.network.reordered;
+        network.queueDrops += result.network.queueDrops;
+
+        for (uint64_t value : {uint64_t(result.ok), uint64_t(result.transferUs), uint64_t(result.totalUs),
+                               result.retransmits, result.network.received}) {
+            digest = (digest ^ value) * 0x100000001b3ull;
+        }
+
+        if (options.verbose || !result.ok) {
+            cerr << "run " << run << " seed " << seed << ": " << (result.ok ? "ok" : "FAILED") << ", transfer "
+                 << result.transferUs / 1000.0 << " ms, closed after " << result.totalUs / 1000.0 << " ms, "
+                 << result.retransmits << " retransmits, " << result.network.lost << " lost" << endl;
+        }
+    }
+
+    double wallSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    double meanUs = 0;
+    for (int64_t us : transferUs) {
+        meanUs += us / double(transferUs.size());
+    }
+
+    cout << options.runs << " runs of " << options.size << " bytes, " << failures << " failed, "
+         << wallSeconds << " s wall clock\n"
+         << "virtual transfer time mean " << meanUs / 1000 << " ms, p50 " << percentile(transferUs, 0.5) / 1000
+         << " ms, p99 " << percentile(transferUs, 0.99) / 1000 << " ms, max " << percentile(transferUs, 1) / 1000 << " ms\n"
+         << "datagrams " << network.received << ", lost " << network.lost << ", duplicated " << network.duplicated
+         << ", reordered " << network.reordered << ", queue drops " << network.queueDrops << ", retransmits " << retransmits << "\n"
+         << "digest " << hex << digest << dec << endl;
+    return failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,217 @@
+#include "header/sim_network.hpp"
+#include <sys/eventfd.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <stdexcept>
+#include <algorithm>
+
+static uint64_t addressKey(const struct sockaddr_in& addr) {
+    return (uint64_t(addr.sin_addr.s_addr) << 16) | addr.sin_port;
+}
+
+SimNetwork::SimNetwork(const ImpairmentProfile& profile) :
+    loop(EventLoop::threadLoop()),
+    impairment(profile),
+    timerId(-1),
+    nextEphemeralPort(49152) {
+
+    loop.setVirtualTime(true);
+    timerId = loop.addTimer([this]() { deliver(); });
+}
+
+SimNetwork::~SimNetwork() {
+    loop.removeTimer(timerId);
+}
+
+bool SimNetwork::attach(SimTransport* transport, struct sockaddr_in& addr) {
+    if (addr.sin_port == 0) {
+        // Ephemeral ports in order, so a seed always gives the same addresses
+        do {
+            addr.sin_port = htons(nextEphemeralPort);
+            nextEphemeralPort = nextEphemeralPort == 65535 ? 49152 : nextEphemeralPort + 1;
+        } while (endpoints.count(addressKey(addr)));
+    }
+    return endpoints.emplace(addressKey(addr), transport).second;
+}
+
+void SimNetwork::detach(const struct sockaddr_in& addr) {
+    endpoints.erase(addressKey(addr));
+}
+
+void SimNetwork::send(const struct sockaddr_in& source, const struct sockaddr_in& dest, const uint8_t* data, uint32_t length) {
+    ImpairmentDirection& link = links[{addressKey(source), addressKey(dest)}];
+    link.name = "link";
+
+    Impairment::Packet packet = {};
+    packet.fd = -1;
+    packet.source = source;
+    packet.dest = dest;
+    packet.data.assign(data, data + length);
+    impairment.submit(link, loop.nowUs() * 1000, packet);
+
+    // Without delay a datagram arrives right away, like on loopback
+    deliver();
+}
+
+void SimNetwork::deliver() {
+    int64_t nowNs = loop.nowUs() * 1000;
+    Impairment::Packet packet;
+    while (impairment.take(nowNs, packet)) {
+        auto endpoint = endpoints.find(addressKey(packet.dest));
+        if (endpoint != endpoints.end()) {
+            packet.direction->forwarded++;
+            endpoint->second->deliver(std::move(packet.data), packet.source);
+        }
+    }
+
+    int64_t next = impairment.nextDue();
+    loop.armTimerUs(timerId, next < 0 ? 0 : std::max<int64_t>(1, (next - nowNs + 999) / 1000));
+}
+
+ImpairmentDirection SimNetwork::getTotals() const {
+    ImpairmentDirection totals;
+    totals.name = "network";
+    for (auto& entry : links) {
+        const ImpairmentDirection& link = entry.second;
+        totals.received += link.received;
+        totals.forwarded += link.forwarded;
+        totals.lost += link.lost;
+        totals.duplicated += link.duplicated;
+        totals.reordered += link.reordered;
+        totals.queueDrops += link.queueDrops;
+    }
+    return totals;
+}
+
+int64_t SimNetwork::nowUs() const {
+    return loop.nowUs();
+}
+
+SimTransport::SimTransport(SimNetwork& network) :
+    network(&network),
+    local{},
+    bound(false) {
+
+    readyFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (readyFd < 0) {
+        throw std::runtime_error("eventfd creation failed");
+    }
+}
+
+SimTransport::~SimTransport() {
+    close();
+}
+
+void SimTransport::clearReady() {
+    uint64_t count;
+    while (read(readyFd, &count, sizeof(count)) == sizeof(count)) {}
+}
+
+void SimTransport::deliver(std::vector<uint8_t>&& data, const struct sockaddr_in& addr) {
+    if (readyFd < 0) {
+        return;
+    }
+
+    queue.push_back({std::move(data), addr});
+    if (queue.size() == 1) {
+        uint64_t one = 1;
+        if (write(readyFd, &one, sizeof(one)) < 0) {
+            // Counter saturated, the descriptor is readable anyway
+        }
+    }
+}
+
+bool SimTransport::bind(const struct sockaddr_in& addr) {
+    if (bound || !network) {
+        return false;
+    }
+    local = addr;
+    bound = network->attach(this, local);
+    return bound;
+}
+
+bool SimTransport::sendSegment(const Segment& segment, const struct sockaddr_in& addr) {
+    if (!network) {
+        return false;
+    }
+    if (!bound) {
+        struct sockaddr_in any = {};
+        any.sin_family = AF_INET;
+        any.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (!bind(any)) {
+            return false;
+        }
+    }
+
+    uint8_t datagram[MAX_DATAGRAM_SIZE];
+    uint32_t length = encodeSegment(segment, datagram);
+    network->send(local, addr, datagram, length);
+    return true;
+}
+
+bool SimTransport::sendSegments(const Segment* segments, int count, const struct sockaddr_in& addr) {
+    for (int i = 0; i < count; i++) {
+        if (!sendSegment(segments[i], addr)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int32_t SimTransport::receiveSegment(Segment& segment, struct sockaddr_in& addr, int timeoutMs) {
+    EventLoop& loop = EventLoop::threadLoop();
+    int64_t deadline = loop.nowUs() + int64_t(timeoutMs) * 1000;
+    while (queue.empty()) {
+        if (!network || timeoutMs == 0) {
+            return 0;
+        }
+
+        int waitMs = -1;
+        if (timeoutMs > 0) {
+            int64_t remaining = (deadline - loop.nowUs()) / 1000;
+            if (remaining <= 0) {
+                return 0;
+            }
+            waitMs = remaining;
+        }
+        if (loop.runOnce(waitMs) < 0) {
+            return -1;
+        }
+    }
+
+    current = std::move(queue.front());
+    queue.pop_front();
+    if (queue.empty()) {
+        clearReady();
+    }
+
+    addr = current.addr;
+    if (!decodeSegment(current.data.data(), current.data.size(), segment)) {
+        return -1;
+    }
+    return current.data.size();
+}
+
+void SimTransport::close() {
+    if (readyFd < 0) {
+        return;
+    }
+
+    if (bound) {
+        network->detach(local);
+        bound = false;
+    }
+    network = nullptr;
+    queue.clear();
+
+    ::close(readyFd);
+    readyFd = -1;
+}
+
+int SimTransport::fd() const {
+    return -1;
+}
+
+int SimTransport::pollFd() const {
+    return readyFd;
+}
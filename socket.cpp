@@ -1,103 +1,105 @@
 #include "header/socket.hpp"
-#include "header/color.hpp"
+#include "header/logger.hpp"
 #include <sys/types.h>
 #include <netinet/in.h>
+#include <netinet/udp.h>
 #include <arpa/inet.h>
 #include <unistd.h>
 #include <errno.h>
 #include <cstring>
-#include <iostream>
-#include <chrono>
-#include <thread>
+#include <algorithm>
+
+const int TCPSocket::RETRANSMIT_TIMEOUT_MS;
+const int TCPSocket::MAX_HANDSHAKE_RETRIES;
+const int TCPSocket::CLOSE_TIMEOUT_MS;
+const int TCPSocket::SHARED_MEMORY_POLL_MS;
 
 // helper methods
-void TCPSocket::setTimeout(int seconds) {
-    struct timeval tv;
-    tv.tv_sec = seconds;
-    tv.tv_usec = 0;
-    setsockopt(socket, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+bool TCPSocket::sendSegment(const Segment& segment, const struct sockaddr_in& addr, TraceEvent event) {
+    if (!transport->sendSegment(segment, addr)) {
+        return false;
+    }
+    stats.segmentsSent++;
+    stats.bytesSent += segment.payloadSize;
+    traceSegment(event, segment);
+    return true;
 }
 
-bool TCPSocket::sendSegment(const Segment& segment, const struct sockaddr_in& addr) {
-    // Send header first
-    ssize_t headerSent = sendto(socket, &segment, sizeof(Segment), 0, 
-                               (struct sockaddr*)&addr, sizeof(addr));
-    
-    if (headerSent < 0) {  // Add error check
+bool TCPSocket::sendSegments(const Segment* segments, int count, const struct sockaddr_in& addr, int retransmitted) {
+    if (!transport->sendSegments(segments, count, addr)) {
         return false;
     }
-
-    // Send payload if exists
-    if (segment.payload && segment.payloadSize > 0) {
-        usleep(1000);  // Small delay for reliability
-        
-        ssize_t payloadSent = sendto(socket, segment.payload, segment.payloadSize, 0,
-                                    (struct sockaddr*)&addr, sizeof(addr));
-                                    
-        if (payloadSent < 0) {
-            return false;
-        }
+    stats.segmentsSent += count;
+    for (int i = 0; i < count; i++) {
+        stats.bytesSent += segments[i].payloadSize;
+        traceSegment(i < retransmitted ? TRACE_RETRANSMIT : TRACE_SEND, segments[i]);
     }
-    
     return true;
 }
 
-int32_t TCPSocket::receiveSegment(Segment& segment, struct sockaddr_in& addr) {
-    socklen_t addrLen = sizeof(addr);
-    
-    // Clear timeout
-    struct timeval tv = {0, 0};
-    setsockopt(socket, SOL_SOCKET, SO_RCVTIMEO, (const char*)&tv, sizeof tv);
-
-    // Receive header
-    int32_t headerBytes = recvfrom(socket, &segment, sizeof(Segment), 0,
-                                 (struct sockaddr*)&addr, &addrLen);
-    
-    if (headerBytes <= 0) {
-        return headerBytes;
+int32_t TCPSocket::receiveSegment(Segment& segment, struct sockaddr_in& addr, int timeoutMs) {
+    int32_t bytes = transport->receiveSegment(segment, addr, timeoutMs);
+    if (bytes <= 0) {
+        return bytes;
     }
+    stats.segmentsReceived++;
+    stats.bytesReceived += segment.payloadSize;
 
     if (peerAddrSet) {
         memcpy(&addr, &peerAddr, sizeof(struct sockaddr_in));
     }
-
-    // If payload exists, receive it 
-    if (segment.payloadSize > 0) {
-        segment.payload = new uint8_t[segment.payloadSize];
-        
-        // Set timeout for payload
-        tv.tv_sec = 1;
-        setsockopt(socket, SOL_SOCKET, SO_RCVTIMEO, (const char*)&tv, sizeof tv);
-       
-        int32_t payloadBytes = recvfrom(socket, segment.payload, segment.payloadSize, 0,
-                                          (struct sockaddr*)&addr, &addrLen);
-            
-        if (payloadBytes > 0) {
-            return headerBytes + payloadBytes;
-        }
-
-        delete[] segment.payload;
-        segment.payload = nullptr;
-        return -1;
-    }
     
-    return headerBytes;
+    return bytes;
 }
 
-TCPSocket::TCPSocket(string ip, int32_t port) : 
+TCPSocket::TCPSocket(string ip, int32_t port, TransportType transportType) :
+    TCPSocket(ip, port, createTransport(transportType)) {}
+
+TCPSocket::TCPSocket(string ip, int32_t port, Transport* transport) : 
     ip(ip), 
     port(port),
+    transport(transport),
     status(CLOSED),
-    peerAddrSet(false) {  // Initialize peerAddrSet
+    trace(nullptr),
+    peerAddrSet(false),  // Initialize peerAddrSet
+    loop(EventLoop::threadLoop()),
+    watchId(-1),
+    timerId(-1),
+    retries(0),
+    expectedSeqNum(0),
+    sharedMemoryEnabled(false),
+    sharedMemory(nullptr),
+    closing(false),
+    closeDeadlineUs(0) {
     
+    stateSinceUs = loop.nowUs();
     segmentHandler = new SegmentHandler();
     memset(&peerAddr, 0, sizeof(peerAddr));  // Initialize peerAddr
-    
-    socket = ::socket(AF_INET, SOCK_DGRAM, 0);
-    if (socket < 0) {
-        delete segmentHandler;
-        throw runtime_error("Socket creation failed");
-    }
+
+    // Zerocopy sends keep acknowledged payloads alive until the kernel is done
+    transport->onPayloadPinned = [this](uint8_t* payload) { segmentHandler->pinPayload(payload); };
+    transport->onPayloadReleased = [this](uint8_t* payload) { segmentHandler->unpinPayload(payload); };
+
+    handshakeOp.active = false;
+    sendOp.active = false;
+    sendOp.slotsFreed = false;
+    sendOp.rewindPending = false;
+    sendOp.timerRunning = false;
+    sendOp.stream = nullptr;
+    sendOp.streamWatchId = -1;
+    sendOp.pending = nullptr;
+    sendOp.pendingSize = 0;
+    sendOp.ended = false;
+    sendOp.sharedConsumed = 0;
+    recvOp.active = false;
+    recvOp.stream = nullptr;
+
+    stats.cwnd = segmentHandler->getWindowSize();
+    stats.rwnd = segmentHandler->getWindowSize();
+
+    // Retransmission timeouts are delivered by the thread's event loop, segments
+    // only while an operation is running (see updateWatch)
+    timerId = loop.addTimer([this]() { onTimer(); });
 }
 
 TCPSocket::~TCPSocket() {
@@ -105,304 +107,1162 @@ TCPSocket::~TCPSocket() {
         close();  // Ensure proper connection closure
     }
 
+    detach();
+    releaseSharedMemory();
+    transport->close();
+    delete transport;
     delete segmentHandler;
-    ::close(socket);
 }
 
-struct sockaddr_in TCPSocket::createAddr(string ip, int32_t port) {
+struct sockaddr_in TCPSocket::createAddr(const string& ip, int32_t port) {
     struct sockaddr_in addr = {};
     addr.sin_family = AF_INET;
     addr.sin_port = htons(port);
-    if (ip == "localhost") {
-        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);  // Force 127.0.0.1
-    } else {
-        addr.sin_addr.s_addr = inet_addr(ip.c_str());
+    // inet_pton, unlike inet_addr, does not turn a bad address into 255.255.255.255
+    if (inet_pton(AF_INET, ip == "localhost" ? "127.0.0.1" : ip.c_str(), &addr.sin_addr) != 1) {
+        throw runtime_error("Invalid IPv4 address: " + ip);
     }
     return addr;
 }
 
-bool TCPSocket::doHandshake(struct sockaddr_in& destAddr) {
-    if (status == LISTEN) {
+void TCPSocket::setGso(bool enabled) {
+    transport->setGso(enabled);
+}
+
+void TCPSocket::setGro(bool enabled) {
+    transport->setGro(enabled);
+}
+
+void TCPSocket::setZeroCopy(bool enabled) {
+    transport->setZeroCopy(enabled);
+}
+
+void TCPSocket::setSharedMemory(bool enabled) {
+    sharedMemoryEnabled = enabled;
+}
+
+void TCPSocket::setStatus(TCPStatusEnum next) {
+    int64_t nowUs = loop.nowUs();
+    stats.stateSeconds[status + 1] += (nowUs - stateSinceUs) / 1e6;
+    stateSinceUs = nowUs;
+    status = next;
+    if (trace) {
+        trace->record(TRACE_STATE, ntohs(peerAddr.sin_port), status, 0, 0, 0, stats.rwnd, stats.cwnd);
+    }
+}
+
+void TCPSocket::traceSegment(TraceEvent event, const Segment& segment) {
+    if (trace) {
+        trace->record(event, ntohs(peerAddr.sin_port), status, segment.seqNum, segment.ackNum,
+                      segment.payloadSize, stats.rwnd, stats.cwnd);
+    }
+}
+
+void TCPSocket::setTrace(PacketTrace* trace) {
+    this->trace = trace;
+}
+
+ConnectionStats TCPSocket::getStats() const {
+    ConnectionStats snapshot = stats;
+    snapshot.retransmits = segmentHandler->getRetransmits();
+    snapshot.stateSeconds[status + 1] += (loop.nowUs() - stateSinceUs) / 1e6;
+    return snapshot;
+}
+
+void TCPSocket::setSelectiveRepeat(bool enabled) {
+    segmentHandler->setMode(enabled ? SELECTIVE_REPEAT : GO_BACK_N);
+}
+
+void TCPSocket::setWindowSize(uint8_t segments) {
+    segmentHandler->setWindowSize(segments);
+    stats.cwnd = segments;
+    stats.rwnd = segments;
+}
+
+void TCPSocket::detach() {
+    if (watchId >= 0) {
+        loop.unwatch(watchId);
+        watchId = -1;
+    }
+    if (timerId >= 0) {
+        loop.removeTimer(timerId);
+        timerId = -1;
+    }
+}
+
+bool TCPSocket::isBusy() const {
+    return handshakeOp.active || sendOp.active || recvOp.active || closing;
+}
+
+void TCPSocket::updateWatch() {
+    // Segments arriving between operations stay queued in the transport, like
+    // they did with blocking reads, instead of being handled by the wrong state
+    if (isBusy() && watchId < 0 && timerId >= 0) {
+        watchId = loop.watch(transport->pollFd(), [this]() { onReadable(); });
+    } else if (!isBusy() && watchId >= 0) {
+        loop.unwatch(watchId);
+        watchId = -1;
+    }
+}
+
+void TCPSocket::armTimer(int timeoutMs) {
+    if (timerId >= 0) {
+        loop.armTimer(timerId, timeoutMs);
+    }
+}
+
+void TCPSocket::armRetransmitTimer() {
+    // Selective Repeat: one timerfd, armed for the earliest segment deadline
+    int64_t deadline = segmentHandler->nextDeadline();
+    armTimer(deadline < 0 ? 0 : std::max<int64_t>(1, (deadline - loop.nowUs() + 999) / 1000));
+}
+
+void TCPSocket::retransmitExpired(int64_t nowUs) {
+    int64_t newDeadline = loop.nowUs() + RETRANSMIT_TIMEOUT_MS * 1000;
+    for (Segment* segment : segmentHandler->expiredSegments(nowUs, newDeadline)) {
+        if (sendSegment(*segment, peerAddr, TRACE_RETRANSMIT)) {
+            LOG_PACKET(Color::RED << "[!]" << Color::RESET << " [Established] [Seg " << segment->seqNum / SegmentHandler::MAX_SEGMENT_SIZE + 1 
+                 << "] [S=" << segment->seqNum << "] Retransmitted");
+        }
+    }
+    armRetransmitTimer();
+}
+
+void TCPSocket::onReadable() {
+    // Drain the transport until it is empty or the running operation is done
+    while (isBusy()) {
         Segment segment;
-        while (status != ESTABLISHED) {
-            int32_t bytes = receiveSegment(segment, destAddr);
-            if (bytes <= 0) continue;
-
-            if (segment.flags.syn) {
-                peerAddr = destAddr;
-                peerAddrSet = true;
-
-                cout << Color::YELLOW << "[i]" << Color::RESET << " [Handshake] [S=" << segment.seqNum << "] Received SYN Request from " 
-                     << inet_ntoa(peerAddr.sin_addr) << ":" << ntohs(peerAddr.sin_port) << endl;
-
-                Segment synAck = syn(generateSecureSequenceNumber());
-                synAck.flags.ack = 1;
-                synAck.ackNum = segment.seqNum + 1;
-
-                if (sendSegment(synAck, peerAddr)) {
-                    status = SYN_RECEIVED;
-                    cout << Color::YELLOW << "[i]" << Color::RESET << " [Handshake] [S=" << synAck.seqNum << "] [A=" << synAck.ackNum 
-                         << "] Sending SYN-ACK Request to " << inet_ntoa(peerAddr.sin_addr) 
-                         << ":" << ntohs(peerAddr.sin_port) << endl;
-                }
-            } else if (status == SYN_RECEIVED && segment.flags.ack) {
-                cout << Color::GREEN << "[+]" << Color::RESET << " [Handshake] Received ACK Request from " 
-                     << inet_ntoa(peerAddr.sin_addr) << ":" << ntohs(peerAddr.sin_port) << endl;
-                status = ESTABLISHED;
+        struct sockaddr_in addr;
+        int32_t bytes = receiveSegment(segment, addr, 0);
+        if (bytes <= 0) {
+            break;
+        }
+        handleSegment(segment, addr);
+    }
+
+    // Every ACK of this batch is processed, hand the freed window slots to the TX stage at once
+    if (sendOp.slotsFreed) {
+        transmitPending();
+    }
+}
+
+void TCPSocket::handleSegment(const Segment& segment, struct sockaddr_in& addr) {
+    switch (status) {
+    case LISTEN:
+        if (segment.flags.syn) {
+            peerAddr = addr;
+            peerAddrSet = true;
+
+            LOG_INFO(Color::YELLOW << "[i]" << Color::RESET << " [Handshake] [S=" << segment.seqNum << "] Received SYN Request from " 
+                 << inet_ntoa(peerAddr.sin_addr) << ":" << ntohs(peerAddr.sin_port));
+
+            handshakeSegment = syn(generateSecureSequenceNumber());
+            handshakeSegment.flags.ack = 1;
+            handshakeSegment.ackNum = segment.seqNum + 1;
+            handshakeSegment = updateChecksum(handshakeSegment);
+            acceptSharedMemory(segment);
+
+            if (sendSegment(handshakeSegment, peerAddr)) {
+                setStatus(SYN_RECEIVED);
+                retries = 0;
+                armTimer(RETRANSMIT_TIMEOUT_MS);
+                LOG_INFO(Color::YELLOW << "[i]" << Color::RESET << " [Handshake] [S=" << handshakeSegment.seqNum << "] [A=" << handshakeSegment.ackNum 
+                     << "] Sending SYN-ACK Request to " << inet_ntoa(peerAddr.sin_addr) 
+                     << ":" << ntohs(peerAddr.sin_port));
+            }
+        }
+        break;
+
+    case SYN_RECEIVED:
+        if (segment.flags.syn) {
+            // Our SYN-ACK was lost, the peer retried its SYN
+            sendSegment(handshakeSegment, peerAddr);
+        } else if (segment.flags.ack) {
+            LOG_INFO(Color::GREEN << "[+]" << Color::RESET << " [Handshake] Received ACK Request from " 
+                 << inet_ntoa(peerAddr.sin_addr) << ":" << ntohs(peerAddr.sin_port));
+            setStatus(ESTABLISHED);
+            armTimer(0);
+            if (sharedMemory) {
+                LOG_INFO(Color::GREEN << "[+]" << Color::RESET << " [Handshake] Data goes through shared memory");
+            }
+            finishHandshake(true);
+        }
+        break;
+
+    case SYN_SENT:
+        if (segment.flags.syn && segment.flags.ack) {
+            LOG_INFO(Color::GREEN << "[+]" << Color::RESET << " [Handshake] [S=" << segment.seqNum << "] [A=" << segment.ackNum 
+                 << "] Received SYN-ACK Request from " << inet_ntoa(peerAddr.sin_addr) 
+                 << ":" << ntohs(peerAddr.sin_port));
+
+            confirmSharedMemory(segment);
+            handshakeSegment = ::ack(segment.ackNum, segment.seqNum + 1);
+            if (sendSegment(handshakeSegment, peerAddr)) {
+                setStatus(ESTABLISHED);
+                armTimer(0);
+                LOG_INFO(Color::YELLOW << "[i]" << Color::RESET << " [Handshake] [A=" << segment.seqNum + 1 
+                     << "] Sending ACK Request to " << inet_ntoa(peerAddr.sin_addr) 
+                     << ":" << ntohs(peerAddr.sin_port));
+                finishHandshake(true);
+            }
+        }
+        break;
+
+    case ESTABLISHED:
+        // Data segments carry no meaningful flags, look at the payload first
+        if (sharedMemory && segment.flags.psh) {
+            // Doorbell: the peer moved data or space in the rings
+            pumpSharedMemory();
+        } else if (recvOp.active && segment.payloadSize > 0) {
+            handleData(segment);
+        } else if (segment.flags.fin) {
+            handleFin();
+        } else if (segment.flags.syn && segment.flags.ack) {
+            // Our handshake ACK was lost, repeat it
+            sendSegment(handshakeSegment, peerAddr);
+        } else if (sendOp.active && segment.flags.ack) {
+            if (isValidChecksum(segment)) {
+                handleAckSegment(segment);
+            } else {
+                stats.checksumFailures++;
+                traceSegment(TRACE_DROP, segment);
+            }
+        }
+        break;
+
+    case FIN_WAIT_1:
+        if (segment.payloadSize > 0) {
+            // The ACK of our last segment was lost, the peer is still retransmitting
+            sendSegment(ack(segment.seqNum, expectedSeqNum), peerAddr);
+        } else if (segment.flags.fin && !segment.flags.ack) {
+            // Simultaneous close, both sides answer the other's FIN and wait for the FIN-ACK
+            sendSegment(finAck(), peerAddr);
+        } else if (segment.flags.fin && segment.flags.ack) {
+            LOG_INFO(Color::GREEN << "[+]" << Color::RESET << " [Closing] Received FIN-ACK request from "
+                 << inet_ntoa(peerAddr.sin_addr) << ":" 
+                 << ntohs(peerAddr.sin_port));
+            
+            setStatus(TIME_WAIT);
+            
+            Segment ackSegment = ack(segment.seqNum + 1, segment.seqNum);
+            if (sendSegment(ackSegment, peerAddr)) {
+                LOG_INFO(Color::YELLOW << "[i]" << Color::RESET << " [Closing] Sending ACK request to "
+                     << inet_ntoa(peerAddr.sin_addr) << ":" 
+                     << ntohs(peerAddr.sin_port));
             }
+            finishClose();
         }
+        break;
+
+    case CLOSE_WAIT:
+        if (segment.flags.fin) {
+            // Our FIN-ACK was lost, the peer retried its FIN
+            sendSegment(finAck(), peerAddr);
+        } else if (closing && segment.flags.ack) {
+            LOG_INFO(Color::GREEN << "[+]" << Color::RESET << " [Closing] Received final ACK from "
+                 << inet_ntoa(peerAddr.sin_addr) << ":" 
+                 << ntohs(peerAddr.sin_port));
+            finishClose();
+        }
+        break;
+
+    default:
+        break;
     }
-    
-    else if (status == CLOSED) {
-        peerAddr = destAddr; 
-        peerAddrSet = true;
-        
-        //initiate handshake
-        Segment synSegment = syn(generateSecureSequenceNumber());
-        if (!sendSegment(synSegment, peerAddr)) {
-            cout << Color::RED << "[!]" << Color::RESET << " Failed to send SYN" << endl;
-            return false;
+}
+
+void TCPSocket::handleFin() {
+    LOG_INFO(Color::YELLOW << "[i]" << Color::RESET << " [Closing] Received FIN request from "
+         << inet_ntoa(peerAddr.sin_addr) << ":"
+         << ntohs(peerAddr.sin_port));
+
+    Segment finAckSegment = finAck();
+    if (!sendSegment(finAckSegment, peerAddr)) {
+        return;
+    }
+
+    LOG_INFO(Color::YELLOW << "[i]" << Color::RESET << " [Closing] Sending FIN-ACK request to "
+         << inet_ntoa(peerAddr.sin_addr) << ":"
+         << ntohs(peerAddr.sin_port));
+
+    // A receiver that has all its data only waits for the last ACK, a sender still has to close
+    if (recvOp.active) {
+        setStatus(LAST_ACK);
+        // Selective Repeat acknowledges segments before the reader has room for
+        // them, those still have to be delivered (onStreamSpace)
+        if (reorderBuffer.find(expectedSeqNum) == reorderBuffer.end()) {
+            finishRecv();
+        }
+    } else {
+        setStatus(CLOSE_WAIT);
+        if (sendOp.active) {
+            finishSend();
         }
+    }
+}
 
-        cout << Color::YELLOW << "[i]" << Color::RESET << " [Handshake] [S=" << synSegment.seqNum << "] Sending SYN request to " 
-             << inet_ntoa(peerAddr.sin_addr) << ":" << ntohs(peerAddr.sin_port) << endl;
-        status = SYN_SENT;
+void TCPSocket::onTimer() {
+    int64_t nowUs = loop.nowUs();
 
-        // Wait for SYN-ACK and send ACK
-        Segment segment;
-        while (status != ESTABLISHED) {
-            int32_t bytes = receiveSegment(segment, destAddr);
-            if (bytes <= 0) continue;
-
-            if (segment.flags.syn && segment.flags.ack) {
-                cout << Color::GREEN << "[+]" << Color::RESET << " [Handshake] [S=" << segment.seqNum << "] [A=" << segment.ackNum 
-                     << "] Received SYN-ACK Request from " << inet_ntoa(peerAddr.sin_addr) 
-                     << ":" << ntohs(peerAddr.sin_port) << endl;
-
-                Segment ack = ::ack(segment.ackNum, segment.seqNum + 1);
-                if (sendSegment(ack, destAddr)) {
-                    status = ESTABLISHED;
-                    cout << Color::YELLOW << "[i]" << Color::RESET << " [Handshake] [A=" << segment.seqNum + 1 
-                         << "] Sending ACK Request to " << inet_ntoa(peerAddr.sin_addr) 
-                         << ":" << ntohs(peerAddr.sin_port) << endl;
-                }
+    switch (status) {
+    case SYN_SENT:
+    case SYN_RECEIVED:
+        if (++retries > MAX_HANDSHAKE_RETRIES) {
+            LOG_WARN(Color::RED << "[!]" << Color::RESET << " [Handshake] No response from "
+                 << inet_ntoa(peerAddr.sin_addr) << ":" << ntohs(peerAddr.sin_port));
+            // A passive side goes back to waiting for a new SYN
+            setStatus(status == SYN_SENT ? CLOSED : LISTEN);
+            releaseSharedMemory();
+            if (status == CLOSED) {
+                finishHandshake(false);
             }
+            return;
         }
+        sendSegment(handshakeSegment, peerAddr);
+        armTimer(RETRANSMIT_TIMEOUT_MS);
+        break;
+
+    case ESTABLISHED:
+        if (sharedMemory) {
+            pumpSharedMemory();
+        } else if (sendOp.active && segmentHandler->getMode() == SELECTIVE_REPEAT) {
+            // Selective Repeat: only the segments whose own timer expired go out again
+            retransmitExpired(nowUs);
+        } else if (sendOp.active) {
+            // Go-Back-N: nothing acknowledged in time, send the unacknowledged part of the window again
+            LOG_WARN(Color::RED << "[!]" << Color::RESET << " [Established] ACK timeout, retransmitting window");
+            sendOp.timerRunning = false;
+            segmentHandler->rewind();
+            transmitPending();
+        }
+        break;
+
+    case FIN_WAIT_1:
+    case CLOSE_WAIT:
+        if (nowUs >= closeDeadlineUs) {
+            finishClose();
+        } else if (status == FIN_WAIT_1) {
+            sendSegment(fin(), peerAddr);
+            armTimer(RETRANSMIT_TIMEOUT_MS);
+        } else {
+            armTimer((closeDeadlineUs - nowUs) / 1000 + 1);
+        }
+        break;
+
+    default:
+        break;
     }
+}
+
+void TCPSocket::startHandshake(const struct sockaddr_in& destAddr, std::function<void(bool)> onDone) {
+    handshakeOp.active = true;
+    handshakeOp.onDone = onDone;
+    updateWatch();
+
+    if (status == LISTEN) {
+        onReadable();
+        return;
+    }
+
+    if (status != CLOSED) {
+        finishHandshake(status == ESTABLISHED);
+        return;
+    }
+
+    peerAddr = destAddr; 
+    peerAddrSet = true;
+    
+    //initiate handshake
+    handshakeSegment = syn(generateSecureSequenceNumber());
+    offerSharedMemory();
+    if (!sendSegment(handshakeSegment, peerAddr)) {
+        LOG_ERROR(Color::RED << "[!]" << Color::RESET << " Failed to send SYN");
+        releaseSharedMemory();
+        finishHandshake(false);
+        return;
+    }
+
+    LOG_INFO(Color::YELLOW << "[i]" << Color::RESET << " [Handshake] [S=" << handshakeSegment.seqNum << "] Sending SYN request to " 
+         << inet_ntoa(peerAddr.sin_addr) << ":" << ntohs(peerAddr.sin_port));
+    setStatus(SYN_SENT);
+    retries = 0;
+    armTimer(RETRANSMIT_TIMEOUT_MS);
+    onReadable();
+}
+
+void TCPSocket::finishHandshake(bool established) {
+    if (!handshakeOp.active) {
+        return;
+    }
+    handshakeOp.active = false;
+    updateWatch();
+
+    std::function<void(bool)> onDone = std::move(handshakeOp.onDone);
+    if (onDone) {
+        onDone(established);
+    }
+}
+
+bool TCPSocket::doHandshake(struct sockaddr_in& destAddr) {
+    bool done = false;
+    bool established = false;
+    startHandshake(destAddr, [&](bool result) {
+        established = result;
+        done = true;
+    });
+    loop.runUntil([&]() { return done; });
 
-    return status == ESTABLISHED;
+    if (established) {
+        destAddr = peerAddr;
+    }
+    return established;
 }
 
 void TCPSocket::listen() {
     struct sockaddr_in addr = createAddr(ip, port);
-    if (bind(socket, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+    if (!transport->bind(addr)) {
         throw runtime_error("Bind failed");
     }
-    status = LISTEN;
+    setStatus(LISTEN);
 }
 
-void TCPSocket::send(string destIp, int32_t destPort, void* dataStream, uint32_t dataSize) { 
+void TCPSocket::startSend(void* dataStream, uint32_t dataSize, std::function<void()> onDone) { 
     if (!peerAddrSet) {
-        cerr << Color::RED << "[!]" << Color::RESET << " No established connection" << endl;
+        LOG_ERROR(Color::RED << "[!]" << Color::RESET << " No established connection");
+        if (onDone) {
+            onDone();
+        }
+        return;
+    }
+
+    LOG_INFO(Color::YELLOW << "[i]" << Color::RESET << " Sending input to " << inet_ntoa(peerAddr.sin_addr) 
+         << ":" << ntohs(peerAddr.sin_port));
+
+    if (sharedMemory) {
+        sendOp.active = true;
+        sendOp.pending = (const uint8_t*)dataStream;
+        sendOp.pendingSize = dataSize;
+        sendOp.ended = false;
+        sendOp.onDone = onDone;
+        updateWatch();
+        pumpSharedMemory();
         return;
     }
-  
+
     segmentHandler->setDataStream((uint8_t*)dataStream, dataSize);
-    cout << Color::YELLOW << "[i]" << Color::RESET << " Sending input to " << inet_ntoa(peerAddr.sin_addr) 
-         << ":" << ntohs(peerAddr.sin_port) << endl;
-
-    int helper = 0;
-    while (status == ESTABLISHED) {
-        Segment* segments = segmentHandler->advanceWindow(segmentHandler->getWindowSize(), helper);
-        helper++;
-        // Segment* segments = segmentHandler->advanceWindow(segmentHandler->segmentBuffer.size());
-        if (!segments) {
+    sendOp.active = true;
+    sendOp.slotsFreed = true;
+    sendOp.onDone = onDone;
+    updateWatch();
+    transmitPending();
+
+    // ACKs that arrived before the send started
+    onReadable();
+}
+
+void TCPSocket::startSendStream(StreamChannel& channel, std::function<void()> onDone) {
+    if (!peerAddrSet) {
+        LOG_ERROR(Color::RED << "[!]" << Color::RESET << " No established connection");
+        if (onDone) {
+            onDone();
+        }
+        return;
+    }
+
+    LOG_INFO(Color::YELLOW << "[i]" << Color::RESET << " Streaming input to " << inet_ntoa(peerAddr.sin_addr) 
+         << ":" << ntohs(peerAddr.sin_port));
+
+    sendOp.active = true;
+    sendOp.slotsFreed = true;
+    sendOp.stream = &channel;
+    sendOp.onDone = onDone;
+    sendOp.streamWatchId = loop.watch(channel.getDataFd(), [this]() { onStreamData(); });
+    if (sharedMemory) {
+        sendOp.ended = false;
+        sendOp.sharedConsumed = sharedMemory->getConsumed();
+        updateWatch();
+        pumpSharedMemory();
+        return;
+    }
+    segmentHandler->setDataSource(&channel.getRing());
+    updateWatch();
+    onStreamData();
+
+    // ACKs that arrived before the send started
+    onReadable();
+}
+
+void TCPSocket::onStreamData() {
+    // The writer published bytes or closed the stream: cut what fits in the window
+    sendOp.stream->acknowledgeData();
+    if (sharedMemory) {
+        pumpSharedMemory();
+        return;
+    }
+    segmentHandler->pullSegments();
+    sendOp.stream->consumed();
+
+    if (segmentHandler->isComplete()) {
+        finishSend();
+        return;
+    }
+    transmitPending();
+}
+
+void TCPSocket::offerSharedMemory() {
+    // A same-host peer finds the rings in the SYN, one that does not know
+    // them ignores the payload and the connection stays on segments
+    releaseSharedMemory();
+    if (!sharedMemoryEnabled || !isSameHost(peerAddr)) {
+        return;
+    }
+
+    try {
+        sharedMemory = new SharedMemoryChannel();
+    } catch (const std::runtime_error& e) {
+        LOG_WARN(Color::RED << "[!]" << Color::RESET << " [Handshake] No shared memory: " << e.what());
+        return;
+    }
+    handshakeSegment.payload = (uint8_t*)&sharedMemory->getOffer();
+    handshakeSegment.payloadSize = sizeof(SharedMemoryOffer);
+    handshakeSegment = updateChecksum(handshakeSegment);
+}
+
+void TCPSocket::acceptSharedMemory(const Segment& synSegment) {
+    releaseSharedMemory();
+    if (!sharedMemoryEnabled || !isSharedMemoryOffer(synSegment) || !isValidChecksum(synSegment) || !isSameHost(peerAddr)) {
+        return;
+    }
+
+    SharedMemoryOffer offer;
+    memcpy(&offer, synSegment.payload, sizeof(offer));
+    try {
+        sharedMemory = new SharedMemoryChannel(offer);
+    } catch (const std::runtime_error& e) {
+        LOG_WARN(Color::RED << "[!]" << Color::RESET << " [Handshake] Shared memory offer declined: " << e.what());
+        return;
+    }
+
+    // Echoing the offer in the SYN-ACK accepts it
+    handshakeSegment.payload = (uint8_t*)&sharedMemory->getOffer();
+    handshakeSegment.payloadSize = sizeof(SharedMemoryOffer);
+    handshakeSegment = updateChecksum(handshakeSegment);
+}
+
+void TCPSocket::confirmSharedMemory(const Segment& synAckSegment) {
+    if (!sharedMemory) {
+        return;
+    }
+
+    SharedMemoryOffer echoed = {};
+    if (isSharedMemoryOffer(synAckSegment)) {
+        memcpy(&echoed, synAckSegment.payload, sizeof(echoed));
+    }
+    if (echoed.token != sharedMemory->getOffer().token) {
+        LOG_INFO(Color::YELLOW << "[i]" << Color::RESET << " [Handshake] Peer declined shared memory, sending segments");
+        releaseSharedMemory();
+        return;
+    }
+    LOG_INFO(Color::GREEN << "[+]" << Color::RESET << " [Handshake] Data goes through shared memory");
+}
+
+void TCPSocket::releaseSharedMemory() {
+    delete sharedMemory;
+    sharedMemory = nullptr;
+}
+
+void TCPSocket::pumpSharedMemory() {
+    // Move bytes both ways until neither direction can, then wait for the
+    // doorbell. It is requested before one last look, so whatever the peer
+    // does in between is either seen here or rung.
+    bool waiting = false;
+    while (sharedMemory && (sendOp.active || recvOp.active)) {
+        bool moved = sendOp.active && pumpSharedSend();
+        moved = (recvOp.active && sharedMemory && pumpSharedRecv()) || moved;
+        if (moved) {
+            waiting = false;
+        } else if (!waiting && sharedMemory) {
+            sharedMemory->requestDoorbell();
+            waiting = true;
+        } else {
             break;
         }
+    }
 
-        // Get actual window size
-        uint8_t actualWindowSize = segmentHandler->getWindowSize();
+    if (sharedMemory && sharedMemory->takeDoorbell()) {
+        Segment doorbell = {};
+        doorbell.flags.psh = 1;
+        doorbell.data_offset = 5;
+        sendSegment(updateChecksum(doorbell), peerAddr);
+    }
+    if (sharedMemory && (sendOp.active || recvOp.active)) {
+        armTimer(SHARED_MEMORY_POLL_MS);
+    }
+}
 
-        // Send all segments first
-        for (int i = 0; i < actualWindowSize; i++) {
-            if (sendSegment(segments[i], peerAddr)) {
-                cout << Color::YELLOW << "[i]" << Color::RESET << " [Established] [Seg " << i+1 
-                     << "] [S=" << segments[i].seqNum << "] Sent" << endl;
+bool TCPSocket::pumpSharedSend() {
+    size_t moved = 0;
+    bool ended = false;
+    if (!sendOp.ended) {
+        if (sendOp.stream) {
+            ByteRing& ring = sendOp.stream->getRing();
+            if (sharedBounce.empty()) {
+                sharedBounce.resize(1 << 18);
+            }
+            size_t length = std::min({ring.readable(), sharedMemory->writable(), sharedBounce.size()});
+            if (length > 0) {
+                moved = ring.read(sharedBounce.data(), length);
+                sharedMemory->write(sharedBounce.data(), moved);
+                sendOp.stream->consumed();
             }
+            ended = ring.isDrained();
+        } else {
+            moved = sharedMemory->write(sendOp.pending, sendOp.pendingSize);
+            sendOp.pending += moved;
+            sendOp.pendingSize -= moved;
+            ended = sendOp.pendingSize == 0;
         }
+        stats.bytesSent += moved;
 
-        // Wait for ACKs
-        cout << Color::MAGENTA << "[~]" << Color::RESET << " [Established] Waiting for segments to be ACKed" << endl;
-
-        // Then handle ACKs
-        for (int i = 0; i < actualWindowSize; i++) {
-            Segment recvSegment;
-            int32_t bytes = receiveSegment(recvSegment, peerAddr);
-
-            if (bytes > 0) {
-                // Check for FIN first
-                if (recvSegment.flags.fin) {
-                    cout << Color::YELLOW << "[i]" << Color::RESET << " [Closing] Received FIN request from "
-                         << inet_ntoa(peerAddr.sin_addr) << ":"
-                         << ntohs(peerAddr.sin_port) << endl;
-                    
-                    Segment finAckSegment = finAck();
-                    if (sendSegment(finAckSegment, peerAddr)) {
-                        cout << Color::YELLOW << "[i]" << Color::RESET << " [Closing] Sending FIN-ACK request to "
-                             << inet_ntoa(peerAddr.sin_addr) << ":"
-                             << ntohs(peerAddr.sin_port) << endl;
-                        status = CLOSE_WAIT;
-                        delete[] segments;
-                        return;
-                    }
-                }
-
-                // Handle normal ACK
-                else if (isValidChecksum(recvSegment) && recvSegment.flags.ack) {
-                    cout << Color::YELLOW << "[i]" << Color::RESET << " [Established] [Seg " << i+1 
-                         << "] [A=" << recvSegment.ackNum << "] ACKed" << endl;
-                    segmentHandler->handleAck(recvSegment.ackNum);
-                }
-            }
+        if (ended) {
+            sharedMemory->endMessage();
+            sendOp.ended = true;
         }
-        delete[] segments;
     }
+
+    if (sendOp.stream) {
+        uint64_t consumed = sharedMemory->getConsumed();
+        sendOp.stream->delivered(consumed - sendOp.sharedConsumed);
+        sendOp.sharedConsumed = consumed;
+    }
+
+    // Read to its end by the peer: every byte is delivered
+    if (sendOp.ended && sharedMemory->isMessageConsumed()) {
+        finishSend();
+        return true;
+    }
+    return moved > 0 || ended;
 }
 
-int32_t TCPSocket::recv(std::vector<uint8_t>& buffer, uint32_t length) {
-    if (status != ESTABLISHED && !doHandshake(peerAddr)) {
-        // cerr << "status: " << status << endl;
-        return -1;
+bool TCPSocket::pumpSharedRecv() {
+    bool messageEnd = false;
+    size_t moved;
+    if (recvOp.stream) {
+        ByteRing& ring = recvOp.stream->getRing();
+        if (sharedBounce.empty()) {
+            sharedBounce.resize(1 << 18);
+        }
+        moved = sharedMemory->read(sharedBounce.data(), std::min(ring.writable(), sharedBounce.size()), messageEnd);
+        if (moved > 0) {
+            ring.write(sharedBounce.data(), moved);
+            recvOp.stream->published();
+        }
+    } else {
+        moved = sharedMemory->read(recvOp.buffer->data() + recvOp.totalReceived,
+                                   recvOp.length - recvOp.totalReceived, messageEnd);
+    }
+    recvOp.totalReceived += moved;
+    stats.bytesReceived += moved;
+
+    if (messageEnd || (!recvOp.stream && recvOp.totalReceived == recvOp.length)) {
+        finishRecv();
+        return true;
+    }
+    return moved > 0;
+}
+
+void TCPSocket::transmitPending() {
+    // TX stage: put every segment the window allows but that was not sent yet on the wire
+    sendOp.slotsFreed = false;
+    if (!sendOp.active) {
+        sendOp.rewindPending = false;
+        return;
+    }
+    if (sendOp.rewindPending) {
+        sendOp.rewindPending = false;
+        segmentHandler->rewind();
+    }
+    if (status != ESTABLISHED) {
+        finishSend();
+        return;
+    }
+
+    int count = 0;
+    uint64_t retransmits = segmentHandler->getRetransmits();
+    Segment* segments = segmentHandler->nextSegments(count, loop.nowUs(), RETRANSMIT_TIMEOUT_MS * 1000);
+    if (count == 0) {
+        return;
+    }
+
+    // Send all new segments as one batch, segments a rewind went back over come first
+    if (sendSegments(segments, count, peerAddr, segmentHandler->getRetransmits() - retransmits)) {
+        for (int i = 0; i < count; i++) {
+            LOG_PACKET(Color::YELLOW << "[i]" << Color::RESET << " [Established] [Seg " << segments[i].seqNum / SegmentHandler::MAX_SEGMENT_SIZE + 1 
+                 << "] [S=" << segments[i].seqNum << "] Sent");
+        }
+    }
+
+    // The timer covers the oldest unacknowledged segment, only start it when idle
+    if (segmentHandler->getMode() == SELECTIVE_REPEAT) {
+        armRetransmitTimer();
+    } else if (!sendOp.timerRunning) {
+        sendOp.timerRunning = true;
+        armTimer(RETRANSMIT_TIMEOUT_MS);
+    }
+    LOG_PACKET(Color::MAGENTA << "[~]" << Color::RESET << " [Established] Waiting for segments to be ACKed");
+}
+
+void TCPSocket::handleAckSegment(const Segment& segment) {
+    // ACK stage: slide the window, the TX stage then fills the freed slots
+    LOG_PACKET(Color::YELLOW << "[i]" << Color::RESET << " [Established] [Seg " << (segment.ackNum + SegmentHandler::MAX_SEGMENT_SIZE - 1) / SegmentHandler::MAX_SEGMENT_SIZE 
+         << "] [A=" << segment.ackNum << "] ACKed");
+    int64_t nowUs = loop.nowUs();
+    uint32_t sendBase = segmentHandler->getSendBase();
+    uint32_t acked = segmentHandler->handleAck(segment.ackNum, nowUs);
+    if (segmentHandler->getMode() == SELECTIVE_REPEAT && segment.window == 0) {
+        // seqNum echoes the segment this ACK is for (window updates echo nothing)
+        acked += segmentHandler->markAcknowledged(segment.seqNum, nowUs);
+    }
+
+    int64_t rttUs = segmentHandler->takeRttSample();
+    if (rttUs >= 0) {
+        stats.addRttSample(rttUs / 1000.0);
+    }
+    if (segment.window > 0) {
+        stats.rwnd = segment.window;
+    } else if (acked == 0) {
+        stats.duplicateAcks++;
     }
+    traceSegment(TRACE_ACK, segment);
 
-    cout << Color::YELLOW << "[i]" << Color::RESET << " Ready to receive input from " << inet_ntoa(peerAddr.sin_addr) 
-         << ":" << ntohs(peerAddr.sin_port) << endl;
-    cout << Color::MAGENTA << "[~]" << Color::RESET << " [Established] Waiting for segments to be sent" << endl;
+    if (acked == 0 && segment.window > 0 && segment.ackNum == segmentHandler->getSendBase()) {
+        // Window update: the receiver dropped segments for lack of space and has
+        // room again, resend them now instead of waiting for the timeout
+        LOG_PACKET(Color::YELLOW << "[i]" << Color::RESET << " [Established] [A=" << segment.ackNum << "] Window update");
+        if (segmentHandler->getMode() == SELECTIVE_REPEAT) {
+            retransmitExpired(INT64_MAX);
+        } else {
+            // Rewinding here would make later ACKs of this batch look like
+            // ACKs for data never sent, the TX stage does it after the batch
+            sendOp.rewindPending = true;
+            sendOp.slotsFreed = true;
+        }
+        return;
+    }
+
+    if (sendOp.stream && acked > 0) {
+        // Sliding the window pulled more bytes out of the ring, unblock the writer
+        sendOp.stream->delivered(segmentHandler->getSendBase() - sendBase);
+        sendOp.stream->consumed();
+    }
+
+    if (segmentHandler->isComplete()) {
+        finishSend();
+        return;
+    }
+
+    if (segmentHandler->getMode() == SELECTIVE_REPEAT) {
+        armRetransmitTimer();
+        sendOp.slotsFreed = sendOp.slotsFreed || acked > 0;
+    } else if (acked > 0) {
+        // Progress, restart the timer for the new oldest segment
+        armTimer(RETRANSMIT_TIMEOUT_MS);
+        sendOp.timerRunning = true;
+        sendOp.slotsFreed = true;
+    }
+}
 
-    uint32_t totalReceived = 0;
-    uint32_t segCount = 1;
+void TCPSocket::finishSend() {
+    if (!sendOp.active) {
+        return;
+    }
+    sendOp.active = false;
+    sendOp.rewindPending = false;
+    sendOp.timerRunning = false;
+    if (sendOp.stream) {
+        loop.unwatch(sendOp.streamWatchId);
+        sendOp.streamWatchId = -1;
+        sendOp.stream = nullptr;
+        segmentHandler->setDataSource(nullptr);
+    }
+    armTimer(0);
+    updateWatch();
+
+    std::function<void()> onDone = std::move(sendOp.onDone);
+    if (onDone) {
+        onDone();
+    }
+}
+
+void TCPSocket::send(string destIp, int32_t destPort, void* dataStream, uint32_t dataSize) { 
+    bool done = false;
+    startSend(dataStream, dataSize, [&]() { done = true; });
+    loop.runUntil([&]() { return done; });
+}
+
+void TCPSocket::startRecv(std::vector<uint8_t>& buffer, uint32_t length, std::function<void(int32_t)> onDone) {
+    LOG_INFO(Color::YELLOW << "[i]" << Color::RESET << " Ready to receive input from " << inet_ntoa(peerAddr.sin_addr) 
+         << ":" << ntohs(peerAddr.sin_port));
+    LOG_PACKET(Color::MAGENTA << "[~]" << Color::RESET << " [Established] Waiting for segments to be sent");
+
+    recvOp.active = true;
+    recvOp.buffer = &buffer;
+    recvOp.stream = nullptr;
+    recvOp.length = length;
+    recvOp.totalReceived = 0;
+    recvOp.segCount = 1;
+    recvOp.onDone = onDone;
+    updateWatch();
 
     // Resize buffer to accommodate the incoming data
     buffer.resize(buffer.size() + length);
 
-    while (true) {
-        Segment segment;
-        struct sockaddr_in tempAddr; 
-        int32_t bytes = receiveSegment(segment, tempAddr);
+    if (sharedMemory) {
+        pumpSharedMemory();
+        return;
+    }
+    onReadable();
+}
 
-        if (bytes > 0) {
-            // Safe payload check
-            if (segment.payloadSize > 0 && segment.payloadSize <= length - totalReceived) {
-                cout << Color::YELLOW << "[i]" << Color::RESET << " [Established] [Seg " << segCount 
-                     << "] [S=" << segment.seqNum << "] ACKed" << endl;
+void TCPSocket::startRecvStream(StreamChannel& channel, std::function<void(int32_t)> onDone) {
+    LOG_INFO(Color::YELLOW << "[i]" << Color::RESET << " Streaming input from " << inet_ntoa(peerAddr.sin_addr) 
+         << ":" << ntohs(peerAddr.sin_port));
 
-                // Copy the payload into the buffer
-                std::copy(segment.payload, segment.payload + segment.payloadSize, 
-                          buffer.begin() + totalReceived);
+    recvOp.active = true;
+    recvOp.buffer = nullptr;
+    recvOp.stream = &channel;
+    recvOp.starved = false;
+    recvOp.spaceWatchId = loop.watch(channel.getSpaceFd(), [this]() { onStreamSpace(); });
+    recvOp.length = 0;
+    recvOp.totalReceived = 0;
+    recvOp.segCount = 1;
+    recvOp.onDone = onDone;
+    updateWatch();
+
+    if (sharedMemory) {
+        pumpSharedMemory();
+        return;
+    }
+    onReadable();
+}
 
-                totalReceived += segment.payloadSize;
+void TCPSocket::onStreamSpace() {
+    // The reader consumed bytes, tell a sender whose segments were dropped
+    recvOp.stream->acknowledgeSpace();
+    if (sharedMemory) {
+        pumpSharedMemory();
+        return;
+    }
+    if (!recvOp.starved || recvSpace() < SegmentHandler::MAX_SEGMENT_SIZE) {
+        return;
+    }
+    recvOp.starved = false;
+    bool finished = drainReorderBuffer();
 
-                // Send ACK
-                Segment ackSegment = ack(segment.seqNum + segment.payloadSize, 
-                                         segment.seqNum);
+    Segment update = ack(segmentHandler->getNextSeqNum(), expectedSeqNum);
+    update.window = std::min<uint32_t>(recvSpace() / SegmentHandler::MAX_SEGMENT_SIZE, 0xFFFF);
+    update = updateChecksum(update);
+    if (sendSegment(update, peerAddr)) {
+        LOG_PACKET(Color::YELLOW << "[i]" << Color::RESET << " [Established] [A=" << update.ackNum << "] Window update sent");
+    }
 
-                if (sendSegment(ackSegment, peerAddr)) {
-                    cout << Color::YELLOW << "[i]" << Color::RESET << " [Established] [Seg " << segCount 
-                         << "] [A=" << ackSegment.ackNum << "] Sent" << endl;
-                }
+    if (finished || (status == LAST_ACK && reorderBuffer.find(expectedSeqNum) == reorderBuffer.end())) {
+        finishRecv();
+    }
+}
 
-                if (segment.payloadSize < 1460) {
-                    break;
-                }
+uint32_t TCPSocket::recvSpace() const {
+    // A full ring holds segments back unacknowledged, the sender retransmits
+    // them later: the reader's pace becomes the sender's
+    if (recvOp.stream) {
+        return std::min<size_t>(recvOp.stream->getRing().writable(), UINT32_MAX);
+    }
+    return recvOp.length - recvOp.totalReceived;
+}
 
-                segCount++;
-            }
+void TCPSocket::deliverPayload(const uint8_t* data, uint32_t size) {
+    if (recvOp.stream) {
+        recvOp.stream->getRing().write(data, size);
+        recvOp.stream->published();
+    } else {
+        std::copy(data, data + size, recvOp.buffer->begin() + recvOp.totalReceived);
+    }
+    recvOp.totalReceived += size;
+}
 
-            // Handle FIN after receiving all data
-            else if (segment.flags.fin) {
-                Segment finAckSegment = finAck();
-                if (sendSegment(finAckSegment, peerAddr)) {
-                    cout << Color::YELLOW << "[i]" << Color::RESET << " [Closing] Sending FIN-ACK request to "
-                         << inet_ntoa(peerAddr.sin_addr) << ":"
-                         << ntohs(peerAddr.sin_port) << endl;
-                    status = LAST_ACK;
-                }
-                break;
-            }
-        } else {
-            cerr << Color::RED << "[!]" << Color::RESET << " Error or connection closed masuk ke socket" << endl;
+void TCPSocket::handleData(const Segment& segment) {
+    if (segmentHandler->getMode() == SELECTIVE_REPEAT) {
+        handleSelectiveData(segment);
+        return;
+    }
+
+    // Go-Back-N receiver: only the next in-order segment is kept, anything else
+    // (lost predecessor, retransmitted duplicate) just repeats the cumulative ACK
+    bool validChecksum = isValidChecksum(segment);
+    if (!validChecksum) {
+        stats.checksumFailures++;
+    }
+    bool inOrder = segment.seqNum == expectedSeqNum && validChecksum &&
+                   segment.payloadSize <= recvSpace();
+    if (recvOp.stream && segment.seqNum == expectedSeqNum && !inOrder) {
+        recvOp.starved = true;
+    }
+
+    traceSegment(inOrder ? TRACE_RECEIVE : TRACE_DROP, segment);
+    if (inOrder) {
+        LOG_PACKET(Color::YELLOW << "[i]" << Color::RESET << " [Established] [Seg " << recvOp.segCount 
+             << "] [S=" << segment.seqNum << "] ACKed");
+
+        // Copy the payload into the buffer
+        deliverPayload(segment.payload, segment.payloadSize);
+        expectedSeqNum += segment.payloadSize;
+    }
+
+    // Send ACK
+    Segment ackSegment = ack(segmentHandler->getNextSeqNum(), expectedSeqNum);
+
+    if (sendSegment(ackSegment, peerAddr)) {
+        LOG_PACKET(Color::YELLOW << "[i]" << Color::RESET << " [Established] [Seg " << recvOp.segCount 
+             << "] [A=" << ackSegment.ackNum << "] Sent");
+    }
+
+    if (!inOrder) {
+        return;
+    }
+
+    if (segment.payloadSize < SegmentHandler::MAX_SEGMENT_SIZE) {
+        finishRecv();
+        return;
+    }
+
+    recvOp.segCount++;
+}
+
+void TCPSocket::handleSelectiveData(const Segment& segment) {
+    // Selective Repeat receiver: every valid segment inside the receive window is
+    // acknowledged on its own, the ones ahead of a gap wait in reorderBuffer
+    uint32_t windowBytes = segmentHandler->getWindowSize() * SegmentHandler::MAX_SEGMENT_SIZE;
+    if (!isValidChecksum(segment)) {
+        stats.checksumFailures++;
+        traceSegment(TRACE_DROP, segment);
+        return;
+    }
+    if (!seqLess(segment.seqNum, expectedSeqNum + windowBytes)) {
+        traceSegment(TRACE_DROP, segment);
+        return;
+    }
+
+    if (seqLess(segment.seqNum, expectedSeqNum)) {
+        // Delivered already, its ACK was lost
+        traceSegment(TRACE_DROP, segment);
+    } else if (seqLess(expectedSeqNum, segment.seqNum)) {
+        traceSegment(TRACE_RECEIVE, segment);
+        reorderBuffer.emplace(segment.seqNum, std::vector<uint8_t>(segment.payload, segment.payload + segment.payloadSize));
+        LOG_PACKET(Color::YELLOW << "[i]" << Color::RESET << " [Established] [S=" << segment.seqNum << "] Buffered out of order");
+    }
+
+    bool finished = false;
+    if (segment.seqNum == expectedSeqNum) {
+        if (segment.payloadSize > recvSpace()) {
+            recvOp.starved = recvOp.stream != nullptr;
+            traceSegment(TRACE_DROP, segment);
+            return;
+        }
+        traceSegment(TRACE_RECEIVE, segment);
+        reorderBuffer[segment.seqNum].assign(segment.payload, segment.payload + segment.payloadSize);
+        finished = drainReorderBuffer();
+    }
+
+    Segment ackSegment = ack(segment.seqNum, expectedSeqNum);
+    if (sendSegment(ackSegment, peerAddr)) {
+        LOG_PACKET(Color::YELLOW << "[i]" << Color::RESET << " [Established] [S=" << ackSegment.seqNum 
+             << "] [A=" << ackSegment.ackNum << "] Sent");
+    }
+
+    if (finished) {
+        finishRecv();
+    }
+}
+
+bool TCPSocket::drainReorderBuffer() {
+    // Hand over every buffered segment that is now contiguous
+    bool finished = false;
+    auto next = reorderBuffer.find(expectedSeqNum);
+    while (!finished && next != reorderBuffer.end()) {
+        if (next->second.size() > recvSpace()) {
+            // Kept until the reader makes room (onStreamSpace)
+            recvOp.starved = recvOp.stream != nullptr;
             break;
         }
+
+        LOG_PACKET(Color::YELLOW << "[i]" << Color::RESET << " [Established] [Seg " << recvOp.segCount 
+             << "] [S=" << next->first << "] ACKed");
+
+        deliverPayload(next->second.data(), next->second.size());
+        expectedSeqNum += next->second.size();
+        finished = next->second.size() < SegmentHandler::MAX_SEGMENT_SIZE;
+        recvOp.segCount++;
+
+        reorderBuffer.erase(next);
+        next = reorderBuffer.find(expectedSeqNum);
     }
+    return finished;
+}
+
+void TCPSocket::finishRecv() {
+    if (!recvOp.active) {
+        return;
+    }
+    recvOp.active = false;
+    reorderBuffer.clear();
+    updateWatch();
 
-    // Resize the buffer to the actual received size
-    buffer.resize(totalReceived);
+    if (recvOp.stream) {
+        // End of stream for the reader
+        loop.unwatch(recvOp.spaceWatchId);
+        recvOp.stream->close();
+        recvOp.stream = nullptr;
+    } else {
+        // Resize the buffer to the actual received size
+        recvOp.buffer->resize(recvOp.totalReceived);
+    }
 
-    return totalReceived;
+    std::function<void(int32_t)> onDone = std::move(recvOp.onDone);
+    if (onDone) {
+        onDone(recvOp.totalReceived);
+    }
 }
 
-void TCPSocket::close() {
-    struct timeval tv = {5, 0};
-    setsockopt(socket, SOL_SOCKET, SO_RCVTIMEO, (const char*)&tv, sizeof tv);
+int32_t TCPSocket::recv(std::vector<uint8_t>& buffer, uint32_t length) {
+    if (status != ESTABLISHED && !doHandshake(peerAddr)) {
+        // cerr << "status: " << status << endl;
+        return -1;
+    }
+
+    bool done = false;
+    int32_t received = 0;
+    startRecv(buffer, length, [&](int32_t total) {
+        received = total;
+        done = true;
+    });
+    loop.runUntil([&]() { return done; });
+
+    return received;
+}
+
+void TCPSocket::sendStream(StreamChannel& channel) {
+    bool done = false;
+    startSendStream(channel, [&]() { done = true; });
+    loop.runUntil([&]() { return done; });
+}
+
+int32_t TCPSocket::recvStream(StreamChannel& channel) {
+    if (status != ESTABLISHED && !doHandshake(peerAddr)) {
+        channel.close();
+        return -1;
+    }
+
+    bool done = false;
+    int32_t received = 0;
+    startRecvStream(channel, [&](int32_t total) {
+        received = total;
+        done = true;
+    });
+    loop.runUntil([&]() { return done; });
+
+    return received;
+}
+
+void TCPSocket::startClose(std::function<void()> onDone) {
+    closing = true;
+    closeDone = onDone;
+    updateWatch();
+    closeDeadlineUs = loop.nowUs() + CLOSE_TIMEOUT_MS * 1000;
 
     if (status == ESTABLISHED) {
         // Initiator closing sequence
-        status = FIN_WAIT_1;
+        setStatus(FIN_WAIT_1);
         
         Segment finSegment = fin();
         
         if (sendSegment(finSegment, peerAddr)) {
-            cout << Color::YELLOW << "[i]" << Color::RESET << " [Closing] Sending FIN request to " 
+            LOG_INFO(Color::YELLOW << "[i]" << Color::RESET << " [Closing] Sending FIN request to " 
                  << inet_ntoa(peerAddr.sin_addr) << ":" 
-                 << ntohs(peerAddr.sin_port) << endl;
-
-            time_t startTime = time(NULL);
-            
-            while (status == FIN_WAIT_1 && (time(NULL) - startTime < 5)) { 
-                Segment finAckSegment;
-                int32_t bytes = receiveSegment(finAckSegment, peerAddr);
-                     
-                if (bytes > 0) {
-                    if (finAckSegment.flags.fin && finAckSegment.flags.ack) {
-                        cout << Color::GREEN << "[+]" << Color::RESET << " [Closing] Received FIN-ACK request from "
-                             << inet_ntoa(peerAddr.sin_addr) << ":" 
-                             << ntohs(peerAddr.sin_port) << endl;
-                        
-                        status = TIME_WAIT;
-                        
-                        Segment ackSegment = ack(finAckSegment.seqNum + 1, 
-                                               finAckSegment.seqNum);
-                        if (sendSegment(ackSegment, peerAddr)) {
-                            cout << Color::YELLOW << "[i]" << Color::RESET << " [Closing] Sending ACK request to "
-                                 << inet_ntoa(peerAddr.sin_addr) << ":" 
-                                 << ntohs(peerAddr.sin_port) << endl;
-                            status = CLOSED;
-                            break;
-                        }
-                    }
-                }
-            }
-        } else {
-            cout << "Failed to send FIN segment" << endl;
+                 << ntohs(peerAddr.sin_port));
+            armTimer(RETRANSMIT_TIMEOUT_MS);
+            onReadable();
+            return;
         }
+        LOG_ERROR("Failed to send FIN segment");
     }
     else if (status == CLOSE_WAIT) {
-        Segment ackSegment;
-        time_t startTime = time(NULL);
-        
-        while (time(NULL) - startTime < 5) {
-            int32_t bytes = receiveSegment(ackSegment, peerAddr);
-            if (bytes > 0 && ackSegment.flags.ack) {
-                cout << Color::GREEN << "[+]" << Color::RESET << " [Closing] Received final ACK from "
-                     << inet_ntoa(peerAddr.sin_addr) << ":" 
-                     << ntohs(peerAddr.sin_port) << endl;
-                status = CLOSED;
-                break;
-            }
-        }
+        armTimer(CLOSE_TIMEOUT_MS);
+        onReadable();
+        return;
     }
-    
-    cout << Color::YELLOW << "[i]" << Color::RESET << " Connection closed successfully" << endl;
-    status = CLOSED;
-    ::close(socket);
-}
\ No newline at end of file
+
+    finishClose();
+}
+
+void TCPSocket::finishClose() {
+    if (!closing) {
+        return;
+    }
+    closing = false;
+
+    LOG_INFO(Color::YELLOW << "[i]" << Color::RESET << " Connection closed successfully");
+    setStatus(CLOSED);
+    detach();
+    releaseSharedMemory();
+    transport->close();
+
+    std::function<void()> onDone = std::move(closeDone);
+    if (onDone) {
+        onDone();
+    }
+}
+
+void TCPSocket::close() {
+    bool done = false;
+    startClose([&]() { done = true; });
+    loop.runUntil([&]() { return done; });
+}
+
+OperationAwaiter<bool> TCPSocket::async_connect(const struct sockaddr_in& destAddr) {
+    struct sockaddr_in addr = destAddr;
+    return OperationAwaiter<bool>(loop, [this, addr](std::function<void(bool)> onDone) {
+        startHandshake(addr, onDone);
+    });
+}
+
+OperationAwaiter<bool> TCPSocket::async_accept() {
+    return OperationAwaiter<bool>(loop, [this](std::function<void(bool)> onDone) {
+        if (status == CLOSED) {
+            listen();
+        }
+        startHandshake(peerAddr, onDone);
+    });
+}
+
+OperationAwaiter<void> TCPSocket::async_send(void* dataStream, uint32_t dataSize) {
+    return OperationAwaiter<void>(loop, [this, dataStream, dataSize](std::function<void()> onDone) {
+        startSend(dataStream, dataSize, onDone);
+    });
+}
+
+OperationAwaiter<int32_t> TCPSocket::async_recv(std::vector<uint8_t>& buffer, uint32_t length) {
+    std::vector<uint8_t>* target = &buffer;
+    return OperationAwaiter<int32_t>(loop, [this, target, length](std::function<void(int32_t)> onDone) {
+        if (status != ESTABLISHED) {
+            onDone(-1);
+            return;
+        }
+        startRecv(*target, length, onDone);
+    });
+}
+
+OperationAwaiter<void> TCPSocket::async_close() {
+    return OperationAwaiter<void>(loop, [this](std::function<void()> onDone) {
+        startClose(onDone);
+    });
+}
@@ -0,0 +1,121 @@
+#include "header/stream_channel.hpp"
+#include <sys/eventfd.h>
+#include <poll.h>
+#include <unistd.h>
+#include <stdexcept>
+
+StreamChannel::StreamChannel(size_t capacity) :
+    ring(capacity),
+    deliveredBytes(0) {
+
+    dataFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    spaceFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (dataFd < 0 || spaceFd < 0) {
+        if (dataFd >= 0) {
+            ::close(dataFd);
+        }
+        if (spaceFd >= 0) {
+            ::close(spaceFd);
+        }
+        throw std::runtime_error("eventfd creation failed");
+    }
+}
+
+StreamChannel::~StreamChannel() {
+    ::close(dataFd);
+    ::close(spaceFd);
+}
+
+void StreamChannel::signal(int fd) {
+    uint64_t one = 1;
+    if (::write(fd, &one, sizeof(one)) < 0) {
+        // Counter saturated, the descriptor is readable anyway
+    }
+}
+
+void StreamChannel::clear(int fd) {
+    uint64_t count;
+    if (::read(fd, &count, sizeof(count)) < 0) {
+        // Nothing pending
+    }
+}
+
+void StreamChannel::wait(int fd) {
+    struct pollfd pfd = {fd, POLLIN, 0};
+    poll(&pfd, 1, -1);
+    clear(fd);
+}
+
+size_t StreamChannel::write(const uint8_t* data, size_t length, bool block) {
+    size_t written = 0;
+    while (written < length) {
+        size_t n = ring.write(data + written, length - written);
+        if (n > 0) {
+            written += n;
+            signal(dataFd);
+            continue;
+        }
+        if (!block) {
+            break;
+        }
+        // Full: sleep until the consumer frees space. A signal sent between
+        // the failed write and the poll stays in the counter, nothing is lost.
+        wait(spaceFd);
+    }
+    return written;
+}
+
+size_t StreamChannel::read(uint8_t* data, size_t length, bool block) {
+    while (true) {
+        size_t n = ring.read(data, length);
+        if (n > 0) {
+            signal(spaceFd);
+            return n;
+        }
+        if (!block || ring.isDrained()) {
+            return 0;
+        }
+        wait(dataFd);
+    }
+}
+
+void StreamChannel::close() {
+    ring.close();
+    signal(dataFd);
+}
+
+ByteRing& StreamChannel::getRing() {
+    return ring;
+}
+
+int StreamChannel::getDataFd() const {
+    return dataFd;
+}
+
+void StreamChannel::acknowledgeData() {
+    clear(dataFd);
+}
+
+void StreamChannel::consumed() {
+    signal(spaceFd);
+}
+
+void StreamChannel::delivered(uint64_t bytes) {
+    deliveredBytes.fetch_add(bytes, std::memory_order_release);
+}
+
+uint64_t StreamChannel::getDelivered() const {
+    return deliveredBytes.load(std::memory_order_acquire);
+}
+
+void StreamChannel::published() {
+    signal(dataFd);
+}
+
+int StreamChannel::getSpaceFd() const {
+    return spaceFd;
+}
+
+void StreamChannel::acknowledgeSpace() {
+    clear(spaceFd);
+}
@@ -0,0 +1,142 @@
+#include "header/stripe.hpp"
+#include "header/session.hpp"
+#include <vector>
+#include <cstring>
+#include <stdexcept>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+static const uint32_t STRIPE_MAGIC = 0x53545231;  // "STR1"
+static const uint64_t STRIPE_ALIGNMENT = 1 << 20;
+static const size_t STRIPE_CHUNK = 1 << 20;
+
+void stripeRange(uint64_t size, uint16_t index, uint16_t count, uint64_t& offset, uint64_t& length) {
+    uint64_t part = (size + count - 1) / count;
+    part = (part + STRIPE_ALIGNMENT - 1) / STRIPE_ALIGNMENT * STRIPE_ALIGNMENT;
+    offset = std::min(size, part * index);
+    length = std::min(part, size - offset);
+}
+
+void writeStripe(StreamChannel& channel, const std::string& path, const std::string& name,
+                 uint16_t index, uint16_t count) {
+    if (name.size() > SessionWriter::MAX_NAME_LENGTH) {
+        throw std::runtime_error("file name too long: " + name);
+    }
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        throw std::runtime_error("cannot open " + path);
+    }
+    struct stat info;
+    if (fstat(fd, &info) < 0) {
+        ::close(fd);
+        throw std::runtime_error("cannot stat " + path);
+    }
+
+    StripeHeader header = {};
+    header.magic = STRIPE_MAGIC;
+    header.index = index;
+    header.count = count;
+    header.fileSize = info.st_size;
+    header.mode = info.st_mode & 07777;
+    header.nameLength = name.size();
+    uint64_t offset, length;
+    stripeRange(header.fileSize, index, count, offset, length);
+    header.offset = offset;
+    header.length = length;
+    posix_fadvise(fd, offset, length, POSIX_FADV_SEQUENTIAL);
+
+    channel.write((const uint8_t*)&header, sizeof(header));
+    channel.write((const uint8_t*)name.data(), name.size());
+
+    std::vector<uint8_t> chunk(STRIPE_CHUNK);
+    for (uint64_t done = 0; done < length; ) {
+        ssize_t n = pread(fd, chunk.data(), std::min<uint64_t>(chunk.size(), length - done), offset + done);
+        if (n <= 0) {
+            // The stripe ends early, its receiver sees it
+            ::close(fd);
+            throw std::runtime_error("short read from " + path);
+        }
+        channel.write(chunk.data(), n);
+        done += n;
+    }
+    ::close(fd);
+}
+
+static bool readExactly(StreamChannel& channel, uint8_t* data, size_t length) {
+    size_t done = 0;
+    while (done < length) {
+        size_t n = channel.read(data + done, length - done);
+        if (n == 0) {
+            return false;
+        }
+        done += n;
+    }
+    return true;
+}
+
+StripeHeader readStripe(StreamChannel& channel, const std::filesystem::path& directory, std::string& name) {
+    StripeHeader header;
+    if (!readExactly(channel, (uint8_t*)&header, sizeof(header)) || header.magic != STRIPE_MAGIC) {
+        throw std::runtime_error("not a striped transfer");
+    }
+    uint64_t offset, length;
+    stripeRange(header.fileSize, header.index, header.count, offset, length);
+    if (header.count == 0 || header.count > MAX_STRIPES || header.index >= header.count ||
+        header.offset != offset || header.length != length) {
+        throw std::runtime_error("invalid stripe " + std::to_string(header.index) + " of " + std::to_string(header.count));
+    }
+    name.resize(header.nameLength);
+    if (!readExactly(channel, (uint8_t*)name.data(), name.size())) {
+        throw std::runtime_error("stripe ended in its header");
+    }
+    std::filesystem::path relative = safeTransferPath(name);
+    if (relative.empty()) {
+        throw std::runtime_error("unsafe file name: " + name);
+    }
+
+    std::filesystem::path path = directory / relative;
+    std::error_code error;
+    std::filesystem::create_directories(path.parent_path(), error);
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        throw std::runtime_error("cannot create " + path.string());
+    }
+    // The sender's permission bits, kept writable for the owner so stripes
+    // opening the file later still can. The caller applies the exact bits.
+    if (fchmod(fd, (header.mode & 07777) | S_IWUSR) < 0) {
+        ::close(fd);
+        throw std::runtime_error("cannot set the mode of " + path.string());
+    }
+    // Every stripe asks for the same size, whichever comes first lays the file out
+    if (header.fileSize > 0) {
+        fallocate(fd, 0, 0, header.fileSize);
+    }
+    if (ftruncate(fd, header.fileSize) < 0) {
+        ::close(fd);
+        throw std::runtime_error("cannot resize " + path.string());
+    }
+
+    std::vector<uint8_t> chunk(STRIPE_CHUNK);
+    for (uint64_t done = 0; done < length; ) {
+        size_t n = channel.read(chunk.data(), std::min<uint64_t>(chunk.size(), length - done));
+        if (n == 0) {
+            ::close(fd);
+            throw std::runtime_error("stripe " + std::to_string(header.index) + " ended early");
+        }
+        for (size_t written = 0; written < n; ) {
+            ssize_t result = pwrite(fd, chunk.data() + written, n - written, offset + done + written);
+            if (result <= 0) {
+                ::close(fd);
+                throw std::runtime_error("cannot write " + path.string());
+            }
+            written += result;
+        }
+        done += n;
+    }
+    if (::close(fd) < 0) {
+        throw std::runtime_error("cannot write " + path.string());
+    }
+    return header;
+}
@@ -0,0 +1,271 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <deque>
+#include <algorithm>
+#include "header/packet_trace.hpp"
+#include "header/segment_handler.hpp"
+
+/**
+ * Offline analyzer for --trace files, in the spirit of tcptrace.
+ *
+ * Prints a summary per connection and writes gnuplot data for one of them:
+ *   PREFIX.seq.dat      sequence number over time (blocks: sent, retransmitted, acked, dropped)
+ *   PREFIX.goodput.dat  acknowledged (or received) payload per interval, in Mbit/s
+ *   PREFIX.rtt.dat      RTT samples from cumulative ACKs, Karn's rule
+ *   PREFIX.gp           gnuplot script rendering the three into PREFIX.png
+ */
+
+using namespace std;
+
+static const char* EVENT_NAMES[] = {"send", "retransmit", "ack", "receive", "drop", "state"};
+
+struct Options {
+    string tracePath;
+    string prefix;
+    int connection = -1;     // -1: the connection with the most events
+    double intervalMs = 100;
+};
+
+struct Point {
+    double seconds;
+    double value;
+};
+
+struct Analysis {
+    uint64_t counts[6] = {};
+    uint64_t dataBytes = 0;
+    uint64_t goodputBytes = 0;
+    double seconds = 0;
+
+    vector<Point> sent;
+    vector<Point> retransmitted;
+    vector<Point> acked;
+    vector<Point> dropped;
+    vector<Point> goodput;
+    vector<Point> rtt;
+};
+
+static Analysis analyze(const vector<TraceRecord>& events, double intervalMs) {
+    Analysis result;
+    if (events.empty()) {
+        return result;
+    }
+
+    struct Outstanding {
+        uint32_t end;
+        uint64_t sentNs;
+        bool retransmitted;
+    };
+    deque<Outstanding> outstanding;
+
+    // Goodput follows the sender's cumulative ACKs, or the receiver's accepted data
+    bool senderSide = any_of(events.begin(), events.end(), [](const TraceRecord& e) { return e.event == TRACE_ACK; });
+    uint64_t startNs = events.front().timestampNs;
+    uint64_t intervalNs = uint64_t(intervalMs * 1e6);
+    uint64_t bucketStart = startNs;
+    uint64_t bucketBytes = 0;
+    uint32_t highestAck = 0;  // Data sequence numbers start at 0
+
+    for (const TraceRecord& e : events) {
+        result.counts[e.event]++;
+        double t = (e.timestampNs - startNs) / 1e9;
+
+        while (e.timestampNs >= bucketStart + intervalNs) {
+            result.goodput.push_back({(bucketStart - startNs) / 1e9, bucketBytes * 8 / (intervalMs * 1e3)});
+            bucketStart += intervalNs;
+            bucketBytes = 0;
+        }
+
+        switch (e.event) {
+        case TRACE_SEND:
+            if (e.length > 0) {
+                result.dataBytes += e.length;
+                result.sent.push_back({t, double(e.seqNum)});
+                outstanding.push_back({e.seqNum + e.length, e.timestampNs, false});
+            }
+            break;
+
+        case TRACE_RETRANSMIT:
+            result.retransmitted.push_back({t, double(e.seqNum)});
+            for (Outstanding& segment : outstanding) {
+                if (segment.end == e.seqNum + e.length) {
+                    segment.retransmitted = true;
+                }
+            }
+            break;
+
+        case TRACE_ACK:
+            result.acked.push_back({t, double(e.ackNum)});
+            if (seqLess(highestAck, e.ackNum)) {
+                bucketBytes += e.ackNum - highestAck;
+                result.goodputBytes += e.ackNum - highestAck;
+                highestAck = e.ackNum;
+            }
+            // The segment ending at the ACK gives the sample, unless it was sent twice
+            while (!outstanding.empty() && !seqLess(e.ackNum, outstanding.front().end)) {
+                if (outstanding.front().end == e.ackNum && !outstanding.front().retransmitted) {
+                    result.rtt.push_back({t, (e.timestampNs - outstanding.front().sentNs) / 1e6});
+                }
+                outstanding.pop_front();
+            }
+            break;
+
+        case TRACE_RECEIVE:
+            result.sent.push_back({t, double(e.seqNum)});
+            if (!senderSide) {
+                bucketBytes += e.length;
+                result.goodputBytes += e.length;
+                result.dataBytes += e.length;
+            }
+            break;
+
+        case TRACE_DROP:
+            result.dropped.push_back({t, double(e.seqNum)});
+            break;
+
+        default:
+            break;
+        }
+        result.seconds = t;
+    }
+    result.goodput.push_back({(bucketStart - startNs) / 1e9, bucketBytes * 8 / (intervalMs * 1e3)});
+    return result;
+}
+
+static void writeBlock(ofstream& out, const char* name, const vector<Point>& points) {
+    out << "# " << name << "\n";
+    for (const Point& p : points) {
+        out << p.seconds << " " << p.value << "\n";
+    }
+    // Two blank lines end a gnuplot index block, an empty block still needs a point
+    if (points.empty()) {
+        out << "0 NaN\n";
+    }
+    out << "\n\n";
+}
+
+static bool writePlots(const string& prefix, const Analysis& analysis) {
+    ofstream seq(prefix + ".seq.dat");
+    ofstream goodput(prefix + ".goodput.dat");
+    ofstream rtt(prefix + ".rtt.dat");
+    ofstream script(prefix + ".gp");
+    if (!seq || !goodput || !rtt || !script) {
+        return false;
+    }
+
+    writeBlock(seq, "sent", analysis.sent);
+    writeBlock(seq, "retransmitted", analysis.retransmitted);
+    writeBlock(seq, "acked", analysis.acked);
+    writeBlock(seq, "dropped", analysis.dropped);
+    writeBlock(goodput, "goodput Mbit/s", analysis.goodput);
+    writeBlock(rtt, "rtt ms", analysis.rtt);
+
+    script << "set terminal pngcairo size 1200,1200\n"
+           << "set output '" << prefix << ".png'\n"
+           << "set multiplot layout 3,1\n"
+           << "set xlabel 'time (s)'\n"
+           << "set ylabel 'sequence number'\n"
+           << "plot '" << prefix << ".seq.dat' index 0 with dots title 'sent', \\\n"
+           << "     '' index 1 with points pt 2 lc rgb 'red' title 'retransmitted', \\\n"
+           << "     '' index 2 with steps lc rgb 'green' title 'acked', \\\n"
+           << "     '' index 3 with points pt 1 lc rgb 'black' title 'dropped'\n"
+           << "set ylabel 'goodput (Mbit/s)'\n"
+           << "plot '" << prefix << ".goodput.dat' with steps notitle\n"
+           << "set ylabel 'RTT (ms)'\n"
+           << "plot '" << prefix << ".rtt.dat' with points pt 7 ps 0.3 notitle\n"
+           << "unset multiplot\n";
+    return true;
+}
+
+static void printSummary(int connection, const Analysis& analysis) {
+    cout << "Connection " << connection << ": " << analysis.seconds << " s";
+    for (int i = 0; i < 6; i++) {
+        cout << ", " << analysis.counts[i] << " " << EVENT_NAMES[i];
+    }
+    cout << "\n";
+    cout << "    data bytes " << analysis.dataBytes << ", goodput "
+         << (analysis.seconds > 0 ? analysis.goodputBytes * 8 / analysis.seconds / 1e6 : 0) << " Mbit/s";
+    if (!analysis.rtt.empty()) {
+        double minRtt = analysis.rtt.front().value, maxRtt = minRtt, sum = 0;
+        for (const Point& p : analysis.rtt) {
+            minRtt = min(minRtt, p.value);
+            maxRtt = max(maxRtt, p.value);
+            sum += p.value;
+        }
+        cout << ", RTT min/avg/max " << minRtt << "/" << sum / analysis.rtt.size() << "/" << maxRtt << " ms ("
+             << analysis.rtt.size() << " samples)";
+    }
+    cout << "\n";
+}
+
+int main(int argc, char* argv[]) {
+    Options options;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "-c" && i + 1 < argc) {
+            options.connection = stoi(argv[++i]);
+        } else if (arg == "-o" && i + 1 < argc) {
+            options.prefix = argv[++i];
+        } else if (arg == "-i" && i + 1 < argc) {
+            options.intervalMs = stod(argv[++i]);
+        } else if (options.tracePath.empty() && arg[0] != '-') {
+            options.tracePath = arg;
+        } else {
+            options.tracePath.clear();
+            break;
+        }
+    }
+    if (options.tracePath.empty() || options.intervalMs <= 0) {
+        cerr << "Usage: trace_analyzer TRACE [-c CONNECTION] [-o PREFIX] [-i INTERVAL_MS]" << endl;
+        return 1;
+    }
+    if (options.prefix.empty()) {
+        options.prefix = options.tracePath.substr(0, options.tracePath.rfind('.'));
+    }
+
+    vector<TraceRecord> records;
+    try {
+        records = PacketTrace::load(options.tracePath);
+    } catch (const exception& e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+
+    // Slots are claimed in order but written by several threads, sort by time
+    stable_sort(records.begin(), records.end(),
+                [](const TraceRecord& a, const TraceRecord& b) { return a.timestampNs < b.timestampNs; });
+
+    map<int, vector<TraceRecord>> connections;
+    for (const TraceRecord& record : records) {
+        if (record.event <= TRACE_STATE) {
+            connections[record.connection].push_back(record);
+        }
+    }
+    cout << records.size() << " events, " << connections.size() << " connections\n";
+
+    int selected = options.connection;
+    size_t most = 0;
+    for (auto& [connection, events] : connections) {
+        Analysis analysis = analyze(events, options.intervalMs);
+        printSummary(connection, analysis);
+        if (options.connection < 0 && events.size() > most) {
+            most = events.size();
+            selected = connection;
+        }
+    }
+
+    auto found = connections.find(selected);
+    if (found == connections.end()) {
+        cerr << "No events for connection " << selected << endl;
+        return 1;
+    }
+    if (!writePlots(options.prefix, analyze(found->second, options.intervalMs))) {
+        cerr << "Cannot write " << options.prefix << ".*" << endl;
+        return 1;
+    }
+    cout << "Connection " << selected << " plotted: gnuplot " << options.prefix << ".gp renders " << options.prefix << ".png" << endl;
+    return 0;
+}
@@ -0,0 +1,54 @@
+#include "header/transport.hpp"
+#include "header/udp_transport.hpp"
+#include "header/io_uring_transport.hpp"
+#include "header/xdp_transport.hpp"
+#include "header/logger.hpp"
+#include <stdexcept>
+
+const uint32_t Transport::MAX_DATAGRAM_SIZE;
+
+int Transport::pollFd() const {
+    return fd();
+}
+
+bool Transport::setGso(bool enabled) {
+    if (enabled) {
+        LOG_INFO(Color::YELLOW << "[i]" << Color::RESET << " UDP GSO is not available with this transport");
+    }
+    return !enabled;
+}
+
+bool Transport::setGro(bool enabled) {
+    if (enabled) {
+        LOG_INFO(Color::YELLOW << "[i]" << Color::RESET << " UDP GRO is not available with this transport");
+    }
+    return !enabled;
+}
+
+bool Transport::setZeroCopy(bool enabled) {
+    if (enabled) {
+        LOG_INFO(Color::YELLOW << "[i]" << Color::RESET << " MSG_ZEROCOPY is not available with this transport");
+    }
+    return !enabled;
+}
+
+Transport* createTransport(TransportType type) {
+    if (type == IO_URING_TRANSPORT) {
+        try {
+            return new IoUringTransport();
+        } catch (const std::exception& e) {
+            LOG_INFO(Color::YELLOW << "[i]" << Color::RESET << " io_uring unavailable (" << e.what()
+                      << "), using UDP sockets");
+        }
+    }
+    if (type == XDP_TRANSPORT) {
+        try {
+            return new XdpTransport(XdpTransport::getDefaultInterface());
+        } catch (const std::exception& e) {
+            LOG_INFO(Color::YELLOW << "[i]" << Color::RESET << " AF_XDP unavailable (" << e.what()
+                      << "), using UDP sockets");
+        }
+    }
+
+    return new UdpTransport();
+}
@@ -0,0 +1,467 @@
+#include "header/udp_transport.hpp"
+#include "header/logger.hpp"
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <unistd.h>
+#include <errno.h>
+#include <cstring>
+#include <chrono>
+#include <stdexcept>
+#include <poll.h>
+#include <linux/errqueue.h>
+
+using namespace std;
+
+const uint32_t UdpTransport::MAX_UDP_PAYLOAD;
+const uint32_t UdpTransport::GSO_MAX_SEGMENTS;
+const uint32_t UdpTransport::MAX_GRO_BUFFER;
+
+UdpTransport::UdpTransport() :
+    currentTimeoutMs(-1),
+    gsoEnabled(false),
+    groEnabled(false),
+    zeroCopyEnabled(false),
+    zeroCopyNextId(0),
+    rxBuffer(MAX_DATAGRAM_SIZE),
+    rxLength(0),
+    rxOffset(0),
+    rxSegmentSize(0) {
+
+    socket = ::socket(AF_INET, SOCK_DGRAM, 0);
+    if (socket < 0) {
+        throw runtime_error("Socket creation failed");
+    }
+}
+
+UdpTransport::~UdpTransport() {
+    close();
+}
+
+// helper methods
+void UdpTransport::setTimeout(int timeoutMs) {
+    if (timeoutMs == currentTimeoutMs) {
+        return;
+    }
+
+    // A zero timeval means block forever
+    struct timeval tv = {0, 0};
+    if (timeoutMs > 0) {
+        tv.tv_sec = timeoutMs / 1000;
+        tv.tv_usec = (timeoutMs % 1000) * 1000;
+    }
+    setsockopt(socket, SOL_SOCKET, SO_RCVTIMEO, (const char*)&tv, sizeof tv);
+    currentTimeoutMs = timeoutMs;
+}
+
+bool UdpTransport::bind(const struct sockaddr_in& addr) {
+    return ::bind(socket, (const struct sockaddr*)&addr, sizeof(addr)) == 0;
+}
+
+bool UdpTransport::sendSegment(const Segment& segment, const struct sockaddr_in& addr) {
+    // Header and payload travel in a single datagram
+    uint8_t datagram[MAX_DATAGRAM_SIZE];
+    uint32_t length = encodeSegment(segment, datagram);
+
+    ssize_t sent = sendto(socket, datagram, length, 0,
+                          (struct sockaddr*)&addr, sizeof(addr));
+    
+    return sent >= 0;
+}
+
+bool UdpTransport::sendSegments(const Segment* segments, int count, const struct sockaddr_in& addr) {
+    if (count <= 0) {
+        return true;
+    }
+
+    if (zeroCopyEnabled) {
+        return sendZeroCopy(segments, count, addr);
+    }
+
+    if (txBuffer.size() < count * MAX_DATAGRAM_SIZE) {
+        txBuffer.resize(count * MAX_DATAGRAM_SIZE);
+    }
+
+    // Encode the whole window back to back
+    std::vector<uint32_t> lengths(count);
+    uint32_t offset = 0;
+    for (int i = 0; i < count; i++) {
+        lengths[i] = encodeSegment(segments[i], txBuffer.data() + offset);
+        offset += lengths[i];
+    }
+
+    if (!gsoEnabled) {
+        return sendBatch(txBuffer.data(), lengths, addr);
+    }
+
+    // Every datagram of a GSO batch must be gsoSize bytes, only the last one may be shorter
+    size_t first = 0;
+    offset = 0;
+    while (first < lengths.size()) {
+        uint32_t gsoSize = lengths[first];
+        uint32_t batchLength = lengths[first];
+        size_t batchCount = 1;
+        while (first + batchCount < lengths.size() && batchCount < GSO_MAX_SEGMENTS &&
+               lengths[first + batchCount - 1] == gsoSize &&
+               lengths[first + batchCount] <= gsoSize) {
+            batchLength += lengths[first + batchCount];
+            batchCount++;
+        }
+
+        bool sent;
+        if (batchCount == 1) {
+            sent = sendto(socket, txBuffer.data() + offset, batchLength, 0,
+                          (struct sockaddr*)&addr, sizeof(addr)) >= 0;
+        } else {
+            sent = sendGsoBatch(txBuffer.data() + offset, batchLength, gsoSize, addr);
+        }
+
+        if (!sent) {
+            if (errno != EIO && errno != EINVAL && errno != ENOPROTOOPT && errno != EOPNOTSUPP) {
+                return false;
+            }
+
+            // Kernel or device rejected UDP_SEGMENT, segment in software from now on
+            LOG_INFO(Color::YELLOW << "[i]" << Color::RESET << " UDP GSO rejected (" << strerror(errno)
+                 << "), falling back to batched sends");
+            gsoEnabled = false;
+            std::vector<uint32_t> remaining(lengths.begin() + first, lengths.end());
+            return sendBatch(txBuffer.data() + offset, remaining, addr);
+        }
+
+        first += batchCount;
+        offset += batchLength;
+    }
+
+    return true;
+}
+
+bool UdpTransport::sendGsoBatch(const uint8_t* data, uint32_t length, uint16_t gsoSize, const struct sockaddr_in& addr) {
+    struct iovec iov;
+    iov.iov_base = const_cast<uint8_t*>(data);
+    iov.iov_len = length;
+
+    char control[CMSG_SPACE(sizeof(uint16_t))] = {};
+    struct msghdr msg = {};
+    msg.msg_name = const_cast<struct sockaddr_in*>(&addr);
+    msg.msg_namelen = sizeof(addr);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_UDP;
+    cmsg->cmsg_type = UDP_SEGMENT;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+    memcpy(CMSG_DATA(cmsg), &gsoSize, sizeof(gsoSize));
+
+    return sendmsg(socket, &msg, 0) >= 0;
+}
+
+bool UdpTransport::sendBatch(const uint8_t* data, const std::vector<uint32_t>& lengths, const struct sockaddr_in& addr) {
+    std::vector<struct iovec> iovs(lengths.size());
+    std::vector<struct mmsghdr> msgs(lengths.size());
+
+    uint32_t offset = 0;
+    for (size_t i = 0; i < lengths.size(); i++) {
+        iovs[i].iov_base = const_cast<uint8_t*>(data + offset);
+        iovs[i].iov_len = lengths[i];
+        offset += lengths[i];
+
+        msgs[i] = {};
+        msgs[i].msg_hdr.msg_name = const_cast<struct sockaddr_in*>(&addr);
+        msgs[i].msg_hdr.msg_namelen = sizeof(addr);
+        msgs[i].msg_hdr.msg_iov = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    // sendmmsg may stop early, keep going until the whole window is out
+    size_t sentCount = 0;
+    while (sentCount < msgs.size()) {
+        int sent = sendmmsg(socket, msgs.data() + sentCount, msgs.size() - sentCount, 0);
+        if (sent < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        sentCount += sent;
+    }
+
+    return true;
+}
+
+bool UdpTransport::sendZeroCopy(const Segment* segments, int count, const struct sockaddr_in& addr) {
+    reapZeroCopyCompletions();
+
+    // Header goes from the pending entry, payload straight from the SegmentHandler buffer
+    size_t firstPending = zeroCopyPending.size();
+    std::vector<struct iovec> iovs(count * 2);
+    std::vector<struct mmsghdr> msgs(count);
+    for (int i = 0; i < count; i++) {
+        zeroCopyPending.push_back({});
+        ZeroCopySend& pending = zeroCopyPending.back();
+        pending.payload = segments[i].payload;
+        pending.completed = false;
+        memcpy(pending.header, &segments[i], SEGMENT_HEADER_SIZE);
+
+        iovs[2 * i].iov_base = pending.header;
+        iovs[2 * i].iov_len = SEGMENT_HEADER_SIZE;
+        iovs[2 * i + 1].iov_base = segments[i].payload;
+        iovs[2 * i + 1].iov_len = segments[i].payloadSize;
+
+        msgs[i] = {};
+        msgs[i].msg_hdr.msg_name = const_cast<struct sockaddr_in*>(&addr);
+        msgs[i].msg_hdr.msg_namelen = sizeof(addr);
+        msgs[i].msg_hdr.msg_iov = &iovs[2 * i];
+        msgs[i].msg_hdr.msg_iovlen = (segments[i].payload && segments[i].payloadSize > 0) ? 2 : 1;
+    }
+
+    int sentCount = 0;
+    while (sentCount < count) {
+        int sent = sendmmsg(socket, msgs.data() + sentCount, count - sentCount, MSG_ZEROCOPY);
+        if (sent < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        sentCount += sent;
+    }
+    int sendErrno = errno;
+
+    // Every datagram that went out gets the next notification id
+    for (int i = 0; i < sentCount; i++) {
+        ZeroCopySend& pending = zeroCopyPending[firstPending + i];
+        pending.id = zeroCopyNextId++;
+        if (onPayloadPinned) {
+            onPayloadPinned(pending.payload);
+        }
+    }
+    zeroCopyPending.resize(firstPending + sentCount);
+
+    if (sentCount == count) {
+        return true;
+    }
+
+    // ENOBUFS means the pinned page budget (optmem) is used up, copy the rest instead
+    if (sendErrno != ENOBUFS) {
+        errno = sendErrno;
+        return false;
+    }
+    for (int i = sentCount; i < count; i++) {
+        if (!sendSegment(segments[i], addr)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void UdpTransport::reapZeroCopyCompletions() {
+    while (!zeroCopyPending.empty()) {
+        char control[CMSG_SPACE(sizeof(struct sock_extended_err) + sizeof(struct sockaddr_in))] = {};
+        struct msghdr msg = {};
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+
+        if (recvmsg(socket, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) {
+            break;
+        }
+
+        for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+            if (cmsg->cmsg_level != SOL_IP || cmsg->cmsg_type != IP_RECVERR) {
+                continue;
+            }
+
+            struct sock_extended_err err;
+            memcpy(&err, CMSG_DATA(cmsg), sizeof(err));
+            if (err.ee_origin != SO_EE_ORIGIN_ZEROCOPY || err.ee_errno != 0) {
+                continue;
+            }
+
+            // Notification covers ids [ee_info, ee_data], wraparound safe
+            uint32_t lo = err.ee_info;
+            uint32_t hi = err.ee_data;
+            for (auto& pending : zeroCopyPending) {
+                if (pending.id - lo <= hi - lo) {
+                    pending.completed = true;
+                }
+            }
+        }
+    }
+
+    // Hand buffers back in order, only from the front so pending headers never move
+    while (!zeroCopyPending.empty() && zeroCopyPending.front().completed) {
+        if (onPayloadReleased) {
+            onPayloadReleased(zeroCopyPending.front().payload);
+        }
+        zeroCopyPending.pop_front();
+    }
+}
+
+void UdpTransport::waitZeroCopyCompletions(int timeoutMs) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+
+    reapZeroCopyCompletions();
+    while (!zeroCopyPending.empty()) {
+        auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+            deadline - std::chrono::steady_clock::now()).count();
+        if (remaining <= 0) {
+            LOG_WARN(Color::RED << "[!]" << Color::RESET << " " << zeroCopyPending.size()
+                 << " zerocopy sends still pending, keeping their buffers");
+            return;
+        }
+
+        // Error queue readiness is always reported as POLLERR
+        struct pollfd pfd = {socket, 0, 0};
+        poll(&pfd, 1, remaining);
+        reapZeroCopyCompletions();
+    }
+}
+
+int32_t UdpTransport::receiveDatagrams(int flags) {
+    socklen_t addrLen = sizeof(rxAddr);
+
+    rxLength = 0;
+    rxOffset = 0;
+
+    if (!groEnabled) {
+        int32_t bytes = recvfrom(socket, rxBuffer.data(), rxBuffer.size(), flags,
+                                 (struct sockaddr*)&rxAddr, &addrLen);
+        if (bytes > 0) {
+            rxLength = bytes;
+            rxSegmentSize = bytes;
+        }
+        return bytes;
+    }
+
+    struct iovec iov;
+    iov.iov_base = rxBuffer.data();
+    iov.iov_len = rxBuffer.size();
+
+    char control[CMSG_SPACE(sizeof(int))] = {};
+    struct msghdr msg = {};
+    msg.msg_name = &rxAddr;
+    msg.msg_namelen = addrLen;
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    int32_t bytes = recvmsg(socket, &msg, flags);
+    if (bytes <= 0) {
+        return bytes;
+    }
+
+    // Without the cmsg the read holds a single datagram
+    rxLength = bytes;
+    rxSegmentSize = bytes;
+    for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO) {
+            int gsoSize;
+            memcpy(&gsoSize, CMSG_DATA(cmsg), sizeof(gsoSize));
+            if (gsoSize > 0) {
+                rxSegmentSize = gsoSize;
+            }
+        }
+    }
+
+    return bytes;
+}
+
+int32_t UdpTransport::receiveSegment(Segment& segment, struct sockaddr_in& addr, int timeoutMs) {
+    // Completions on the error queue keep the descriptor flagged (EPOLLERR) until read
+    if (!zeroCopyPending.empty()) {
+        reapZeroCopyCompletions();
+    }
+
+    if (rxOffset >= rxLength) {
+        int flags = 0;
+        if (timeoutMs == 0) {
+            flags = MSG_DONTWAIT;
+        } else {
+            setTimeout(timeoutMs);
+        }
+
+        int32_t bytes = receiveDatagrams(flags);
+        if (bytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return 0;
+        }
+        if (bytes <= 0) {
+            return -1;
+        }
+    }
+
+    // Take the next datagram out of the coalesced buffer, the payload stays in rxBuffer
+    uint8_t* datagram = rxBuffer.data() + rxOffset;
+    uint32_t length = std::min(rxSegmentSize, rxLength - rxOffset);
+    rxOffset += length;
+    addr = rxAddr;
+
+    if (!decodeSegment(datagram, length, segment)) {
+        return -1;
+    }
+    
+    return length;
+}
+
+bool UdpTransport::setGso(bool enabled) {
+    gsoEnabled = enabled;
+    if (!enabled) {
+        return true;
+    }
+
+    // Probe for kernel support (Linux 4.18+), the per-send cmsg overrides this value
+    int gsoSize = 0;
+    if (setsockopt(socket, SOL_UDP, UDP_SEGMENT, &gsoSize, sizeof(gsoSize)) < 0) {
+        LOG_INFO(Color::YELLOW << "[i]" << Color::RESET << " UDP GSO not supported (" << strerror(errno)
+             << "), using batched sends");
+        gsoEnabled = false;
+    }
+    return gsoEnabled;
+}
+
+bool UdpTransport::setGro(bool enabled) {
+    int value = enabled ? 1 : 0;
+    if (setsockopt(socket, SOL_UDP, UDP_GRO, &value, sizeof(value)) < 0) {
+        if (enabled) {
+            LOG_INFO(Color::YELLOW << "[i]" << Color::RESET << " UDP GRO not supported (" << strerror(errno)
+                 << "), receiving one datagram per read");
+        }
+        groEnabled = false;
+        return !enabled;
+    }
+
+    groEnabled = enabled;
+    if (groEnabled && rxBuffer.size() < MAX_GRO_BUFFER) {
+        rxBuffer.resize(MAX_GRO_BUFFER);
+    }
+    return true;
+}
+
+bool UdpTransport::setZeroCopy(bool enabled) {
+    int value = enabled ? 1 : 0;
+    if (setsockopt(socket, SOL_SOCKET, SO_ZEROCOPY, &value, sizeof(value)) < 0) {
+        if (enabled) {
+            LOG_INFO(Color::YELLOW << "[i]" << Color::RESET << " MSG_ZEROCOPY not supported (" << strerror(errno)
+                 << "), copying send buffers");
+        }
+        zeroCopyEnabled = false;
+        return !enabled;
+    }
+
+    zeroCopyEnabled = enabled;
+    return true;
+}
+
+void UdpTransport::close() {
+    if (socket < 0) {
+        return;
+    }
+
+    waitZeroCopyCompletions(1000);
+    ::close(socket);
+    socket = -1;
+}
+
+int UdpTransport::fd() const {
+    return socket;
+}
@@ -0,0 +1,681 @@
+#include "header/xdp_transport.hpp"
+#include "header/logger.hpp"
+#include <sys/socket.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+#include <sys/epoll.h>
+#include <sys/syscall.h>
+#include <net/if.h>
+#include <net/route.h>
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <netinet/udp.h>
+#include <arpa/inet.h>
+#include <ifaddrs.h>
+#include <linux/bpf.h>
+#include <linux/if_link.h>
+#include <unistd.h>
+#include <errno.h>
+#include <cstring>
+#include <cstddef>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+const uint32_t XdpTransport::FRAME_SIZE;
+const uint32_t XdpTransport::FRAME_COUNT;
+const uint32_t XdpTransport::RING_SIZE;
+
+std::string XdpTransport::defaultInterface;
+
+// Ethernet, IPv4 without options and UDP headers in front of every datagram
+static const uint32_t ETH_HEADER_SIZE = 14;
+static const uint32_t IP_HEADER_SIZE = 20;
+static const uint32_t UDP_HEADER_SIZE = 8;
+static const uint32_t FRAME_HEADERS_SIZE = ETH_HEADER_SIZE + IP_HEADER_SIZE + UDP_HEADER_SIZE;
+
+// How often an unresolved next hop is looked up again, the kernel sends meanwhile
+static const std::chrono::milliseconds NEIGHBOUR_RETRY(100);
+
+static long bpf(int command, union bpf_attr& attr) {
+    return syscall(__NR_bpf, command, &attr, sizeof(attr));
+}
+
+static struct bpf_insn instruction(uint8_t code, uint8_t dst, uint8_t src, int16_t offset, int32_t imm) {
+    struct bpf_insn insn = {};
+    insn.code = code;
+    insn.dst_reg = dst;
+    insn.src_reg = src;
+    insn.off = offset;
+    insn.imm = imm;
+    return insn;
+}
+
+static uint16_t ipChecksum(const uint8_t* header, uint32_t length) {
+    uint32_t sum = 0;
+    for (uint32_t i = 0; i < length; i += 2) {
+        sum += (header[i] << 8) | header[i + 1];
+    }
+    while (sum >> 16) {
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    }
+    return htons(~sum);
+}
+
+void XdpTransport::setDefaultInterface(const std::string& name) {
+    defaultInterface = name;
+}
+
+const std::string& XdpTransport::getDefaultInterface() {
+    return defaultInterface;
+}
+
+XdpTransport::XdpTransport(const std::string& interface) :
+    interfaceName(interface),
+    ifindex(0),
+    localMac{},
+    localIp(0),
+    mtu(1500),
+    bound(false),
+    localPort(0),
+    xsk(-1),
+    epollFd(-1),
+    mapFd(-1),
+    progFd(-1),
+    linkFd(-1),
+    attached(false),
+    umem(nullptr),
+    rx{},
+    tx{},
+    fill{},
+    completion{},
+    currentFrame(-1),
+    nextIpId(0) {
+
+    ifindex = if_nametoindex(interface.c_str());
+    if (interface.empty() || ifindex == 0 || interface.size() >= IFNAMSIZ) {
+        throw std::runtime_error("no interface '" + interface + "'");
+    }
+
+    struct ifreq request = {};
+    strncpy(request.ifr_name, interface.c_str(), IFNAMSIZ - 1);
+    if (ioctl(fallback.fd(), SIOCGIFHWADDR, &request) < 0) {
+        throw std::runtime_error("cannot read the MAC address of " + interface);
+    }
+    memcpy(localMac, request.ifr_hwaddr.sa_data, sizeof(localMac));
+    if (ioctl(fallback.fd(), SIOCGIFMTU, &request) == 0) {
+        mtu = request.ifr_mtu;
+    }
+
+    struct ifaddrs* addresses;
+    if (getifaddrs(&addresses) == 0) {
+        for (struct ifaddrs* entry = addresses; entry; entry = entry->ifa_next) {
+            if (entry->ifa_addr && entry->ifa_addr->sa_family == AF_INET && interface == entry->ifa_name) {
+                localIp = ((struct sockaddr_in*)entry->ifa_addr)->sin_addr.s_addr;
+                break;
+            }
+        }
+        freeifaddrs(addresses);
+    }
+    if (localIp == 0) {
+        throw std::runtime_error(interface + " has no IPv4 address");
+    }
+
+    xsk = ::socket(AF_XDP, SOCK_RAW | SOCK_CLOEXEC, 0);
+    if (xsk < 0) {
+        throw std::runtime_error(std::string("AF_XDP socket failed: ") + strerror(errno));
+    }
+
+    // Frame memory shared with the kernel, registered once
+    void* memory = mmap(nullptr, size_t(FRAME_SIZE) * FRAME_COUNT, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) {
+        close();
+        throw std::runtime_error("UMEM allocation failed");
+    }
+    umem = static_cast<uint8_t*>(memory);
+
+    struct xdp_umem_reg registration = {};
+    registration.addr = (uint64_t)umem;
+    registration.len = size_t(FRAME_SIZE) * FRAME_COUNT;
+    registration.chunk_size = FRAME_SIZE;
+    int ringSize = RING_SIZE;
+    if (setsockopt(xsk, SOL_XDP, XDP_UMEM_REG, &registration, sizeof(registration)) < 0 ||
+        setsockopt(xsk, SOL_XDP, XDP_UMEM_FILL_RING, &ringSize, sizeof(ringSize)) < 0 ||
+        setsockopt(xsk, SOL_XDP, XDP_UMEM_COMPLETION_RING, &ringSize, sizeof(ringSize)) < 0 ||
+        setsockopt(xsk, SOL_XDP, XDP_RX_RING, &ringSize, sizeof(ringSize)) < 0 ||
+        setsockopt(xsk, SOL_XDP, XDP_TX_RING, &ringSize, sizeof(ringSize)) < 0) {
+        std::string error = strerror(errno);
+        close();
+        throw std::runtime_error("UMEM registration failed: " + error);
+    }
+
+    struct xdp_mmap_offsets offsets;
+    socklen_t length = sizeof(offsets);
+    if (getsockopt(xsk, SOL_XDP, XDP_MMAP_OFFSETS, &offsets, &length) < 0) {
+        close();
+        throw std::runtime_error("AF_XDP ring offsets unavailable");
+    }
+    try {
+        mapRing(rx, offsets.rx, XDP_PGOFF_RX_RING, sizeof(struct xdp_desc));
+        mapRing(tx, offsets.tx, XDP_PGOFF_TX_RING, sizeof(struct xdp_desc));
+        mapRing(fill, offsets.fr, XDP_UMEM_PGOFF_FILL_RING, sizeof(uint64_t));
+        mapRing(completion, offsets.cr, XDP_UMEM_PGOFF_COMPLETION_RING, sizeof(uint64_t));
+    } catch (const std::runtime_error&) {
+        close();
+        throw;
+    }
+
+    // Hand every receive frame to the kernel, keep the send frames
+    uint64_t* fillAddrs = static_cast<uint64_t*>(fill.descs);
+    for (uint32_t i = 0; i < FRAME_COUNT / 2; i++) {
+        fillAddrs[i & fill.mask] = uint64_t(i) * FRAME_SIZE;
+    }
+    __atomic_store_n(fill.producer, FRAME_COUNT / 2, __ATOMIC_RELEASE);
+    for (uint32_t i = FRAME_COUNT / 2; i < FRAME_COUNT; i++) {
+        freeFrames.push_back(uint64_t(i) * FRAME_SIZE);
+    }
+
+    // Zero-copy where the driver supports it, copy mode everywhere else (veth, generic XDP)
+    struct sockaddr_xdp address = {};
+    address.sxdp_family = AF_XDP;
+    address.sxdp_ifindex = ifindex;
+    address.sxdp_queue_id = 0;
+    address.sxdp_flags = XDP_ZEROCOPY;
+    if (::bind(xsk, (struct sockaddr*)&address, sizeof(address)) < 0) {
+        address.sxdp_flags = XDP_COPY;
+        if (::bind(xsk, (struct sockaddr*)&address, sizeof(address)) < 0) {
+            std::string error = strerror(errno);
+            close();
+            throw std::runtime_error("AF_XDP bind to " + interface + " failed: " + error);
+        }
+    }
+
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    struct epoll_event event = {};
+    event.events = EPOLLIN;
+    if (epollFd < 0 || epoll_ctl(epollFd, EPOLL_CTL_ADD, xsk, &event) < 0 ||
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, fallback.pollFd(), &event) < 0) {
+        close();
+        throw std::runtime_error("epoll setup failed");
+    }
+
+    LOG_INFO(Color::YELLOW << "[i]" << Color::RESET << " AF_XDP socket on " << interface << " queue 0 ("
+             << (address.sxdp_flags == XDP_ZEROCOPY ? "zero-copy" : "copy") << " mode)");
+}
+
+XdpTransport::~XdpTransport() {
+    close();
+}
+
+void XdpTransport::mapRing(Ring& ring, const struct xdp_ring_offset& offset, uint64_t pgoff, size_t descSize) {
+    ring.mapSize = offset.desc + RING_SIZE * descSize;
+    void* memory = mmap(nullptr, ring.mapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, xsk, pgoff);
+    if (memory == MAP_FAILED) {
+        ring.map = nullptr;
+        throw std::runtime_error("AF_XDP ring mmap failed");
+    }
+
+    uint8_t* base = static_cast<uint8_t*>(memory);
+    ring.map = memory;
+    ring.producer = reinterpret_cast<uint32_t*>(base + offset.producer);
+    ring.consumer = reinterpret_cast<uint32_t*>(base + offset.consumer);
+    ring.descs = base + offset.desc;
+    ring.mask = RING_SIZE - 1;
+}
+
+void XdpTransport::unmapRing(Ring& ring) {
+    if (ring.map) {
+        munmap(ring.map, ring.mapSize);
+        ring.map = nullptr;
+    }
+}
+
+bool XdpTransport::attachProgram() {
+    // XSKMAP with this socket as the entry of queue 0
+    union bpf_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.map_type = BPF_MAP_TYPE_XSKMAP;
+    attr.key_size = sizeof(uint32_t);
+    attr.value_size = sizeof(uint32_t);
+    attr.max_entries = 1;
+    mapFd = bpf(BPF_MAP_CREATE, attr);
+    if (mapFd < 0) {
+        LOG_INFO(Color::YELLOW << "[i]" << Color::RESET << " XSKMAP creation failed: " << strerror(errno));
+        return false;
+    }
+
+    uint32_t queue = 0;
+    uint32_t socketFd = xsk;
+    memset(&attr, 0, sizeof(attr));
+    attr.map_fd = mapFd;
+    attr.key = (uint64_t)&queue;
+    attr.value = (uint64_t)&socketFd;
+    attr.flags = BPF_ANY;
+    if (bpf(BPF_MAP_UPDATE_ELEM, attr) < 0) {
+        LOG_INFO(Color::YELLOW << "[i]" << Color::RESET << " XSKMAP update failed: " << strerror(errno));
+        return false;
+    }
+
+    // IPv4/UDP datagrams without options or fragmentation for our port go to
+    // the socket of their queue, everything else to the kernel
+    std::vector<struct bpf_insn> program;
+    std::vector<size_t> toPass;
+    auto emit = [&](uint8_t code, uint8_t dst, uint8_t src, int16_t offset, int32_t imm) {
+        program.push_back(instruction(code, dst, src, offset, imm));
+    };
+    auto passUnless = [&](uint8_t reg, int32_t value) {
+        toPass.push_back(program.size());
+        emit(BPF_JMP | BPF_JNE | BPF_K, reg, 0, 0, value);
+    };
+
+    emit(BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_6, BPF_REG_1, 0, 0);
+    emit(BPF_LDX | BPF_W | BPF_MEM, BPF_REG_2, BPF_REG_6, offsetof(struct xdp_md, data), 0);
+    emit(BPF_LDX | BPF_W | BPF_MEM, BPF_REG_3, BPF_REG_6, offsetof(struct xdp_md, data_end), 0);
+    emit(BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_4, BPF_REG_2, 0, 0);
+    emit(BPF_ALU64 | BPF_ADD | BPF_K, BPF_REG_4, 0, 0, FRAME_HEADERS_SIZE);
+    toPass.push_back(program.size());
+    emit(BPF_JMP | BPF_JGT | BPF_X, BPF_REG_4, BPF_REG_3, 0, 0);
+
+    // Loads are in host order like htons() values, so the comparisons hold on any host
+    emit(BPF_LDX | BPF_H | BPF_MEM, BPF_REG_5, BPF_REG_2, 12, 0);
+    passUnless(BPF_REG_5, htons(0x0800));
+    emit(BPF_LDX | BPF_B | BPF_MEM, BPF_REG_5, BPF_REG_2, ETH_HEADER_SIZE, 0);
+    passUnless(BPF_REG_5, 0x45);
+    emit(BPF_LDX | BPF_H | BPF_MEM, BPF_REG_5, BPF_REG_2, ETH_HEADER_SIZE + 6, 0);
+    emit(BPF_ALU64 | BPF_AND | BPF_K, BPF_REG_5, 0, 0, htons(IP_MF | IP_OFFMASK));
+    passUnless(BPF_REG_5, 0);
+    emit(BPF_LDX | BPF_B | BPF_MEM, BPF_REG_5, BPF_REG_2, ETH_HEADER_SIZE + 9, 0);
+    passUnless(BPF_REG_5, IPPROTO_UDP);
+    emit(BPF_LDX | BPF_H | BPF_MEM, BPF_REG_5, BPF_REG_2, ETH_HEADER_SIZE + IP_HEADER_SIZE + 2, 0);
+    passUnless(BPF_REG_5, localPort);
+
+    // bpf_redirect_map(&xsks, ctx->rx_queue_index, XDP_PASS)
+    emit(BPF_LD | BPF_DW | BPF_IMM, BPF_REG_1, BPF_PSEUDO_MAP_FD, 0, mapFd);
+    emit(0, 0, 0, 0, 0);
+    emit(BPF_LDX | BPF_W | BPF_MEM, BPF_REG_2, BPF_REG_6, offsetof(struct xdp_md, rx_queue_index), 0);
+    emit(BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_3, 0, 0, XDP_PASS);
+    emit(BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_redirect_map);
+    emit(BPF_JMP | BPF_EXIT, 0, 0, 0, 0);
+
+    size_t pass = program.size();
+    emit(BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_0, 0, 0, XDP_PASS);
+    emit(BPF_JMP | BPF_EXIT, 0, 0, 0, 0);
+    for (size_t jump : toPass) {
+        program[jump].off = pass - (jump + 1);
+    }
+
+    static const char LICENSE[] = "Dual BSD/GPL";
+    std::vector<char> log(16384);
+    memset(&attr, 0, sizeof(attr));
+    attr.prog_type = BPF_PROG_TYPE_XDP;
+    attr.insns = (uint64_t)program.data();
+    attr.insn_cnt = program.size();
+    attr.license = (uint64_t)LICENSE;
+    attr.log_buf = (uint64_t)log.data();
+    attr.log_size = log.size();
+    attr.log_level = 1;
+    progFd = bpf(BPF_PROG_LOAD, attr);
+    if (progFd < 0) {
+        LOG_INFO(Color::YELLOW << "[i]" << Color::RESET << " XDP program rejected: " << strerror(errno));
+        LOG_DEBUG(log.data());
+        return false;
+    }
+
+    // Detached automatically when the link is closed, also when the process dies.
+    // Generic mode when the driver has no native XDP for this setup (veth above ~3.5 KB MTU).
+    for (uint32_t mode : {0u, uint32_t(XDP_FLAGS_SKB_MODE)}) {
+        memset(&attr, 0, sizeof(attr));
+        attr.link_create.prog_fd = progFd;
+        attr.link_create.target_ifindex = ifindex;
+        attr.link_create.attach_type = BPF_XDP;
+        attr.link_create.flags = mode;
+        linkFd = bpf(BPF_LINK_CREATE, attr);
+        if (linkFd >= 0) {
+            break;
+        }
+    }
+    if (linkFd < 0) {
+        LOG_INFO(Color::YELLOW << "[i]" << Color::RESET << " XDP attach to " << interfaceName << " failed: " << strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+bool XdpTransport::bind(const struct sockaddr_in& addr) {
+    if (bound || !fallback.bind(addr)) {
+        return false;
+    }
+    bound = true;
+
+    struct sockaddr_in actual = {};
+    socklen_t length = sizeof(actual);
+    getsockname(fallback.fd(), (struct sockaddr*)&actual, &length);
+    localPort = actual.sin_port;
+
+    attached = xsk >= 0 && attachProgram();
+    if (attached) {
+        LOG_INFO(Color::YELLOW << "[i]" << Color::RESET << " XDP program on " << interfaceName
+                 << " redirects port " << ntohs(localPort));
+    } else {
+        LOG_INFO(Color::YELLOW << "[i]" << Color::RESET << " AF_XDP unavailable on " << interfaceName
+                 << ", using UDP sockets");
+    }
+    return true;
+}
+
+bool XdpTransport::ensureBound() {
+    if (bound) {
+        return true;
+    }
+    // Like an unbound UDP socket: an ephemeral port on the first send
+    struct sockaddr_in any = {};
+    any.sin_family = AF_INET;
+    any.sin_addr.s_addr = htonl(INADDR_ANY);
+    return bind(any);
+}
+
+uint32_t XdpTransport::nextHop(uint32_t dest) {
+    auto cached = hops.find(dest);
+    if (cached != hops.end()) {
+        return cached->second;
+    }
+
+    // Longest matching route of this interface, in the kernel's main table
+    std::ifstream routes("/proc/net/route");
+    std::string line;
+    std::getline(routes, line);
+
+    uint32_t hop = 0;
+    int bestBits = -1;
+    while (std::getline(routes, line)) {
+        std::istringstream fields(line);
+        std::string name;
+        uint32_t destination, gateway, mask;
+        unsigned flags, refCount, use, metric;
+        fields >> name >> std::hex >> destination >> gateway >> flags >> std::dec >> refCount >> use >> metric >> std::hex >> mask;
+        if (!fields || name != interfaceName || !(flags & RTF_UP) || (dest & mask) != destination) {
+            continue;
+        }
+        int bits = __builtin_popcount(mask);
+        if (bits > bestBits) {
+            bestBits = bits;
+            hop = (flags & RTF_GATEWAY) ? gateway : dest;
+        }
+    }
+    hops[dest] = hop;
+    return hop;
+}
+
+bool XdpTransport::resolveNextHop(uint32_t dest, uint8_t* mac) {
+    auto known = neighbours.find(dest);
+    if (known != neighbours.end()) {
+        memcpy(mac, known->second.data(), 6);
+        return true;
+    }
+
+    // Not resolved yet: the kernel sends (and resolves) until the entry shows up
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    if (now - neighboursRead < NEIGHBOUR_RETRY) {
+        return false;
+    }
+    neighboursRead = now;
+
+    uint32_t hop = nextHop(dest);
+    if (hop == 0) {
+        return false;
+    }
+
+    std::ifstream table("/proc/net/arp");
+    std::string line;
+    std::getline(table, line);
+    while (std::getline(table, line)) {
+        std::istringstream fields(line);
+        std::string ip, type, flags, hardware, mask, device;
+        fields >> ip >> type >> flags >> hardware >> mask >> device;
+        if (device != interfaceName || inet_addr(ip.c_str()) != hop || !(std::stoul(flags, nullptr, 16) & 0x2)) {
+            continue;
+        }
+
+        std::array<uint8_t, 6> address;
+        unsigned bytes[6];
+        if (sscanf(hardware.c_str(), "%x:%x:%x:%x:%x:%x", &bytes[0], &bytes[1], &bytes[2], &bytes[3], &bytes[4], &bytes[5]) != 6) {
+            return false;
+        }
+        for (int i = 0; i < 6; i++) {
+            address[i] = bytes[i];
+        }
+        neighbours[dest] = address;
+        memcpy(mac, address.data(), 6);
+        return true;
+    }
+    return false;
+}
+
+uint32_t XdpTransport::buildFrame(uint8_t* frame, const Segment& segment, const struct sockaddr_in& addr, const uint8_t* mac) {
+    uint32_t payloadLength = encodeSegment(segment, frame + FRAME_HEADERS_SIZE);
+
+    memcpy(frame, mac, 6);
+    memcpy(frame + 6, localMac, 6);
+    frame[12] = 0x08;
+    frame[13] = 0x00;
+
+    struct iphdr ip = {};
+    ip.version = 4;
+    ip.ihl = IP_HEADER_SIZE / 4;
+    ip.tot_len = htons(IP_HEADER_SIZE + UDP_HEADER_SIZE + payloadLength);
+    ip.id = htons(nextIpId++);
+    ip.frag_off = htons(IP_DF);
+    ip.ttl = 64;
+    ip.protocol = IPPROTO_UDP;
+    ip.saddr = localIp;
+    ip.daddr = addr.sin_addr.s_addr;
+    memcpy(frame + ETH_HEADER_SIZE, &ip, IP_HEADER_SIZE);
+    ip.check = ipChecksum(frame + ETH_HEADER_SIZE, IP_HEADER_SIZE);
+    memcpy(frame + ETH_HEADER_SIZE, &ip, IP_HEADER_SIZE);
+
+    // No UDP checksum (optional over IPv4), every segment carries its own
+    struct udphdr udp = {};
+    udp.source = localPort;
+    udp.dest = addr.sin_port;
+    udp.len = htons(UDP_HEADER_SIZE + payloadLength);
+    memcpy(frame + ETH_HEADER_SIZE + IP_HEADER_SIZE, &udp, UDP_HEADER_SIZE);
+
+    return FRAME_HEADERS_SIZE + payloadLength;
+}
+
+void XdpTransport::reclaimFrames() {
+    uint32_t consumer = *completion.consumer;
+    uint32_t producer = __atomic_load_n(completion.producer, __ATOMIC_ACQUIRE);
+    uint64_t* addrs = static_cast<uint64_t*>(completion.descs);
+    for (; consumer != producer; consumer++) {
+        freeFrames.push_back(addrs[consumer & completion.mask]);
+    }
+    __atomic_store_n(completion.consumer, consumer, __ATOMIC_RELEASE);
+}
+
+void XdpTransport::kick() {
+    // Copy mode transmits inside this call, zero-copy drivers are only woken up
+    if (sendto(xsk, nullptr, 0, MSG_DONTWAIT, nullptr, 0) < 0 &&
+        errno != EAGAIN && errno != EBUSY && errno != ENOBUFS && errno != ENETDOWN) {
+        LOG_WARN(Color::RED << "[!]" << Color::RESET << " AF_XDP transmit failed: " << strerror(errno));
+    }
+}
+
+bool XdpTransport::sendSegment(const Segment& segment, const struct sockaddr_in& addr) {
+    return sendSegments(&segment, 1, addr);
+}
+
+bool XdpTransport::sendSegments(const Segment* segments, int count, const struct sockaddr_in& addr) {
+    if (count <= 0) {
+        return true;
+    }
+    if (!ensureBound()) {
+        return false;
+    }
+
+    uint32_t largest = 0;
+    for (int i = 0; i < count; i++) {
+        largest = std::max(largest, segments[i].payloadSize);
+    }
+    uint8_t mac[6];
+    bool direct = attached && addr.sin_addr.s_addr != localIp &&
+                  IP_HEADER_SIZE + UDP_HEADER_SIZE + SEGMENT_HEADER_SIZE + largest <= mtu &&
+                  resolveNextHop(addr.sin_addr.s_addr, mac);
+    if (!direct) {
+        return fallback.sendSegments(segments, count, addr);
+    }
+
+    reclaimFrames();
+    uint32_t producer = *tx.producer;
+    struct xdp_desc* descs = static_cast<struct xdp_desc*>(tx.descs);
+    for (int i = 0; i < count; i++) {
+        for (int attempt = 0; freeFrames.empty() && attempt < 100; attempt++) {
+            // Every send frame is in flight, push out what is queued and take back the sent ones
+            __atomic_store_n(tx.producer, producer, __ATOMIC_RELEASE);
+            kick();
+            reclaimFrames();
+        }
+        if (freeFrames.empty()) {
+            __atomic_store_n(tx.producer, producer, __ATOMIC_RELEASE);
+            return false;
+        }
+
+        uint64_t frame = freeFrames.back();
+        freeFrames.pop_back();
+        struct xdp_desc& desc = descs[producer & tx.mask];
+        desc.addr = frame;
+        desc.len = buildFrame(umem + frame, segments[i], addr, mac);
+        desc.options = 0;
+        producer++;
+    }
+
+    // The whole window with one wakeup
+    __atomic_store_n(tx.producer, producer, __ATOMIC_RELEASE);
+    kick();
+    return true;
+}
+
+void XdpTransport::recycleFrame() {
+    if (currentFrame < 0) {
+        return;
+    }
+    uint32_t producer = *fill.producer;
+    static_cast<uint64_t*>(fill.descs)[producer & fill.mask] = currentFrame & ~uint64_t(FRAME_SIZE - 1);
+    __atomic_store_n(fill.producer, producer + 1, __ATOMIC_RELEASE);
+    currentFrame = -1;
+}
+
+bool XdpTransport::takeFrame(Segment& segment, struct sockaddr_in& addr, int32_t& length) {
+    uint32_t consumer = *rx.consumer;
+    uint32_t producer = __atomic_load_n(rx.producer, __ATOMIC_ACQUIRE);
+    struct xdp_desc* descs = static_cast<struct xdp_desc*>(rx.descs);
+
+    while (consumer != producer) {
+        struct xdp_desc desc = descs[consumer & rx.mask];
+        consumer++;
+        __atomic_store_n(rx.consumer, consumer, __ATOMIC_RELEASE);
+
+        // The frame goes back to the fill ring on the next receive, the payload points into it
+        currentFrame = desc.addr;
+        uint8_t* frame = umem + desc.addr;
+        uint16_t udpLength;
+        memcpy(&udpLength, frame + ETH_HEADER_SIZE + IP_HEADER_SIZE + 4, sizeof(udpLength));
+        udpLength = ntohs(udpLength);
+        if (desc.len < FRAME_HEADERS_SIZE || udpLength < UDP_HEADER_SIZE ||
+            ETH_HEADER_SIZE + IP_HEADER_SIZE + udpLength > desc.len) {
+            recycleFrame();
+            continue;
+        }
+
+        addr = {};
+        addr.sin_family = AF_INET;
+        memcpy(&addr.sin_addr.s_addr, frame + ETH_HEADER_SIZE + 12, 4);
+        memcpy(&addr.sin_port, frame + ETH_HEADER_SIZE + IP_HEADER_SIZE, 2);
+        length = udpLength - UDP_HEADER_SIZE;
+        if (!decodeSegment(frame + FRAME_HEADERS_SIZE, length, segment)) {
+            recycleFrame();
+            continue;
+        }
+
+        // A directly connected sender's MAC address is the one to answer to
+        uint32_t source = addr.sin_addr.s_addr;
+        if (!neighbours.count(source) && nextHop(source) == source) {
+            std::array<uint8_t, 6> address;
+            memcpy(address.data(), frame + 6, 6);
+            neighbours[source] = address;
+        }
+        return true;
+    }
+    return false;
+}
+
+int32_t XdpTransport::receiveSegment(Segment& segment, struct sockaddr_in& addr, int timeoutMs) {
+    recycleFrame();
+
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+    while (true) {
+        int32_t length;
+        if (attached && takeFrame(segment, addr, length)) {
+            return length;
+        }
+        // Whatever the program passed to the kernel
+        int32_t bytes = fallback.receiveSegment(segment, addr, 0);
+        if (bytes != 0 || timeoutMs == 0) {
+            return bytes;
+        }
+
+        int waitMs = -1;
+        if (timeoutMs > 0) {
+            waitMs = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+            if (waitMs <= 0) {
+                return 0;
+            }
+        }
+        struct epoll_event event;
+        int ready = epoll_wait(epollFd, &event, 1, waitMs);
+        if (ready < 0 && errno != EINTR) {
+            return -1;
+        }
+        if (ready == 0) {
+            return 0;
+        }
+    }
+}
+
+void XdpTransport::close() {
+    // Closing the link detaches the program, the kernel stack gets the port back
+    for (int* descriptor : {&linkFd, &progFd, &mapFd}) {
+        if (*descriptor >= 0) {
+            ::close(*descriptor);
+            *descriptor = -1;
+        }
+    }
+    attached = false;
+
+    unmapRing(rx);
+    unmapRing(tx);
+    unmapRing(fill);
+    unmapRing(completion);
+    if (xsk >= 0) {
+        ::close(xsk);
+        xsk = -1;
+    }
+    if (umem) {
+        munmap(umem, size_t(FRAME_SIZE) * FRAME_COUNT);
+        umem = nullptr;
+    }
+    if (epollFd >= 0) {
+        ::close(epollFd);
+        epollFd = -1;
+    }
+    fallback.close();
+}
+
+int XdpTransport::fd() const {
+    return xsk;
+}
+
+int XdpTransport::pollFd() const {
+    return epollFd;
+}